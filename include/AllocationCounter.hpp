@@ -0,0 +1,27 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// counts operator new calls on every thread while enabled, for the
+// benchmarks. the operators are replaced in src/AllocationCounter.cpp, a
+// binary without it counts nothing.
+struct SAllocationCounter {
+  static inline std::atomic<bool> s_bEnabled{false};
+  static inline std::atomic<size_t> s_uCount{0};
+  static inline std::atomic<size_t> s_uBytes{0};
+
+  static void Start() {
+    s_uCount.store(0, std::memory_order_relaxed);
+    s_uBytes.store(0, std::memory_order_relaxed);
+    s_bEnabled.store(true, std::memory_order_release);
+  }
+  static void Stop() { s_bEnabled.store(false, std::memory_order_release); }
+
+  static void Add(size_t bytes) {
+    if (!s_bEnabled.load(std::memory_order_relaxed))
+      return;
+    s_uCount.fetch_add(1, std::memory_order_relaxed);
+    s_uBytes.fetch_add(bytes, std::memory_order_relaxed);
+  }
+};
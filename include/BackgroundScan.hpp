@@ -0,0 +1,136 @@
+#pragma once
+
+#include "FileSystem.hpp"
+#include "FileWatcher.hpp"
+#include <atomic>
+#include <boost/lockfree/queue.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// runs CFileSystem::ScanRoot on its own thread and streams the found
+// directories to the UI thread in batches through a lock free queue. every
+// visited directory is registered with the watcher (if any) as the scan goes.
+class CBackgroundScan {
+public:
+  // names stay packed per directory, a batch costs a few allocations no
+  // matter how many files it carries
+  using FileBatch = std::vector<SScannedDir>;
+
+  static constexpr size_t s_uBatchSize = 512; // files, not directories
+
+  explicit CBackgroundScan(const CFileSystem &fileSystem,
+                           CFileWatcher *watcher = nullptr)
+      : m_fileSystem(fileSystem), m_pWatcher(watcher), m_queue(64) {}
+
+  ~CBackgroundScan() {
+    m_bCancel.store(true, std::memory_order_relaxed);
+    if (m_thread.joinable())
+      m_thread.join();
+
+    FileBatch *batch = nullptr;
+    while (m_queue.pop(batch))
+      delete batch;
+  }
+
+  CBackgroundScan(const CBackgroundScan &) = delete;
+  CBackgroundScan &operator=(const CBackgroundScan &) = delete;
+
+  void Start() {
+    m_thread = std::thread([this] { Run(); });
+  }
+
+  bool IsDone() const { return m_bDone.load(std::memory_order_acquire); }
+
+  size_t GetFoundCount() const {
+    return m_uFound.load(std::memory_order_relaxed);
+  }
+
+  // blocks until a batch is queued, the scan is done or timeout passed.
+  // the queue itself never blocks, this only wakes whoever waits on it.
+  void WaitForBatch(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(m_mtxWake);
+    m_cvWake.wait_for(lock, timeout,
+                      [this] { return !m_queue.empty() || IsDone(); });
+  }
+
+  // UI thread only. hands over every batch that arrived since the last call
+  template <typename F> void Drain(F &&consume) {
+    FileBatch *batch = nullptr;
+    while (m_queue.pop(batch)) {
+      std::unique_ptr<FileBatch> owned(batch);
+      consume(*owned);
+    }
+  }
+
+private:
+  const CFileSystem &m_fileSystem;
+  CFileWatcher *m_pWatcher;
+  boost::lockfree::queue<FileBatch *> m_queue;
+  std::mutex m_mtxWake;
+  std::condition_variable m_cvWake;
+
+  std::thread m_thread;
+  std::atomic<bool> m_bCancel{false};
+  std::atomic<bool> m_bDone{false};
+  std::atomic<size_t> m_uFound{0};
+
+  struct SPending {
+    FileBatch dirs;
+    size_t files = 0;
+  };
+
+  void Push(SPending &pending) {
+    if (pending.dirs.empty())
+      return;
+
+    m_uFound.fetch_add(pending.files, std::memory_order_relaxed);
+    m_queue.push(new FileBatch(std::move(pending.dirs)));
+    pending.dirs.clear();
+    pending.files = 0;
+    Wake();
+  }
+
+  // taking the lock orders the push before a waiter's check
+  void Wake() {
+    { std::lock_guard<std::mutex> lock(m_mtxWake); }
+    m_cvWake.notify_all();
+  }
+
+  void Run() {
+    // one pending batch per worker, only touched by that worker
+    std::vector<SPending> l_vPending(m_fileSystem.GetScanThreadCount());
+
+    m_fileSystem.ScanRoot(
+        [this, &l_vPending](uint32_t worker, const SScannedDir &dir) {
+          if (m_pWatcher)
+            m_pWatcher->Watch(dir.relDir, dir.mtime);
+
+          if (dir.fileCount == 0)
+            return;
+
+          SPending &pending = l_vPending[worker];
+
+          SScannedDir &copy = pending.dirs.emplace_back();
+          copy.relDir = dir.relDir;
+          copy.fileNames = dir.fileNames;
+          copy.fileCount = dir.fileCount;
+
+          pending.files += dir.fileCount;
+          if (pending.files >= s_uBatchSize)
+            Push(pending);
+        },
+        &m_bCancel);
+
+    for (SPending &pending : l_vPending)
+      Push(pending);
+
+    m_bDone.store(true, std::memory_order_release);
+    Wake();
+  }
+};
@@ -0,0 +1,212 @@
+#pragma once
+
+#include "Hash.hpp"
+#include "ModelBaker.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+class CTextureCache;
+
+// baked models are stored by the hash of the source file's content, so a
+// file that is copied or renamed still finds its bake and an edited one never
+// finds a stale bake. a bake is an optimized <hash>.glb that the viewer
+// imports in place of its source.
+//
+// hashing means reading the whole source, the manifest remembers the hash
+// for each source path together with its mtime and size so an unchanged
+// file is looked up without being read. eHazBake writes it, the viewer only
+// reads it and adds what it hashed itself for the rest of the session.
+class CBakeCache {
+public:
+  explicit CBakeCache(std::filesystem::path dir = GetDefaultDir())
+      : m_dir(std::move(dir)) {}
+
+  // $XDG_CACHE_HOME/eHazViewer/baked, falling back to ~/.cache
+  static std::filesystem::path GetDefaultDir() {
+    if (const char *xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+      return std::filesystem::path(xdg) / "eHazViewer" / "baked";
+    if (const char *home = std::getenv("HOME"); home && *home)
+      return std::filesystem::path(home) / ".cache" / "eHazViewer" / "baked";
+    return "eHazBaked";
+  }
+
+  const std::filesystem::path &GetDir() const { return m_dir; }
+
+  // the viewer can bake sources that have no bake yet while loading them
+  void SetBakeMissing(bool bake) { m_bBakeMissing = bake; }
+  bool GetBakeMissing() const { return m_bBakeMissing; }
+
+  // where the deferred textures of bakes are kept block compressed, null
+  // decodes them on every load
+  void SetTextureCache(CTextureCache *cache) { m_pTextureCache = cache; }
+  CTextureCache *GetTextureCache() const { return m_pTextureCache; }
+
+  // the baker version is mixed in, a new baker never reuses old output
+  static uint64_t GetHashSeed() {
+    return HashFNV1a("eHazBake" + std::to_string(CModelBaker::s_uVersion));
+  }
+
+  std::filesystem::path GetBakedPath(uint64_t hash,
+                                     std::string_view ext) const {
+    char l_name[32];
+    std::snprintf(l_name, sizeof(l_name), "%016llx",
+                  static_cast<unsigned long long>(hash));
+    return m_dir / (std::string(l_name) + std::string(ext));
+  }
+
+  // empty if the content was never baked
+  std::filesystem::path Find(uint64_t hash) const {
+    std::error_code ec;
+    std::filesystem::path path = GetBakedPath(hash, ".glb");
+    if (!std::filesystem::is_regular_file(path, ec))
+      path.clear();
+    return path;
+  }
+
+  // true if the source is unchanged since it was last hashed
+  bool LookupHash(const std::filesystem::path &source, uint64_t &hash) const {
+    SStamp l_stamp;
+    if (!GetStamp(source, l_stamp))
+      return false;
+
+    std::lock_guard<std::mutex> lock(m_mtx);
+    auto found = m_mapManifest.find(GetKey(source));
+    if (found == m_mapManifest.end() || found->second.mtime != l_stamp.mtime ||
+        found->second.size != l_stamp.size)
+      return false;
+
+    hash = found->second.hash;
+    return true;
+  }
+
+  void Remember(const std::filesystem::path &source, uint64_t hash) {
+    SStamp l_stamp;
+    if (!GetStamp(source, l_stamp))
+      return;
+
+    l_stamp.hash = hash;
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_mapManifest[GetKey(source)] = l_stamp;
+  }
+
+  // reads the file in chunks, keepGoing is asked after every one
+  template <typename F>
+  static bool HashFile(const std::filesystem::path &path,
+                       std::vector<char> &chunk, uint64_t &hash,
+                       F &&keepGoing) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      return false;
+
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    chunk.resize(1 << 20);
+
+    hash = GetHashSeed();
+    bool finished = true;
+    ssize_t l_iRead = 0;
+    while ((l_iRead = ::read(fd, chunk.data(), chunk.size())) > 0) {
+      hash = HashFNV1a(
+          std::string_view(chunk.data(), static_cast<size_t>(l_iRead)), hash);
+      if (!keepGoing()) {
+        finished = false;
+        break;
+      }
+    }
+
+    ::close(fd);
+    return finished && l_iRead == 0;
+  }
+
+  // "<hash> <mtime> <size> <absolute source path>" per line
+  void LoadManifest() {
+    std::ifstream in(m_dir / "manifest");
+    std::string line;
+
+    std::lock_guard<std::mutex> lock(m_mtx);
+    while (std::getline(in, line)) {
+      std::istringstream fields(line);
+      SStamp l_stamp;
+      std::string l_sHash;
+      if (!(fields >> l_sHash >> l_stamp.mtime >> l_stamp.size))
+        continue;
+
+      std::string l_sPath;
+      std::getline(fields >> std::ws, l_sPath);
+      l_stamp.hash = std::strtoull(l_sHash.c_str(), nullptr, 16);
+      if (!l_sPath.empty())
+        m_mapManifest[l_sPath] = l_stamp;
+    }
+  }
+
+  // entries whose source is gone are dropped
+  bool SaveManifest() const {
+    std::error_code ec;
+    std::filesystem::create_directories(m_dir, ec);
+
+    const std::filesystem::path l_path = m_dir / "manifest";
+    std::filesystem::path l_tmpPath = l_path;
+    l_tmpPath += ".tmp";
+
+    {
+      std::ofstream out(l_tmpPath, std::ios::trunc);
+      std::lock_guard<std::mutex> lock(m_mtx);
+      for (const auto &[path, stamp] : m_mapManifest) {
+        if (!std::filesystem::exists(path, ec))
+          continue;
+
+        char l_sHash[32];
+        std::snprintf(l_sHash, sizeof(l_sHash), "%016llx",
+                      static_cast<unsigned long long>(stamp.hash));
+        out << l_sHash << ' ' << stamp.mtime << ' ' << stamp.size << ' '
+            << path << '\n';
+      }
+      if (!out.flush())
+        return false;
+    }
+
+    std::filesystem::rename(l_tmpPath, l_path, ec);
+    return !ec;
+  }
+
+private:
+  struct SStamp {
+    int64_t mtime = 0;
+    uint64_t size = 0;
+    uint64_t hash = 0;
+  };
+
+  std::filesystem::path m_dir;
+  bool m_bBakeMissing = false;
+  CTextureCache *m_pTextureCache = nullptr;
+  mutable std::mutex m_mtx;
+  std::unordered_map<std::string, SStamp> m_mapManifest;
+
+  static std::string GetKey(const std::filesystem::path &source) {
+    std::error_code ec;
+    std::filesystem::path l_abs = std::filesystem::absolute(source, ec);
+    return (ec ? source : l_abs).lexically_normal().string();
+  }
+
+  static bool GetStamp(const std::filesystem::path &source, SStamp &stamp) {
+    std::error_code ec;
+    auto time = std::filesystem::last_write_time(source, ec);
+    if (ec)
+      return false;
+    stamp.size = std::filesystem::file_size(source, ec);
+    if (ec)
+      return false;
+    stamp.mtime = static_cast<int64_t>(time.time_since_epoch().count());
+    return true;
+  }
+};
@@ -0,0 +1,372 @@
+#pragma once
+
+#include "ImageDecoder.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// BC7 and BC5 encoders for the texture cache, with decoders for drivers
+// that can not sample them. BC7 only uses mode 6: one subset, 7 bit RGBA
+// endpoints with a p-bit each and 4 bit indices, what most encoders pick
+// for smooth color anyway. the decoders only read what the encoders write,
+// the cache never holds anything else. BC5 is two BC4 blocks, red and green,
+// for normal maps.
+
+// 128 bit block, written and read from the least significant bit up
+class CBlockBits {
+public:
+  explicit CBlockBits(uint8_t *block) : m_pBlock(block) {}
+
+  void Write(uint32_t value, uint32_t bits) {
+    for (uint32_t i = 0; i < bits; i++, m_uPos++)
+      if (value & (1u << i))
+        m_pBlock[m_uPos / 8] |= static_cast<uint8_t>(1u << (m_uPos % 8));
+  }
+
+  uint32_t Read(uint32_t bits) {
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < bits; i++, m_uPos++)
+      value |= uint32_t((m_pBlock[m_uPos / 8] >> (m_uPos % 8)) & 1u) << i;
+    return value;
+  }
+
+private:
+  uint8_t *m_pBlock;
+  uint32_t m_uPos = 0;
+};
+
+inline constexpr uint8_t s_bc7Weights4[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+                                              34, 38, 43, 47, 51, 55, 60, 64};
+
+// 7 bits per channel plus a p-bit shared by the endpoint's channels
+struct SBC7Endpoint {
+  uint8_t color[4];
+  uint8_t pbit;
+
+  uint8_t Expand(size_t c) const {
+    return static_cast<uint8_t>((color[c] << 1) | pbit);
+  }
+
+  static SBC7Endpoint Quantize(const float value[4]) {
+    SBC7Endpoint best{};
+    float l_fBestError = INFINITY;
+    for (uint8_t pbit = 0; pbit < 2; pbit++) {
+      SBC7Endpoint endpoint{};
+      endpoint.pbit = pbit;
+      float error = 0.0f;
+      for (size_t c = 0; c < 4; c++) {
+        const float q = std::round((value[c] - float(pbit)) * 0.5f);
+        endpoint.color[c] = static_cast<uint8_t>(std::clamp(q, 0.0f, 127.0f));
+        const float delta = float(endpoint.Expand(c)) - value[c];
+        error += delta * delta;
+      }
+      if (error < l_fBestError) {
+        l_fBestError = error;
+        best = endpoint;
+      }
+    }
+    return best;
+  }
+};
+
+inline uint8_t InterpolateBC7(uint8_t e0, uint8_t e1, uint32_t weight) {
+  return static_cast<uint8_t>(((64 - weight) * e0 + weight * e1 + 32) >> 6);
+}
+
+// indices and squared error of the block against two endpoints
+inline float FitBC7Indices(const uint8_t pixels[64], const SBC7Endpoint &e0,
+                           const SBC7Endpoint &e1, uint8_t indices[16]) {
+  int32_t l_palette[16][4];
+  for (size_t i = 0; i < 16; i++)
+    for (size_t c = 0; c < 4; c++)
+      l_palette[i][c] =
+          InterpolateBC7(e0.Expand(c), e1.Expand(c), s_bc7Weights4[i]);
+
+  float l_fError = 0.0f;
+  for (size_t p = 0; p < 16; p++) {
+    int32_t l_iBest = INT32_MAX;
+    for (uint8_t i = 0; i < 16; i++) {
+      int32_t error = 0;
+      for (size_t c = 0; c < 4; c++) {
+        const int32_t delta = l_palette[i][c] - pixels[p * 4 + c];
+        error += delta * delta;
+      }
+      if (error < l_iBest) {
+        l_iBest = error;
+        indices[p] = i;
+      }
+    }
+    l_fError += float(l_iBest);
+  }
+  return l_fError;
+}
+
+inline void EncodeBC7Block(const uint8_t pixels[64], uint8_t out[16]) {
+  float l_mean[4] = {};
+  for (size_t p = 0; p < 16; p++)
+    for (size_t c = 0; c < 4; c++)
+      l_mean[c] += float(pixels[p * 4 + c]) / 16.0f;
+
+  float l_cov[4][4] = {};
+  for (size_t p = 0; p < 16; p++)
+    for (size_t a = 0; a < 4; a++)
+      for (size_t b = 0; b < 4; b++)
+        l_cov[a][b] += (float(pixels[p * 4 + a]) - l_mean[a]) *
+                       (float(pixels[p * 4 + b]) - l_mean[b]);
+
+  // the principal axis by power iteration, the colors spread along it
+  float l_axis[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+  for (int iteration = 0; iteration < 8; iteration++) {
+    float l_next[4] = {};
+    for (size_t a = 0; a < 4; a++)
+      for (size_t b = 0; b < 4; b++)
+        l_next[a] += l_cov[a][b] * l_axis[b];
+
+    float l_fLength = 0.0f;
+    for (float value : l_next)
+      l_fLength = std::max(l_fLength, std::abs(value));
+    if (l_fLength < 1e-6f)
+      break; // one flat color
+    for (size_t a = 0; a < 4; a++)
+      l_axis[a] = l_next[a] / l_fLength;
+  }
+
+  float l_fMin = INFINITY, l_fMax = -INFINITY;
+  for (size_t p = 0; p < 16; p++) {
+    float t = 0.0f;
+    for (size_t c = 0; c < 4; c++)
+      t += (float(pixels[p * 4 + c]) - l_mean[c]) * l_axis[c];
+    l_fMin = std::min(l_fMin, t);
+    l_fMax = std::max(l_fMax, t);
+  }
+
+  float l_ends[2][4];
+  const float l_fAxisLength2 = l_axis[0] * l_axis[0] + l_axis[1] * l_axis[1] +
+                               l_axis[2] * l_axis[2] + l_axis[3] * l_axis[3];
+  for (size_t c = 0; c < 4; c++) {
+    const float scale =
+        l_fAxisLength2 > 0.0f ? l_axis[c] / l_fAxisLength2 : 0.0f;
+    l_ends[0][c] = std::clamp(l_mean[c] + scale * l_fMin, 0.0f, 255.0f);
+    l_ends[1][c] = std::clamp(l_mean[c] + scale * l_fMax, 0.0f, 255.0f);
+  }
+
+  SBC7Endpoint l_best[2] = {SBC7Endpoint::Quantize(l_ends[0]),
+                            SBC7Endpoint::Quantize(l_ends[1])};
+  uint8_t l_bestIndices[16];
+  float l_fBestError = FitBC7Indices(pixels, l_best[0], l_best[1],
+                                     l_bestIndices);
+
+  // least squares endpoints for the chosen weights, kept while they help
+  for (int iteration = 0; iteration < 2 && l_fBestError > 0.0f; iteration++) {
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    float ax[4] = {}, bx[4] = {};
+    for (size_t p = 0; p < 16; p++) {
+      const float b = float(s_bc7Weights4[l_bestIndices[p]]) / 64.0f;
+      const float a = 1.0f - b;
+      aa += a * a;
+      ab += a * b;
+      bb += b * b;
+      for (size_t c = 0; c < 4; c++) {
+        ax[c] += a * float(pixels[p * 4 + c]);
+        bx[c] += b * float(pixels[p * 4 + c]);
+      }
+    }
+
+    const float det = aa * bb - ab * ab;
+    if (std::abs(det) < 1e-6f)
+      break; // every pixel got the same weight
+    for (size_t c = 0; c < 4; c++) {
+      l_ends[0][c] = std::clamp((bb * ax[c] - ab * bx[c]) / det, 0.0f, 255.0f);
+      l_ends[1][c] = std::clamp((aa * bx[c] - ab * ax[c]) / det, 0.0f, 255.0f);
+    }
+
+    const SBC7Endpoint l_refined[2] = {SBC7Endpoint::Quantize(l_ends[0]),
+                                       SBC7Endpoint::Quantize(l_ends[1])};
+    uint8_t l_indices[16];
+    const float error =
+        FitBC7Indices(pixels, l_refined[0], l_refined[1], l_indices);
+    if (error >= l_fBestError)
+      break;
+    l_fBestError = error;
+    l_best[0] = l_refined[0];
+    l_best[1] = l_refined[1];
+    std::memcpy(l_bestIndices, l_indices, 16);
+  }
+
+  // the first index is stored without its top bit, swapping the endpoints
+  // mirrors the indices
+  if (l_bestIndices[0] >= 8) {
+    std::swap(l_best[0], l_best[1]);
+    for (uint8_t &index : l_bestIndices)
+      index = static_cast<uint8_t>(15 - index);
+  }
+
+  std::memset(out, 0, 16);
+  CBlockBits l_bits(out);
+  l_bits.Write(1u << 6, 7); // mode 6
+  for (size_t c = 0; c < 4; c++) {
+    l_bits.Write(l_best[0].color[c], 7);
+    l_bits.Write(l_best[1].color[c], 7);
+  }
+  l_bits.Write(l_best[0].pbit, 1);
+  l_bits.Write(l_best[1].pbit, 1);
+  for (size_t p = 0; p < 16; p++)
+    l_bits.Write(l_bestIndices[p], p == 0 ? 3 : 4);
+}
+
+// false for the modes the encoder never writes
+inline bool DecodeBC7Block(const uint8_t block[16], uint8_t pixels[64]) {
+  if ((block[0] & 0x7f) != 0x40)
+    return false;
+
+  uint8_t l_copy[16];
+  std::memcpy(l_copy, block, 16);
+  CBlockBits l_bits(l_copy);
+  l_bits.Read(7);
+
+  SBC7Endpoint l_ends[2];
+  for (size_t c = 0; c < 4; c++) {
+    l_ends[0].color[c] = static_cast<uint8_t>(l_bits.Read(7));
+    l_ends[1].color[c] = static_cast<uint8_t>(l_bits.Read(7));
+  }
+  l_ends[0].pbit = static_cast<uint8_t>(l_bits.Read(1));
+  l_ends[1].pbit = static_cast<uint8_t>(l_bits.Read(1));
+
+  for (size_t p = 0; p < 16; p++) {
+    const uint32_t index = l_bits.Read(p == 0 ? 3 : 4);
+    for (size_t c = 0; c < 4; c++)
+      pixels[p * 4 + c] = InterpolateBC7(
+          l_ends[0].Expand(c), l_ends[1].Expand(c), s_bc7Weights4[index]);
+  }
+  return true;
+}
+
+// the 8 value mode: code 0 is e0, 1 is e1 and 2..7 lie in between
+inline float GetBC4Value(uint8_t e0, uint8_t e1, uint32_t code) {
+  if (code < 2)
+    return float(code ? e1 : e0);
+  if (e0 > e1)
+    return (float(8 - code) * e0 + float(code - 1) * e1) / 7.0f;
+
+  // the 6 value mode, the encoder only gets there for flat blocks
+  if (code >= 6)
+    return code == 6 ? 0.0f : 255.0f;
+  return (float(6 - code) * e0 + float(code - 1) * e1) / 5.0f;
+}
+
+// one channel of 16 pixels, values are stride bytes apart
+inline void EncodeBC4Block(const uint8_t *values, size_t stride,
+                           uint8_t out[8]) {
+  uint8_t l_uMin = 255, l_uMax = 0;
+  for (size_t p = 0; p < 16; p++) {
+    l_uMin = std::min(l_uMin, values[p * stride]);
+    l_uMax = std::max(l_uMax, values[p * stride]);
+  }
+
+  std::memset(out, 0, 8);
+  out[0] = l_uMax;
+  out[1] = l_uMin;
+  if (l_uMax == l_uMin)
+    return; // every index 0
+
+  CBlockBits l_bits(out + 2);
+  for (size_t p = 0; p < 16; p++) {
+    uint32_t l_uBest = 0;
+    float l_fBest = INFINITY;
+    for (uint32_t code = 0; code < 8; code++) {
+      const float error = std::abs(GetBC4Value(l_uMax, l_uMin, code) -
+                                   float(values[p * stride]));
+      if (error < l_fBest) {
+        l_fBest = error;
+        l_uBest = code;
+      }
+    }
+    l_bits.Write(l_uBest, 3);
+  }
+}
+
+inline void DecodeBC4Block(const uint8_t block[8], uint8_t *values,
+                           size_t stride) {
+  uint8_t l_copy[8];
+  std::memcpy(l_copy, block, 8);
+  CBlockBits l_bits(l_copy + 2);
+  for (size_t p = 0; p < 16; p++)
+    values[p * stride] = static_cast<uint8_t>(
+        std::lround(GetBC4Value(block[0], block[1], l_bits.Read(3))));
+}
+
+// every level of an RGBA8 image into blocks, the edges of levels that are
+// not a multiple of 4 are repeated. keepGoing is asked after every row of
+// blocks, returns false if it said no.
+template <typename F>
+inline bool CompressImage(const STextureImage &image, ETextureFormat format,
+                          STextureImage &out, F &&keepGoing) {
+  out.Allocate(image.width, image.height, format);
+
+  uint8_t l_block[64];
+  for (uint32_t level = 0; level < image.GetLevelCount(); level++) {
+    const uint32_t width = image.GetLevelWidth(level);
+    const uint32_t height = image.GetLevelHeight(level);
+    const uint8_t *src = image.GetLevelData(level);
+    uint8_t *dst = out.pixels.data() + out.levels[level];
+
+    for (uint32_t by = 0; by < height; by += 4) {
+      if (!keepGoing())
+        return false;
+      for (uint32_t bx = 0; bx < width; bx += 4, dst += 16) {
+        for (uint32_t y = 0; y < 4; y++)
+          for (uint32_t x = 0; x < 4; x++)
+            std::memcpy(l_block + (y * 4 + x) * 4,
+                        src + (size_t(std::min(by + y, height - 1)) * width +
+                               std::min(bx + x, width - 1)) *
+                                  4,
+                        4);
+
+        if (format == ETextureFormat::BC7) {
+          EncodeBC7Block(l_block, dst);
+        } else {
+          EncodeBC4Block(l_block, 4, dst);
+          EncodeBC4Block(l_block + 1, 4, dst + 8);
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// the software path, back to RGBA8. BC5 comes back with blue 0 and alpha
+// 255 like the GPU samples it. false if a block is not one the encoder
+// writes.
+inline bool DecompressImage(const STextureImage &image, STextureImage &out) {
+  out.Allocate(image.width, image.height);
+
+  uint8_t l_block[64];
+  for (uint32_t level = 0; level < image.GetLevelCount(); level++) {
+    const uint32_t width = image.GetLevelWidth(level);
+    const uint32_t height = image.GetLevelHeight(level);
+    const uint8_t *src = image.GetLevelData(level);
+    uint8_t *dst = out.pixels.data() + out.levels[level];
+
+    for (uint32_t by = 0; by < height; by += 4)
+      for (uint32_t bx = 0; bx < width; bx += 4, src += 16) {
+        if (image.format == ETextureFormat::BC7) {
+          if (!DecodeBC7Block(src, l_block))
+            return false;
+        } else {
+          for (size_t p = 0; p < 16; p++) {
+            l_block[p * 4 + 2] = 0;
+            l_block[p * 4 + 3] = 255;
+          }
+          DecodeBC4Block(src, l_block, 4);
+          DecodeBC4Block(src + 8, l_block + 1, 4);
+        }
+
+        for (uint32_t y = 0; y < 4 && by + y < height; y++)
+          for (uint32_t x = 0; x < 4 && bx + x < width; x++)
+            std::memcpy(dst + (size_t(by + y) * width + bx + x) * 4,
+                        l_block + (y * 4 + x) * 4, 4);
+      }
+  }
+  return true;
+}
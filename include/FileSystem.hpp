@@ -1,9 +1,22 @@
 #pragma once
 
+#include "FrameLimiter.hpp"
+#include "Hash.hpp"
+#include "ScanIndex.hpp"
+#include "ThreadPool.hpp"
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <filesystem>
+#include <functional>
 #include <iostream>
+#include <iterator>
 #include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace fs = std::filesystem;
@@ -12,6 +25,31 @@ class CFileSystem {
 public:
   std::vector<std::string> extensions;
   fs::path root;
+  uint32_t scanThreads = 0; // 0 = hardware concurrency
+  bool useIndex = true;
+  bool scanBenchmark = false;
+  fs::path textureBenchmark; // model to time texture decoding on
+  uint32_t textureThreads = 0; // 0 = hardware concurrency
+  uint32_t modelCacheMB = 512; // 0 disables the model cache
+  uint32_t prefetchDepth = 2;   // entries on each side of the selection
+  uint32_t prefetchMB = 256;    // max bytes staged speculatively at once
+  fs::path bakeDir;             // empty = CBakeCache::GetDefaultDir()
+  bool useBakeCache = true;
+  bool bakeOnLoad = false; // bake and optimize models that have no bake yet
+  bool buildLods = true;    // needs the bake cache, the levels live there
+  bool useTextureCache = true; // block compressed textures, next to bakes
+  uint32_t textureUploadKB = 4096; // finer texture levels per frame, 0 = all
+  float lodPixelError = 1.0f; // on screen error a LOD level may have
+  bool continuous = false; // draw every frame even when nothing changes
+  uint32_t framesInFlight = 0; // the renderer's buffer ring depth, 0 unknown
+  EFrameLimit frameLimit = EFrameLimit::VSync;
+  uint32_t maxFps = 60; // for the fixed and adaptive limits
+  bool pacingBenchmark = false;
+  fs::path headlessModel; // drawn offscreen without a window or UI
+  uint32_t headlessFrames = 100;
+  uint32_t headlessWidth = 512;
+  uint32_t headlessHeight = 512;
+  fs::path headlessOutput; // png of the last headless frame
 
   void PrintHelp(const char *exeName) const {
     std::cout << "Usage:\n"
@@ -22,7 +60,72 @@ public:
                  "  --help            Show this help message\n"
                  "  --root <path>     Root directory to scan (default: .)\n"
                  "  --ext <ext...>    File extensions to include\n"
-                 "                    Example: --ext .png .jpg .obj\n\n"
+                 "                    Example: --ext .png .jpg .obj\n"
+                 "  --scan-threads <n>\n"
+                 "                    Threads used to scan the root "
+                 "(default: all cores)\n"
+                 "  --no-index        Ignore the cached scan index and walk "
+                 "the whole root\n"
+                 "  --scan-bench      Scan the root, print file list memory "
+                 "stats and exit\n"
+                 "  --texture-threads <n>\n"
+                 "                    Threads decoding a model's textures "
+                 "(default: all cores)\n"
+                 "  --texture-bench <model.glb>\n"
+                 "                    Decode the model's textures on 1 to "
+                 "all cores, print the times and exit\n"
+                 "  --model-cache-mb <n>\n"
+                 "                    Memory budget for recently viewed "
+                 "models, 0 disables (default: 512)\n"
+                 "  --prefetch-depth <n>\n"
+                 "                    Entries above and below the selection "
+                 "to stage ahead, 0 disables (default: 2)\n"
+                 "  --prefetch-mb <n> Max bytes read ahead at once "
+                 "(default: 256)\n"
+                 "  --bake-dir <path> Where eHazBake put the baked models "
+                 "(default: ~/.cache/eHazViewer/baked)\n"
+                 "  --no-bake-cache   Always load the source files\n"
+                 "  --bake-on-load    Bake and optimize .glb files that are "
+                 "not baked yet when they are loaded\n"
+                 "  --no-lods         Always draw the full detail model\n"
+                 "  --no-texture-cache\n"
+                 "                    Decode baked models' textures on every "
+                 "load instead of\n"
+                 "                    keeping them BC7/BC5 compressed\n"
+                 "  --texture-upload-kb <n>\n"
+                 "                    Texture levels uploaded per frame "
+                 "after the coarse ones,\n"
+                 "                    0 uploads whole textures at once "
+                 "(default: 4096)\n"
+                 "  --lod-error <px>  Pixels a simplified level may be off "
+                 "on screen (default: 1)\n"
+                 "  --continuous      Draw frames back to back instead of "
+                 "waiting for input,\n"
+                 "                    for benchmarking\n"
+                 "  --frames-in-flight <n>\n"
+                 "                    Depth of the renderer's buffer ring, "
+                 "with it a static view\n"
+                 "                    sends nothing, without it the scene "
+                 "goes up every frame\n"
+                 "  --frame-limit <vsync|fixed|adaptive|off>\n"
+                 "                    How frames are paced, adaptive drops "
+                 "below --fps to a rate\n"
+                 "                    the model can hold (default: vsync)\n"
+                 "  --fps <n>         Frame rate cap of the fixed and "
+                 "adaptive limits (default: 60)\n"
+                 "  --pacing-bench    Run every frame limit on simulated "
+                 "frames, print frame\n"
+                 "                    times and input latency and exit\n"
+                 "  --headless <model>\n"
+                 "                    Draw the model offscreen through "
+                 "SDL's EGL driver, print\n"
+                 "                    the frame times and exit\n"
+                 "  --frames <n>      Frames drawn by --headless "
+                 "(default: 100)\n"
+                 "  --size <w>x<h>    Size of the headless frame "
+                 "(default: 512x512)\n"
+                 "  --output <file.png>\n"
+                 "                    Save the last headless frame\n\n"
                  "Example:\n"
                  "  "
               << exeName << " --root assets --ext .png .jpg\n";
@@ -39,6 +142,74 @@ public:
         std::exit(0);
       } else if (arg == "--root" && i + 1 < argc) {
         root = argv[++i];
+      } else if (arg == "--scan-threads" && i + 1 < argc) {
+        scanThreads =
+            static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+      } else if (arg == "--no-index") {
+        useIndex = false;
+      } else if (arg == "--scan-bench") {
+        scanBenchmark = true;
+      } else if (arg == "--texture-threads" && i + 1 < argc) {
+        textureThreads =
+            static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+      } else if (arg == "--texture-bench" && i + 1 < argc) {
+        textureBenchmark = argv[++i];
+      } else if (arg == "--prefetch-depth" && i + 1 < argc) {
+        prefetchDepth =
+            static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+      } else if (arg == "--prefetch-mb" && i + 1 < argc) {
+        prefetchMB =
+            static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+      } else if (arg == "--model-cache-mb" && i + 1 < argc) {
+        modelCacheMB =
+            static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+      } else if (arg == "--bake-dir" && i + 1 < argc) {
+        bakeDir = argv[++i];
+      } else if (arg == "--no-bake-cache") {
+        useBakeCache = false;
+      } else if (arg == "--bake-on-load") {
+        bakeOnLoad = true;
+      } else if (arg == "--no-lods") {
+        buildLods = false;
+      } else if (arg == "--no-texture-cache") {
+        useTextureCache = false;
+      } else if (arg == "--texture-upload-kb" && i + 1 < argc) {
+        textureUploadKB =
+            static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+      } else if (arg == "--lod-error" && i + 1 < argc) {
+        lodPixelError = std::strtof(argv[++i], nullptr);
+      } else if (arg == "--continuous") {
+        continuous = true;
+      } else if (arg == "--frames-in-flight" && i + 1 < argc) {
+        framesInFlight =
+            static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+      } else if (arg == "--frame-limit" && i + 1 < argc) {
+        const std::string mode = argv[++i];
+        if (mode == "fixed")
+          frameLimit = EFrameLimit::Fixed;
+        else if (mode == "adaptive")
+          frameLimit = EFrameLimit::Adaptive;
+        else if (mode == "off")
+          frameLimit = EFrameLimit::Off;
+        else
+          frameLimit = EFrameLimit::VSync;
+      } else if (arg == "--fps" && i + 1 < argc) {
+        maxFps = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+      } else if (arg == "--pacing-bench") {
+        pacingBenchmark = true;
+      } else if (arg == "--headless" && i + 1 < argc) {
+        headlessModel = argv[++i];
+      } else if (arg == "--frames" && i + 1 < argc) {
+        headlessFrames =
+            static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+      } else if (arg == "--size" && i + 1 < argc) {
+        char *end = nullptr;
+        headlessWidth =
+            static_cast<uint32_t>(std::strtoul(argv[++i], &end, 10));
+        headlessHeight = static_cast<uint32_t>(
+            *end == 'x' ? std::strtoul(end + 1, nullptr, 10) : headlessWidth);
+      } else if (arg == "--output" && i + 1 < argc) {
+        headlessOutput = argv[++i];
       } else if (arg == "--ext") {
         extensions.clear();
 
@@ -56,24 +227,230 @@ public:
       extensions = {".hzmdl", ".ahzm", ".glb"};
   }
 
-  std::vector<std::string> GetFilesFromRoot() {
+  bool HasWantedExtension(const fs::path &path) const {
+    if (extensions.empty())
+      return true;
+
+    auto ext = path.extension().string();
+    return std::find(extensions.begin(), extensions.end(), ext) !=
+           extensions.end();
+  }
+
+  static int64_t GetDirMTime(const fs::path &dir) {
+    std::error_code ec;
+    auto time = fs::last_write_time(dir, ec);
+    // never matches a stored mtime, forces the directory to be read
+    if (ec)
+      return INT64_MIN;
+    return static_cast<int64_t>(time.time_since_epoch().count());
+  }
+
+  // called on the scan workers once per directory
+  using DirSink = std::function<void(uint32_t worker, const SScannedDir &dir)>;
+
+  uint32_t GetScanThreadCount() const {
+    return scanThreads ? scanThreads
+                       : std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  // every directory is a task on the work stealing pool and is handed to the
+  // sink on the worker that read it, so nothing is shared between workers.
+  // directories whose mtime matches the on-disk index are not read again,
+  // their entries come straight from the mapped index.
+  // returns false if the root is missing or the scan was canceled.
+  bool ScanRoot(const DirSink &sink,
+                const std::atomic<bool> *cancel = nullptr) const {
+    std::error_code ec;
+    if (!fs::is_directory(root, ec))
+      return false;
+
+    // relative paths are sliced off the iterated path instead of going
+    // through fs::relative, the iterator always yields "<dir>/<name>"
+    std::string l_sPrefix = root.generic_string();
+    if (l_sPrefix.back() != '/')
+      l_sPrefix += '/';
+
+    const uint64_t l_uKey = GetIndexKey();
+    const fs::path l_indexPath = GetIndexPath(l_uKey);
+
+    CScanIndex l_oldIndex;
+    if (useIndex)
+      l_oldIndex.Load(l_indexPath, l_uKey);
+
+    CWorkStealingPool l_pool(GetScanThreadCount());
+
+    SScanContext l_ctx{l_pool, l_oldIndex, l_sPrefix, sink, cancel,
+                       std::vector<std::vector<SScannedDir>>(
+                           useIndex ? l_pool.GetThreadCount() : 0)};
+
+    ScanDirectory(l_ctx, root, l_oldIndex.IsLoaded() ? 0 : -1);
+    l_pool.Wait();
+
+    if (cancel && cancel->load(std::memory_order_relaxed))
+      return false;
+
+    if (useIndex) {
+      std::vector<SScannedDir> l_vDirs;
+      for (auto &dirs : l_ctx.perWorker)
+        std::move(dirs.begin(), dirs.end(), std::back_inserter(l_vDirs));
+
+      if (!CScanIndex::Write(l_indexPath, l_uKey, l_vDirs))
+        std::cerr << "failed to write scan index " << l_indexPath << "\n";
+    }
+    return true;
+  }
+
+  std::vector<std::string> GetFilesFromRoot() const {
+    std::vector<std::vector<std::string>> l_vvsPerWorker(GetScanThreadCount());
+
+    ScanRoot([&l_vvsPerWorker](uint32_t worker, const SScannedDir &dir) {
+      dir.ForEachFile([&](std::string_view name) {
+        l_vvsPerWorker[worker].push_back(dir.relDir + std::string(name));
+      });
+    });
+
+    size_t l_uTotal = 0;
+    for (const auto &files : l_vvsPerWorker)
+      l_uTotal += files.size();
+
     std::vector<std::string> result;
+    result.reserve(l_uTotal);
+    for (auto &files : l_vvsPerWorker)
+      std::move(files.begin(), files.end(), std::back_inserter(result));
+
+    // workers finish in any order, keep the list stable between launches
+    std::sort(result.begin(), result.end());
+
+    return result;
+  }
+
+private:
+  struct SScanContext {
+    CWorkStealingPool &pool;
+    const CScanIndex &oldIndex;
+    const std::string &prefix;
+    const DirSink &sink;
+    const std::atomic<bool> *cancel;
+    std::vector<std::vector<SScannedDir>> perWorker; // only kept for the index
+  };
 
-    if (!fs::exists(root))
-      return result;
+  // the index is only valid for the same root and the same extension filter
+  uint64_t GetIndexKey() const {
+    std::error_code ec;
+    fs::path l_absRoot = fs::weakly_canonical(root, ec);
+    if (ec)
+      l_absRoot = fs::absolute(root, ec);
 
-    for (const auto &entry : fs::recursive_directory_iterator(root)) {
-      if (!entry.is_regular_file())
+    uint64_t key = HashFNV1a(l_absRoot.generic_string());
+    for (const std::string &ext : extensions)
+      key = HashFNV1a(ext, HashFNV1a("|", key));
+    return key;
+  }
+
+  // $XDG_CACHE_HOME/eHazViewer, falling back to ~/.cache and then the root
+  fs::path GetIndexPath(uint64_t key) const {
+    fs::path l_dir;
+    if (const char *xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+      l_dir = fs::path(xdg) / "eHazViewer";
+    else if (const char *home = std::getenv("HOME"); home && *home)
+      l_dir = fs::path(home) / ".cache" / "eHazViewer";
+    else
+      l_dir = root;
+
+    char l_name[40];
+    std::snprintf(l_name, sizeof(l_name), "scan-%016llx.idx",
+                  static_cast<unsigned long long>(key));
+    return l_dir / l_name;
+  }
+
+  // oldDir is the matching directory in the previous index, -1 if unknown
+  void ScanDirectory(SScanContext &ctx, fs::path dir, int64_t oldDir) const {
+    ctx.pool.Submit([this, &ctx, dir = std::move(dir),
+                     oldDir](uint32_t worker) {
+      if (ctx.cancel && ctx.cancel->load(std::memory_order_relaxed))
+        return;
+
+      SScannedDir l_scanned;
+      l_scanned.mtime = GetDirMTime(dir);
+
+      std::string l_sFull = dir.generic_string();
+      if (l_sFull.size() > ctx.prefix.size()) {
+        l_scanned.relDir = l_sFull.substr(ctx.prefix.size());
+        if (l_scanned.relDir.back() != '/')
+          l_scanned.relDir += '/';
+      }
+
+      const CScanIndex &index = ctx.oldIndex;
+      const CScanIndex::SDir *l_pOld =
+          oldDir >= 0 ? &index.GetDir(static_cast<uint32_t>(oldDir))
+                      : nullptr;
+
+      if (l_pOld && l_pOld->mtime == l_scanned.mtime &&
+          index.GetDirPath(*l_pOld) == l_scanned.relDir) {
+        // nothing was added, removed or renamed directly in here
+        for (uint32_t i = 0; i < l_pOld->fileCount; i++)
+          l_scanned.AddFile(index.GetFileName(*l_pOld, i));
+
+        for (uint32_t i = 0; i < l_pOld->childCount; i++) {
+          uint32_t child = index.GetChild(*l_pOld, i);
+          std::string_view childDir = index.GetDirPath(index.GetDir(child));
+          l_scanned.children.emplace_back(childDir);
+          ScanDirectory(ctx, fs::path(ctx.prefix + std::string(childDir)),
+                        child);
+        }
+      } else {
+        ReadDirectory(ctx, dir, l_pOld, l_scanned);
+      }
+
+      ctx.sink(worker, l_scanned);
+
+      if (!ctx.perWorker.empty())
+        ctx.perWorker[worker].push_back(std::move(l_scanned));
+    });
+  }
+
+  void ReadDirectory(SScanContext &ctx, const fs::path &dir,
+                     const CScanIndex::SDir *old,
+                     SScannedDir &scanned) const {
+    const CScanIndex &index = ctx.oldIndex;
+
+    // subdirectories that survived keep pointing at their old entry
+    std::unordered_map<std::string_view, uint32_t> l_mapOldChildren;
+    if (old) {
+      for (uint32_t i = 0; i < old->childCount; i++) {
+        uint32_t child = index.GetChild(*old, i);
+        l_mapOldChildren.emplace(index.GetDirPath(index.GetDir(child)), child);
+      }
+    }
+
+    std::error_code ec;
+    fs::directory_iterator it(dir, fs::directory_options::skip_permission_denied,
+                              ec);
+
+    for (; !ec && it != fs::directory_iterator(); it.increment(ec)) {
+      const fs::directory_entry &entry = *it;
+      std::error_code l_ecEntry;
+
+      // same as recursive_directory_iterator: don't follow directory links
+      if (entry.is_directory(l_ecEntry) && !entry.is_symlink(l_ecEntry)) {
+        std::string l_sChild =
+            scanned.relDir + entry.path().filename().generic_string() + '/';
+
+        auto found = l_mapOldChildren.find(l_sChild);
+        int64_t l_iOldChild = -1;
+        if (found != l_mapOldChildren.end())
+          l_iOldChild = found->second;
+
+        scanned.children.push_back(std::move(l_sChild));
+        ScanDirectory(ctx, entry.path(), l_iOldChild);
         continue;
+      }
 
-      auto ext = entry.path().extension().string();
-      if (!extensions.empty() && std::find(extensions.begin(), extensions.end(),
-                                           ext) == extensions.end())
+      if (!entry.is_regular_file(l_ecEntry) ||
+          !HasWantedExtension(entry.path()))
         continue;
 
-      result.push_back(fs::relative(entry.path(), root).generic_string());
+      scanned.AddFile(entry.path().filename().generic_string());
     }
-
-    return result;
   }
 };
@@ -0,0 +1,242 @@
+#pragma once
+
+#include "FileSystem.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+// changes to the file list, paths are relative to the root like the scan
+// results. removedDirs end with '/' and drop everything below them.
+struct SFileDelta {
+  std::vector<std::string> added;
+  std::vector<std::string> removed;
+  std::vector<std::string> removedDirs;
+  bool rescan = false; // the kernel dropped events, only a full scan helps
+
+  bool Empty() const {
+    return added.empty() && removed.empty() && removedDirs.empty() && !rescan;
+  }
+};
+
+// recursive inotify watcher for the scan root. watches are registered by the
+// scanner as it visits directories, events are read once per frame and
+// coalesced per path so a batch export shows up as one delta.
+class CFileWatcher {
+public:
+  static constexpr uint32_t s_uDirMask =
+      IN_CREATE | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+      IN_DELETE_SELF | IN_ONLYDIR;
+
+  explicit CFileWatcher(const CFileSystem &fileSystem)
+      : m_fileSystem(fileSystem) {
+    m_sPrefix = fileSystem.root.generic_string();
+    if (m_sPrefix.empty() || m_sPrefix.back() != '/')
+      m_sPrefix += '/';
+
+    m_iFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_iFd < 0)
+      std::cerr << "inotify unavailable: " << std::strerror(errno) << "\n";
+  }
+
+  ~CFileWatcher() {
+    if (m_iFd >= 0)
+      ::close(m_iFd);
+  }
+
+  CFileWatcher(const CFileWatcher &) = delete;
+  CFileWatcher &operator=(const CFileWatcher &) = delete;
+
+  bool IsValid() const { return m_iFd >= 0; }
+
+  // thread safe, called by the scan workers. mtime is what the scanner saw,
+  // if the directory changed before the watch existed it is read again.
+  void Watch(const std::string &relDir, int64_t mtime) {
+    if (!AddWatch(relDir))
+      return;
+
+    if (CFileSystem::GetDirMTime(m_sPrefix + relDir) != mtime) {
+      std::lock_guard<std::mutex> lock(m_mtxWatches);
+      m_vsRecheck.push_back(relDir);
+    }
+  }
+
+  // reads every queued event without blocking and folds it into the
+  // pending delta
+  void Poll() {
+    if (m_iFd < 0)
+      return;
+
+    std::vector<std::string> l_vsRecheck;
+    {
+      std::lock_guard<std::mutex> lock(m_mtxWatches);
+      l_vsRecheck.swap(m_vsRecheck);
+    }
+    for (const std::string &relDir : l_vsRecheck)
+      AddTree(relDir, false);
+
+    alignas(inotify_event) char l_buffer[64 * 1024];
+
+    while (true) {
+      ssize_t l_iRead = ::read(m_iFd, l_buffer, sizeof(l_buffer));
+      if (l_iRead <= 0)
+        break;
+
+      for (char *ptr = l_buffer; ptr < l_buffer + l_iRead;) {
+        const auto *event = reinterpret_cast<const inotify_event *>(ptr);
+        HandleEvent(*event);
+        ptr += sizeof(inotify_event) + event->len;
+      }
+    }
+  }
+
+  // something for TakeDelta, without taking it
+  bool HasPending() const {
+    return m_bOverflow || !m_mapPending.empty() || !m_vsRemovedDirs.empty();
+  }
+
+  // hands the coalesced changes over and starts a new delta
+  SFileDelta TakeDelta() {
+    SFileDelta delta;
+    delta.rescan = m_bOverflow;
+    delta.removedDirs.swap(m_vsRemovedDirs);
+
+    for (auto &[path, present] : m_mapPending)
+      (present ? delta.added : delta.removed).push_back(path);
+
+    m_mapPending.clear();
+    m_bOverflow = false;
+    return delta;
+  }
+
+private:
+  const CFileSystem &m_fileSystem;
+  std::string m_sPrefix;
+  int m_iFd = -1;
+
+  std::mutex m_mtxWatches;
+  std::unordered_map<int, std::string> m_mapWatches; // wd -> relDir
+  std::vector<std::string> m_vsRecheck;
+
+  // path -> exists after all events seen so far
+  std::unordered_map<std::string, bool> m_mapPending;
+  std::vector<std::string> m_vsRemovedDirs;
+  bool m_bOverflow = false;
+
+  bool AddWatch(const std::string &relDir) {
+    if (m_iFd < 0)
+      return false;
+
+    int wd = inotify_add_watch(m_iFd, (m_sPrefix + relDir).c_str(), s_uDirMask);
+    if (wd < 0) {
+      // ENOSPC means fs.inotify.max_user_watches is too low for the tree
+      static bool s_bReported = false;
+      if (!s_bReported && errno == ENOSPC) {
+        std::cerr << "inotify watch limit reached, new files under parts of "
+                     "the root will not show up\n";
+        s_bReported = true;
+      }
+      return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mtxWatches);
+    m_mapWatches[wd] = relDir;
+    return true;
+  }
+
+  void RemoveWatchesUnder(const std::string &relDir) {
+    std::lock_guard<std::mutex> lock(m_mtxWatches);
+    for (auto it = m_mapWatches.begin(); it != m_mapWatches.end();) {
+      if (it->second.starts_with(relDir)) {
+        inotify_rm_watch(m_iFd, it->first);
+        it = m_mapWatches.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  // a directory appeared (or changed before we watched it), watch it and
+  // report what is already inside since those events happened before
+  void AddTree(const std::string &relDir, bool recursive) {
+    AddWatch(relDir);
+
+    std::error_code ec;
+    fs::directory_iterator it(m_sPrefix + relDir,
+                              fs::directory_options::skip_permission_denied,
+                              ec);
+
+    for (; !ec && it != fs::directory_iterator(); it.increment(ec)) {
+      const fs::directory_entry &entry = *it;
+      std::error_code l_ecEntry;
+      std::string l_sName = entry.path().filename().generic_string();
+
+      if (entry.is_directory(l_ecEntry) && !entry.is_symlink(l_ecEntry)) {
+        if (recursive)
+          AddTree(relDir + l_sName + '/', true);
+        continue;
+      }
+
+      if (entry.is_regular_file(l_ecEntry) &&
+          m_fileSystem.HasWantedExtension(entry.path()))
+        m_mapPending[relDir + l_sName] = true;
+    }
+  }
+
+  void HandleEvent(const inotify_event &event) {
+    if (event.mask & IN_Q_OVERFLOW) {
+      m_bOverflow = true;
+      return;
+    }
+
+    std::string l_sDir;
+    {
+      std::lock_guard<std::mutex> lock(m_mtxWatches);
+      auto found = m_mapWatches.find(event.wd);
+      if (found == m_mapWatches.end())
+        return;
+
+      if (event.mask & IN_IGNORED) {
+        m_mapWatches.erase(found);
+        return;
+      }
+      l_sDir = found->second;
+    }
+
+    if (event.len == 0)
+      return;
+
+    std::string l_sPath = l_sDir + event.name;
+
+    if (event.mask & IN_ISDIR) {
+      if (event.mask & (IN_CREATE | IN_MOVED_TO)) {
+        AddTree(l_sPath + '/', true);
+      } else if (event.mask & (IN_DELETE | IN_MOVED_FROM)) {
+        l_sPath += '/';
+        RemoveWatchesUnder(l_sPath);
+
+        // anything queued below the directory is gone as well
+        std::erase_if(m_mapPending, [&l_sPath](const auto &pending) {
+          return pending.first.starts_with(l_sPath);
+        });
+        m_vsRemovedDirs.push_back(std::move(l_sPath));
+      }
+      return;
+    }
+
+    if (!m_fileSystem.HasWantedExtension(event.name))
+      return;
+
+    // IN_CREATE alone is a file that is still being written
+    if (event.mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+      m_mapPending[std::move(l_sPath)] = true;
+    else if (event.mask & (IN_DELETE | IN_MOVED_FROM))
+      m_mapPending[std::move(l_sPath)] = false;
+  }
+};
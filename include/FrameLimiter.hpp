@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <utility>
+
+// how the viewer paces its frames. VSync leaves it to the buffer swap, Fixed
+// caps at maxFps, Adaptive caps at maxFps or at the rate the recent frames
+// can hold, whichever is slower, so a heavy model runs at an even rate
+// instead of alternating fast and slow frames. Off draws as fast as it can.
+enum class EFrameLimit : uint8_t { VSync, Fixed, Adaptive, Off };
+
+// samples in 0.25 ms buckets up to 64 ms, the last bucket takes everything
+// longer
+class CFrameHistogram {
+public:
+  static constexpr uint64_t s_uBucketNs = 250'000;
+  static constexpr size_t s_uBuckets = 256;
+
+  void Add(uint64_t ns) {
+    m_auCounts[std::min<uint64_t>(ns / s_uBucketNs, s_uBuckets - 1)]++;
+    m_uCount++;
+  }
+
+  uint64_t GetCount() const { return m_uCount; }
+
+  // upper edge of the bucket the fraction of samples falls in, 0 without
+  // samples
+  double GetPercentileMs(double fraction) const {
+    if (m_uCount == 0)
+      return 0.0;
+
+    const uint64_t l_uRank = std::max<uint64_t>(
+        1, static_cast<uint64_t>(std::ceil(fraction * double(m_uCount))));
+    uint64_t l_uSeen = 0;
+    for (size_t bucket = 0; bucket < s_uBuckets; bucket++) {
+      l_uSeen += m_auCounts[bucket];
+      if (l_uSeen >= l_uRank)
+        return double((bucket + 1) * s_uBucketNs) / 1e6;
+    }
+    return double(s_uBuckets * s_uBucketNs) / 1e6;
+  }
+
+  void Clear() { *this = {}; }
+
+private:
+  std::array<uint64_t, s_uBuckets> m_auCounts{};
+  uint64_t m_uCount = 0;
+};
+
+// nanoseconds from std::chrono::steady_clock. a clock only needs Now and
+// SleepFor, a fake one advances its own time in both since the limiter
+// spins on Now.
+struct SSteadyClock {
+  uint64_t Now() const {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+  }
+  void SleepFor(uint64_t ns) const {
+    std::this_thread::sleep_for(std::chrono::nanoseconds(ns));
+  }
+};
+
+// sleeps before a frame rather than after it. the frame starts as late as
+// it can and still be done by its deadline, going by how long the recent
+// ones took, so the input it samples is as fresh as it can be when the
+// frame is shown. BeginFrame goes right before input is read, EndFrame
+// right after the swap.
+template <typename TClock = SSteadyClock> class CFrameLimiter {
+public:
+  // sleeping overshoots by up to about this much, the rest is spun
+  static constexpr uint64_t s_uSpinNs = 1'000'000;
+  // frames the work estimate looks back over
+  static constexpr size_t s_uWindow = 64;
+
+  explicit CFrameLimiter(EFrameLimit mode = EFrameLimit::VSync,
+                         uint32_t maxFps = 0, TClock clock = {})
+      : m_mode(mode), m_uMaxFps(maxFps), m_clock(std::move(clock)) {}
+
+  EFrameLimit GetMode() const { return m_mode; }
+  TClock &GetClock() { return m_clock; }
+
+  // nanoseconds between frames the limiter aims for, 0 when it does not
+  // pace
+  uint64_t GetInterval() const {
+    if (m_mode == EFrameLimit::VSync || m_mode == EFrameLimit::Off)
+      return 0;
+
+    const uint64_t l_uCap = m_uMaxFps ? 1'000'000'000 / m_uMaxFps : 0;
+    if (m_mode == EFrameLimit::Fixed)
+      return l_uCap;
+    // a tenth of headroom keeps a slightly slower frame from missing
+    return std::max(l_uCap, GetWorkEstimate() * 11 / 10);
+  }
+
+  // how long a frame is expected to take, the 90th percentile of the
+  // recent ones
+  uint64_t GetWorkEstimate() const {
+    if (m_uWorkCount == 0)
+      return 0;
+
+    std::array<uint64_t, s_uWindow> l_auWork = m_auWork;
+    const size_t l_uCount = std::min(m_uWorkCount, s_uWindow);
+    const size_t l_uRank = l_uCount * 9 / 10;
+    std::nth_element(l_auWork.begin(),
+                     l_auWork.begin() + static_cast<std::ptrdiff_t>(l_uRank),
+                     l_auWork.begin() + static_cast<std::ptrdiff_t>(l_uCount));
+    return l_auWork[l_uRank];
+  }
+
+  void BeginFrame() {
+    const uint64_t l_uInterval = GetInterval();
+    if (l_uInterval) {
+      const uint64_t l_uWork = GetWorkEstimate();
+      uint64_t now = m_clock.Now();
+
+      // first frame, or behind: the deadline moves instead of the frame
+      // being skipped
+      if (m_uDeadline < now + l_uWork)
+        m_uDeadline = now + l_uWork;
+
+      const uint64_t l_uWake = m_uDeadline - l_uWork;
+      if (l_uWake > now + s_uSpinNs)
+        m_clock.SleepFor(l_uWake - now - s_uSpinNs);
+      while (m_clock.Now() < l_uWake) {
+      }
+    }
+    m_uFrameStart = m_clock.Now();
+  }
+
+  void EndFrame() {
+    const uint64_t now = m_clock.Now();
+
+    m_auWork[m_uWorkCount % s_uWindow] = now - m_uFrameStart;
+    m_uWorkCount++;
+
+    if (m_uLastEnd)
+      m_frameTimes.Add(now - m_uLastEnd);
+    m_uLastEnd = now;
+
+    m_uDeadline = std::max(m_uDeadline, now) + GetInterval();
+  }
+
+  // from when the input was generated to now, after the swap of the frame
+  // that showed it
+  void AddInputLatency(uint64_t inputTime) {
+    const uint64_t now = m_clock.Now();
+    m_inputLatency.Add(now > inputTime ? now - inputTime : 0);
+  }
+
+  // the loop waited for input, the gap is not a frame time and the next
+  // frame should not wait for an old deadline
+  void Resync() {
+    m_uLastEnd = 0;
+    m_uDeadline = 0;
+  }
+
+  const CFrameHistogram &GetFrameTimes() const { return m_frameTimes; }
+  const CFrameHistogram &GetInputLatency() const { return m_inputLatency; }
+
+private:
+  EFrameLimit m_mode;
+  uint32_t m_uMaxFps;
+  TClock m_clock;
+
+  uint64_t m_uDeadline = 0; // when the next frame should be shown
+  uint64_t m_uFrameStart = 0;
+  uint64_t m_uLastEnd = 0;
+  std::array<uint64_t, s_uWindow> m_auWork{}; // ring of recent frame work
+  size_t m_uWorkCount = 0;
+
+  CFrameHistogram m_frameTimes;
+  CFrameHistogram m_inputLatency;
+};
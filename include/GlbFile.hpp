@@ -0,0 +1,311 @@
+#pragma once
+
+#include "Json.hpp"
+#include "MappedFile.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// binary glTF: 12 byte header, a JSON chunk and an optional BIN chunk that
+// backs buffer 0. only self contained files are handled, external and data:
+// uri buffers are left to the real importer.
+class CGlbFile {
+public:
+  static constexpr uint32_t s_uMagic = 0x46546C67;     // "glTF"
+  static constexpr uint32_t s_uChunkJson = 0x4E4F534A; // "JSON"
+  static constexpr uint32_t s_uChunkBin = 0x004E4942;  // "BIN\0"
+
+  CJson json;
+  std::vector<uint8_t> bin;
+
+  bool Load(const std::filesystem::path &path, std::string &error) {
+    CMappedFile l_file;
+    if (!l_file.Open(path)) {
+      error = "could not open file";
+      return false;
+    }
+
+    const auto *data = reinterpret_cast<const uint8_t *>(l_file.Data());
+    const size_t size = l_file.Size();
+
+    if (size < 20 || ReadU32(data) != s_uMagic || ReadU32(data + 4) != 2) {
+      error = "not a glTF 2.0 binary";
+      return false;
+    }
+
+    const size_t l_uLength = std::min<size_t>(ReadU32(data + 8), size);
+    bool l_bHasJson = false;
+    bin.clear();
+
+    for (size_t pos = 12; pos + 8 <= l_uLength;) {
+      const size_t chunkSize = ReadU32(data + pos);
+      const uint32_t chunkType = ReadU32(data + pos + 4);
+      pos += 8;
+
+      if (chunkSize > l_uLength - pos) {
+        error = "truncated chunk";
+        return false;
+      }
+
+      if (chunkType == s_uChunkJson && !l_bHasJson) {
+        std::string_view text(reinterpret_cast<const char *>(data + pos),
+                              chunkSize);
+        if (!CJson::Parse(text, json, error))
+          return false;
+        l_bHasJson = true;
+      } else if (chunkType == s_uChunkBin && bin.empty()) {
+        bin.assign(data + pos, data + pos + chunkSize);
+      }
+
+      pos += chunkSize;
+    }
+
+    if (!l_bHasJson || !json.IsObject()) {
+      error = "missing JSON chunk";
+      return false;
+    }
+    return true;
+  }
+
+  // writes to a temporary file first, same as the scan index
+  bool Save(const std::filesystem::path &path) const {
+    std::string l_sJson;
+    json.Dump(l_sJson);
+    while (l_sJson.size() % 4)
+      l_sJson += ' ';
+
+    const size_t l_uBinPadded = (bin.size() + 3) & ~size_t(3);
+    size_t l_uTotal = 12 + 8 + l_sJson.size();
+    if (!bin.empty())
+      l_uTotal += 8 + l_uBinPadded;
+
+    if (l_uTotal > UINT32_MAX)
+      return false;
+
+    std::error_code ec;
+    std::filesystem::create_directories(path.parent_path(), ec);
+
+    // the loader and the prefetcher can bake the same file at once
+    std::filesystem::path l_tmpPath = path;
+    l_tmpPath += ".tmp" + std::to_string(std::hash<std::thread::id>()(
+                              std::this_thread::get_id()));
+
+    FILE *out = std::fopen(l_tmpPath.c_str(), "wb");
+    if (!out)
+      return false;
+
+    const uint32_t l_header[5] = {s_uMagic, 2, static_cast<uint32_t>(l_uTotal),
+                                  static_cast<uint32_t>(l_sJson.size()),
+                                  s_uChunkJson};
+    bool ok = std::fwrite(l_header, sizeof(l_header), 1, out) == 1;
+    ok = ok && std::fwrite(l_sJson.data(), 1, l_sJson.size(), out) ==
+                   l_sJson.size();
+
+    if (!bin.empty()) {
+      const uint32_t l_binHeader[2] = {static_cast<uint32_t>(l_uBinPadded),
+                                       s_uChunkBin};
+      const uint8_t l_zeros[4] = {};
+      ok = ok && std::fwrite(l_binHeader, sizeof(l_binHeader), 1, out) == 1;
+      ok = ok && std::fwrite(bin.data(), 1, bin.size(), out) == bin.size();
+      ok = ok && std::fwrite(l_zeros, 1, l_uBinPadded - bin.size(), out) ==
+                     l_uBinPadded - bin.size();
+    }
+    ok = (std::fclose(out) == 0) && ok;
+
+    if (ok)
+      std::filesystem::rename(l_tmpPath, path, ec);
+    if (!ok || ec) {
+      std::filesystem::remove(l_tmpPath, ec);
+      return false;
+    }
+    return true;
+  }
+
+  // everything lives in buffer 0 == the BIN chunk
+  bool IsSelfContained() const {
+    const CJson *buffers = json.Find("buffers");
+    if (!buffers)
+      return true;
+    if (buffers->Size() > 1)
+      return false;
+    return buffers->Size() == 0 || !buffers->GetArray()[0].Find("uri");
+  }
+
+  // the file an image uri points at, relative ones are resolved against dir.
+  // empty for data: and other non file uris.
+  static std::filesystem::path GetUriPath(std::string_view uri,
+                                          const std::filesystem::path &dir) {
+    const size_t l_uColon = uri.find(':');
+    if (uri.empty() || (l_uColon != std::string_view::npos &&
+                        l_uColon < uri.find('/')))
+      return {};
+
+    std::string l_sPath;
+    for (size_t i = 0; i < uri.size(); i++) {
+      if (uri[i] == '%' && i + 2 < uri.size() &&
+          std::isxdigit(static_cast<unsigned char>(uri[i + 1])) &&
+          std::isxdigit(static_cast<unsigned char>(uri[i + 2]))) {
+        l_sPath += static_cast<char>(
+            std::stoi(std::string(uri.substr(i + 1, 2)), nullptr, 16));
+        i += 2;
+      } else {
+        l_sPath += uri[i];
+      }
+    }
+
+    std::filesystem::path l_path(l_sPath);
+    return l_path.is_absolute() ? l_path : dir / l_path;
+  }
+
+  // bytes of an image stored in a bufferView, null for uri images
+  const uint8_t *GetImageData(const CJson &image, size_t &size) const {
+    const CJson *viewIndex = image.Find("bufferView");
+    const CJson *views = json.Find("bufferViews");
+    if (!viewIndex || !views || viewIndex->AsInt() < 0 ||
+        static_cast<size_t>(viewIndex->AsInt()) >= views->Size())
+      return nullptr;
+
+    const CJson &view =
+        views->GetArray()[static_cast<size_t>(viewIndex->AsInt())];
+    const uint64_t offset = GetOptional(view, "byteOffset");
+    size = static_cast<size_t>(GetOptional(view, "byteLength"));
+    if (GetOptional(view, "buffer") != 0 || offset + size > bin.size())
+      return nullptr;
+    return bin.data() + offset;
+  }
+
+  // element layout of one accessor, resolved against its bufferView
+  struct SAccessor {
+    const uint8_t *data = nullptr; // null for accessors without a view
+    uint32_t count = 0;
+    uint32_t componentType = 0;
+    uint32_t components = 0;
+    uint32_t elementSize = 0;
+    uint32_t stride = 0;
+    bool normalized = false;
+    bool sparse = false;
+  };
+
+  static uint32_t GetComponentSize(uint32_t componentType) {
+    switch (componentType) {
+    case 5120: // BYTE
+    case 5121: // UNSIGNED_BYTE
+      return 1;
+    case 5122: // SHORT
+    case 5123: // UNSIGNED_SHORT
+      return 2;
+    case 5125: // UNSIGNED_INT
+    case 5126: // FLOAT
+      return 4;
+    default:
+      return 0;
+    }
+  }
+
+  static uint32_t GetComponentCount(std::string_view type) {
+    if (type == "SCALAR")
+      return 1;
+    if (type == "VEC2")
+      return 2;
+    if (type == "VEC3")
+      return 3;
+    if (type == "VEC4" || type == "MAT2")
+      return 4;
+    if (type == "MAT3")
+      return 9;
+    if (type == "MAT4")
+      return 16;
+    return 0;
+  }
+
+  // validates the accessor against the BIN chunk
+  bool GetAccessor(int64_t index, SAccessor &out) const {
+    const CJson *accessors = json.Find("accessors");
+    if (!accessors || index < 0 ||
+        static_cast<size_t>(index) >= accessors->Size())
+      return false;
+
+    const CJson &accessor = accessors->GetArray()[static_cast<size_t>(index)];
+    const CJson *type = accessor.Find("type");
+    const CJson *componentType = accessor.Find("componentType");
+    const CJson *count = accessor.Find("count");
+    if (!type || !componentType || !count)
+      return false;
+
+    out = SAccessor{};
+    out.componentType = static_cast<uint32_t>(componentType->AsInt(0));
+    out.components = GetComponentCount(type->AsString());
+    out.count = static_cast<uint32_t>(std::max<int64_t>(count->AsInt(0), 0));
+
+    // byte/short matrices have padded columns, nothing exports those
+    const uint32_t l_uCompSize = GetComponentSize(out.componentType);
+    if (!l_uCompSize || !out.components ||
+        (out.components >= 4 && type->AsString().starts_with("MAT") &&
+         l_uCompSize < 4))
+      return false;
+
+    out.elementSize = l_uCompSize * out.components;
+    out.stride = out.elementSize;
+    if (const CJson *normalized = accessor.Find("normalized"))
+      out.normalized = normalized->AsBool();
+    out.sparse = accessor.Find("sparse") != nullptr;
+
+    const CJson *viewIndex = accessor.Find("bufferView");
+    if (!viewIndex)
+      return true;
+
+    const CJson *views = json.Find("bufferViews");
+    const int64_t view = viewIndex->AsInt();
+    if (!views || view < 0 || static_cast<size_t>(view) >= views->Size())
+      return false;
+
+    const CJson &bufferView = views->GetArray()[static_cast<size_t>(view)];
+    if (const CJson *buffer = bufferView.Find("buffer");
+        !buffer || buffer->AsInt() != 0)
+      return false;
+
+    const CJson *viewLength = bufferView.Find("byteLength");
+    const uint64_t l_uViewOffset = GetOptional(bufferView, "byteOffset");
+    const uint64_t l_uViewLength =
+        viewLength ? static_cast<uint64_t>(std::max<int64_t>(
+                         viewLength->AsInt(0), 0))
+                   : 0;
+    const uint64_t l_uOffset = GetOptional(accessor, "byteOffset");
+    if (const uint64_t stride = GetOptional(bufferView, "byteStride"))
+      out.stride = static_cast<uint32_t>(stride);
+
+    if (l_uViewOffset + l_uViewLength > bin.size() ||
+        out.stride < out.elementSize)
+      return false;
+
+    if (out.count) {
+      const uint64_t l_uEnd =
+          l_uOffset + uint64_t(out.count - 1) * out.stride + out.elementSize;
+      if (l_uEnd > l_uViewLength)
+        return false;
+    }
+
+    out.data = bin.data() + l_uViewOffset + l_uOffset;
+    return true;
+  }
+
+  static uint64_t GetOptional(const CJson &object, std::string_view key) {
+    const CJson *value = object.Find(key);
+    return value ? static_cast<uint64_t>(std::max<int64_t>(value->AsInt(0), 0))
+                 : 0;
+  }
+
+private:
+  static uint32_t ReadU32(const uint8_t *data) {
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+  }
+};
@@ -0,0 +1,343 @@
+#pragma once
+
+#include "BlockCompression.hpp"
+#include "ImageDecoder.hpp"
+#include "glad/glad.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// a texture of CGpuTextures, 0 is none. it outlives the GL textures that
+// back it while its levels stream in.
+using TextureID = uint32_t;
+
+// what Stream changed: the texture now samples through handle
+struct STextureSwap {
+  TextureID texture;
+  uint64_t handle;
+};
+
+// textures the viewer decoded itself, with a resident bindless handle for
+// the material SSBO. images are shared by their content key, every model
+// and material showing the same image gets the same texture and handle. a
+// texture is deleted when the last owner releases it, whatever is left goes
+// with the GL context. block compressed images are uploaded as they are, or
+// decompressed first if the driver can not sample the format.
+//
+// with a stream budget a texture starts out with the levels up to
+// s_uCoarseSize only and Stream uploads the finer ones a few rows per frame.
+// the state of a texture with a handle is frozen, so every finer level goes
+// into a new texture that gets the coarser levels copied over on the GPU and
+// a handle of its own once complete. the old handle is retired behind a
+// fence, draws still in flight keep sampling it.
+class CGpuTextures {
+public:
+  // the largest level a streamed texture starts with
+  static constexpr uint32_t s_uCoarseSize = 128;
+
+  // bytes Stream may upload per call, 0 uploads every level right away
+  void SetStreamBudget(uint64_t bytes) { m_uStreamBudget = bytes; }
+
+  // one texture per image, 0 for the empty ones, each returned with a
+  // reference. a model's images are uploaded together once all of them are
+  // decoded, the ones still streaming keep their image until their last
+  // level is up. an image whose key is on the GPU already, or earlier in
+  // images, gets that texture and needs no pixels.
+  std::vector<TextureID> Upload(std::vector<STextureImage> images,
+                                const std::vector<uint64_t> &keys = {}) {
+    std::vector<TextureID> l_vuTextures(images.size(), 0);
+    for (size_t i = 0; i < images.size(); i++) {
+      STextureImage &image = images[i];
+      const uint64_t key = i < keys.size() ? keys[i] : 0;
+      if (auto shared = key ? m_mapKeys.find(key) : m_mapKeys.end();
+          shared != m_mapKeys.end()) {
+        m_mapTextures[shared->second].owners++;
+        l_vuTextures[i] = shared->second;
+        continue;
+      }
+      if (image.Empty())
+        continue;
+      if (image.format != ETextureFormat::RGBA8 && !IsSupported(image.format)) {
+        STextureImage l_decompressed;
+        if (!DecompressImage(image, l_decompressed))
+          continue;
+        image = std::move(l_decompressed);
+      }
+
+      uint32_t l_uFirst = 0;
+      if (m_uStreamBudget)
+        while (l_uFirst + 1 < image.GetLevelCount() &&
+               std::max(image.GetLevelWidth(l_uFirst),
+                        image.GetLevelHeight(l_uFirst)) > s_uCoarseSize)
+          l_uFirst++;
+
+      STexture l_texture;
+      l_texture.gl = CreateTexture(image, l_uFirst);
+      for (uint32_t level = l_uFirst; level < image.GetLevelCount(); level++)
+        UploadRows(l_texture.gl, image, level, l_uFirst, 0,
+                   image.GetLevelHeight(level));
+      l_texture.handle = MakeResident(l_texture.gl);
+      l_texture.firstLevel = l_uFirst;
+      l_texture.bytes = GetChainBytes(image, l_uFirst);
+      l_texture.size = image.pixels.size();
+      l_texture.key = key;
+      if (key)
+        m_mapKeys[key] = m_uNextID;
+      if (l_uFirst > 0) {
+        m_uStreamingBytes += image.levels[l_uFirst];
+        l_texture.image = std::move(image);
+      }
+
+      m_uBytes += l_texture.bytes;
+      l_vuTextures[i] = m_uNextID;
+      m_mapTextures[m_uNextID++] = std::move(l_texture);
+    }
+    return l_vuTextures;
+  }
+
+  uint64_t GetHandle(TextureID texture) const {
+    auto found = m_mapTextures.find(texture);
+    return found == m_mapTextures.end() ? 0 : found->second.handle;
+  }
+
+  // bytes with every level, streamed in or not
+  uint64_t GetSize(TextureID texture) const {
+    auto found = m_mapTextures.find(texture);
+    return found == m_mapTextures.end() ? 0 : found->second.size;
+  }
+
+  void Retain(TextureID texture) {
+    if (auto found = m_mapTextures.find(texture); found != m_mapTextures.end())
+      found->second.owners++;
+  }
+
+  // the GPU must be done with the texture, same as with a model
+  void Release(TextureID texture) {
+    auto found = m_mapTextures.find(texture);
+    if (found == m_mapTextures.end() || --found->second.owners > 0)
+      return;
+
+    STexture &l_texture = found->second;
+    glMakeTextureHandleNonResidentARB(l_texture.handle);
+    glDeleteTextures(1, &l_texture.gl);
+    if (l_texture.next)
+      glDeleteTextures(1, &l_texture.next);
+    if (l_texture.firstLevel > 0)
+      m_uStreamingBytes -= l_texture.image.levels[l_texture.firstLevel] -
+                           l_texture.GetNextUploaded();
+    m_uBytes -= l_texture.bytes;
+    if (l_texture.key)
+      m_mapKeys.erase(l_texture.key);
+    m_mapTextures.erase(found);
+  }
+
+  // once per frame before the materials go to the GPU. uploads up to the
+  // budget of the next finer levels, newest textures first as they belong
+  // to the model just shown, and returns the textures whose handle changed.
+  // handles retired earlier are freed once the GPU is past them.
+  std::vector<STextureSwap> Stream() {
+    FreeRetired();
+
+    std::vector<STextureSwap> l_vSwaps;
+    uint64_t l_uBudget = m_uStreamBudget;
+    for (auto it = m_mapTextures.rbegin(); it != m_mapTextures.rend(); ++it) {
+      if (l_uBudget == 0 || m_uStreamingBytes == 0)
+        break;
+      if (it->second.firstLevel > 0 && StreamRows(it->second, l_uBudget))
+        l_vSwaps.push_back({it->first, it->second.handle});
+    }
+    return l_vSwaps;
+  }
+
+  uint64_t GetBytes() const { return m_uBytes; }
+
+  // bytes of finer levels not on the GPU yet
+  uint64_t GetStreamingBytes() const { return m_uStreamingBytes; }
+
+  // asked once per format, a driver without BPTC or RGTC gets RGBA8
+  bool IsSupported(ETextureFormat format) {
+    const size_t index = static_cast<size_t>(format);
+    if (m_iSupported[index] < 0) {
+      GLint supported = GL_FALSE;
+      glGetInternalformativ(GL_TEXTURE_2D, GetInternalFormat(format),
+                            GL_INTERNALFORMAT_SUPPORTED, 1, &supported);
+      m_iSupported[index] = supported == GL_TRUE ? 1 : 0;
+      if (!m_iSupported[index])
+        std::printf("no %s textures, decompressing them\n",
+                    format == ETextureFormat::BC5 ? "BC5" : "BC7");
+    }
+    return m_iSupported[index] == 1;
+  }
+
+private:
+  struct STexture {
+    GLuint gl = 0; // levels firstLevel and coarser of the image
+    GLuint64 handle = 0;
+    uint32_t owners = 1;
+    uint64_t bytes = 0; // on the GPU now
+    uint64_t size = 0;  // once every level is
+    uint64_t key = 0;
+
+    // while streaming: the whole chain, and level firstLevel - 1 being
+    // filled into next, which has the levels of gl copied over already
+    STextureImage image;
+    uint32_t firstLevel = 0;
+    GLuint next = 0;
+    uint32_t nextRows = 0;
+
+    uint64_t GetNextUploaded() const {
+      if (!next)
+        return 0;
+      return GetLevelBytes(image.format, image.GetLevelWidth(firstLevel - 1),
+                           nextRows);
+    }
+  };
+
+  struct SRetired {
+    GLuint gl;
+    GLuint64 handle;
+    GLsync fence;
+  };
+
+  std::map<TextureID, STexture> m_mapTextures; // ids only grow, oldest first
+  std::unordered_map<uint64_t, TextureID> m_mapKeys;
+  std::vector<SRetired> m_vRetired;
+  TextureID m_uNextID = 1;
+  uint64_t m_uBytes = 0;
+  uint64_t m_uStreamingBytes = 0;
+  uint64_t m_uStreamBudget = 0;
+  int m_iSupported[3] = {1, -1, -1}; // per ETextureFormat, -1 not asked yet
+
+  static GLenum GetInternalFormat(ETextureFormat format) {
+    switch (format) {
+    case ETextureFormat::BC7:
+      return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    case ETextureFormat::BC5:
+      return GL_COMPRESSED_RG_RGTC2;
+    default:
+      return GL_RGBA8;
+    }
+  }
+
+  static uint64_t GetChainBytes(const STextureImage &image, uint32_t first) {
+    return image.pixels.size() - image.levels[first];
+  }
+
+  // storage for the levels of image from first on, level first is the
+  // texture's level 0
+  static GLuint CreateTexture(const STextureImage &image, uint32_t first) {
+    GLuint texture = 0;
+    glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+    glTextureStorage2D(texture,
+                       static_cast<GLsizei>(image.GetLevelCount() - first),
+                       GetInternalFormat(image.format),
+                       static_cast<GLsizei>(image.GetLevelWidth(first)),
+                       static_cast<GLsizei>(image.GetLevelHeight(first)));
+    return texture;
+  }
+
+  // rows [row, row + count) of a level, block compressed ones start on a
+  // block row
+  static void UploadRows(GLuint texture, const STextureImage &image,
+                         uint32_t level, uint32_t first, uint32_t row,
+                         uint32_t count) {
+    const uint32_t width = image.GetLevelWidth(level);
+    const uint8_t *data =
+        image.GetLevelData(level) + GetLevelBytes(image.format, width, row);
+    const GLint target = static_cast<GLint>(level - first);
+    if (image.format == ETextureFormat::RGBA8)
+      glTextureSubImage2D(texture, target, 0, static_cast<GLint>(row),
+                          static_cast<GLsizei>(width),
+                          static_cast<GLsizei>(count), GL_RGBA,
+                          GL_UNSIGNED_BYTE, data);
+    else
+      glCompressedTextureSubImage2D(
+          texture, target, 0, static_cast<GLint>(row),
+          static_cast<GLsizei>(width), static_cast<GLsizei>(count),
+          GetInternalFormat(image.format),
+          static_cast<GLsizei>(GetLevelBytes(image.format, width, count)),
+          data);
+  }
+
+  // the sampler state is frozen once there is a handle
+  static GLuint64 MakeResident(GLuint texture) {
+    glTextureParameteri(texture, GL_TEXTURE_MIN_FILTER,
+                        GL_LINEAR_MIPMAP_LINEAR);
+    glTextureParameteri(texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTextureParameteri(texture, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    const GLuint64 handle = glGetTextureHandleARB(texture);
+    glMakeTextureHandleResidentARB(handle);
+    return handle;
+  }
+
+  // fills the next finer level within budget, true once it is complete and
+  // the texture samples through a new handle
+  bool StreamRows(STexture &texture, uint64_t &budget) {
+    const STextureImage &image = texture.image;
+    const uint32_t level = texture.firstLevel - 1;
+    const uint32_t width = image.GetLevelWidth(level);
+    const uint32_t height = image.GetLevelHeight(level);
+
+    if (!texture.next) {
+      texture.next = CreateTexture(image, level);
+      for (uint32_t copy = texture.firstLevel; copy < image.GetLevelCount();
+           copy++)
+        glCopyImageSubData(
+            texture.gl, GL_TEXTURE_2D,
+            static_cast<GLint>(copy - texture.firstLevel), 0, 0, 0,
+            texture.next, GL_TEXTURE_2D, static_cast<GLint>(copy - level), 0,
+            0, 0, static_cast<GLsizei>(image.GetLevelWidth(copy)),
+            static_cast<GLsizei>(image.GetLevelHeight(copy)), 1);
+    }
+
+    // a row of blocks is 4 rows of pixels. at least one, a level bigger
+    // than the budget still moves.
+    const uint32_t l_uRowHeight = image.format == ETextureFormat::RGBA8 ? 1 : 4;
+    const uint64_t l_uRowBytes = GetLevelBytes(image.format, width, 1);
+    const uint64_t l_uRows =
+        std::max<uint64_t>(budget / l_uRowBytes, 1) * l_uRowHeight;
+    const uint32_t l_uCount = static_cast<uint32_t>(
+        std::min<uint64_t>(l_uRows, height - texture.nextRows));
+
+    const uint64_t l_uBefore = texture.GetNextUploaded();
+    UploadRows(texture.next, image, level, level, texture.nextRows, l_uCount);
+    texture.nextRows += l_uCount;
+    const uint64_t l_uUploaded = texture.GetNextUploaded() - l_uBefore;
+    budget -= std::min(budget, l_uUploaded);
+    m_uStreamingBytes -= l_uUploaded;
+    if (texture.nextRows < height)
+      return false;
+
+    m_vRetired.push_back({texture.gl, texture.handle,
+                          glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)});
+    m_uBytes += GetChainBytes(image, level) - texture.bytes;
+    texture.bytes = GetChainBytes(image, level);
+    texture.gl = texture.next;
+    texture.handle = MakeResident(texture.gl);
+    texture.next = 0;
+    texture.nextRows = 0;
+    texture.firstLevel = level;
+    if (level == 0)
+      texture.image = STextureImage{}; // the CPU copy is done
+    return true;
+  }
+
+  void FreeRetired() {
+    std::erase_if(m_vRetired, [](const SRetired &retired) {
+      const GLenum status = glClientWaitSync(retired.fence, 0, 0);
+      if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        return false;
+
+      glDeleteSync(retired.fence);
+      glMakeTextureHandleNonResidentARB(retired.handle);
+      glDeleteTextures(1, &retired.gl);
+      return true;
+    });
+  }
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// FNV-1a, good enough for cache keys built from short strings
+constexpr uint64_t HashFNV1a(std::string_view data,
+                             uint64_t seed = 14695981039346656037ull) {
+  uint64_t hash = seed;
+  for (char c : data) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+// XXH64, for hashing whole files where FNV-1a's byte at a time loop shows
+inline uint64_t HashXXH64(const void *data, size_t size, uint64_t seed = 0) {
+  constexpr uint64_t s_p1 = 11400714785074694791ull;
+  constexpr uint64_t s_p2 = 14029467366897019727ull;
+  constexpr uint64_t s_p3 = 1609587929392839161ull;
+  constexpr uint64_t s_p4 = 9650029242287828579ull;
+  constexpr uint64_t s_p5 = 2870177450012600261ull;
+
+  auto l_read64 = [](const uint8_t *p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+  };
+  auto l_read32 = [](const uint8_t *p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return uint64_t(value);
+  };
+  auto l_round = [](uint64_t acc, uint64_t input) {
+    return std::rotl(acc + input * s_p2, 31) * s_p1;
+  };
+  auto l_merge = [&](uint64_t acc, uint64_t value) {
+    return (acc ^ l_round(0, value)) * s_p1 + s_p4;
+  };
+
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  const uint8_t *end = p + size;
+  uint64_t hash;
+
+  if (size >= 32) {
+    uint64_t v1 = seed + s_p1 + s_p2, v2 = seed + s_p2, v3 = seed,
+             v4 = seed - s_p1;
+    for (; p + 32 <= end; p += 32) {
+      v1 = l_round(v1, l_read64(p));
+      v2 = l_round(v2, l_read64(p + 8));
+      v3 = l_round(v3, l_read64(p + 16));
+      v4 = l_round(v4, l_read64(p + 24));
+    }
+    hash = std::rotl(v1, 1) + std::rotl(v2, 7) + std::rotl(v3, 12) +
+           std::rotl(v4, 18);
+    hash = l_merge(hash, v1);
+    hash = l_merge(hash, v2);
+    hash = l_merge(hash, v3);
+    hash = l_merge(hash, v4);
+  } else {
+    hash = seed + s_p5;
+  }
+  hash += size;
+
+  for (; p + 8 <= end; p += 8)
+    hash = std::rotl(hash ^ l_round(0, l_read64(p)), 27) * s_p1 + s_p4;
+  if (p + 4 <= end) {
+    hash = std::rotl(hash ^ (l_read32(p) * s_p1), 23) * s_p2 + s_p3;
+    p += 4;
+  }
+  for (; p < end; p++)
+    hash = std::rotl(hash ^ (*p * s_p5), 11) * s_p1;
+
+  hash ^= hash >> 33;
+  hash *= s_p2;
+  hash ^= hash >> 29;
+  hash *= s_p3;
+  hash ^= hash >> 32;
+  return hash;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "MappedFile.hpp"
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// .hzmdl files are boost binary archives. the preamble is checked on the
+// loader thread so a truncated or foreign file is rejected before it ever
+// reaches the deserializer on the render thread:
+//   uint64 length (22) | "serialization::archive" | uint16 library version |
+//   sizeof(int) sizeof(long) sizeof(float) sizeof(double) | endian marker
+inline bool ValidateHazModel(const CMappedFile &file, std::string &error) {
+  static constexpr std::string_view s_signature = "serialization::archive";
+  static constexpr size_t s_uPreamble =
+      sizeof(uint64_t) + s_signature.size() + sizeof(uint16_t) + 5;
+
+  if (!file.IsOpen() || file.Size() < s_uPreamble) {
+    error = "file too small for a .hzmdl header";
+    return false;
+  }
+
+  const auto *data = reinterpret_cast<const char *>(file.Data());
+
+  uint64_t l_uLength = 0;
+  std::memcpy(&l_uLength, data, sizeof(l_uLength));
+  if (l_uLength != s_signature.size() ||
+      std::string_view(data + sizeof(uint64_t), s_signature.size()) !=
+          s_signature) {
+    error = "missing boost archive signature";
+    return false;
+  }
+
+  const char *sizes = data + sizeof(uint64_t) + s_signature.size() +
+                      sizeof(uint16_t);
+  if (sizes[0] != sizeof(int) || sizes[1] != sizeof(long) ||
+      sizes[2] != sizeof(float) || sizes[3] != sizeof(double)) {
+    error = "archive written on a platform with different type sizes";
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,247 @@
+#pragma once
+
+#include <algorithm>
+#include <csetjmp>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <jpeglib.h>
+#include <png.h>
+#include <string>
+#include <vector>
+
+// decoded images are RGBA8, the texture cache holds 4x4 blocks of 16 bytes,
+// see BlockCompression.hpp
+enum class ETextureFormat : uint8_t { RGBA8, BC7, BC5 };
+
+inline size_t GetLevelBytes(ETextureFormat format, uint32_t width,
+                            uint32_t height) {
+  if (format == ETextureFormat::RGBA8)
+    return size_t(width) * height * 4;
+  return size_t((width + 3) / 4) * ((height + 3) / 4) * 16;
+}
+
+// level 0 followed by its mip chain down to 1x1, every level tightly packed
+struct STextureImage {
+  uint32_t width = 0;
+  uint32_t height = 0;
+  ETextureFormat format = ETextureFormat::RGBA8;
+  std::vector<uint8_t> pixels;
+  std::vector<size_t> levels; // byte offset of every level in pixels
+
+  // GL_MAX_TEXTURE_SIZE of the bigger GPUs
+  static constexpr uint32_t s_uMaxSize = 16384;
+
+  bool Empty() const { return levels.empty(); }
+
+  uint32_t GetLevelCount() const {
+    return static_cast<uint32_t>(levels.size());
+  }
+  uint32_t GetLevelWidth(uint32_t level) const {
+    return std::max(1u, width >> level);
+  }
+  uint32_t GetLevelHeight(uint32_t level) const {
+    return std::max(1u, height >> level);
+  }
+  const uint8_t *GetLevelData(uint32_t level) const {
+    return pixels.data() + levels[level];
+  }
+  size_t GetLevelSize(uint32_t level) const {
+    return GetLevelBytes(format, GetLevelWidth(level), GetLevelHeight(level));
+  }
+
+  static uint32_t GetFullLevelCount(uint32_t width, uint32_t height) {
+    uint32_t count = 1;
+    while ((std::max(width, height) >> count) > 0)
+      count++;
+    return count;
+  }
+
+  // lays the chain out and sizes pixels for it, the levels are left to
+  // fill in
+  void Allocate(uint32_t w, uint32_t h,
+                ETextureFormat layout = ETextureFormat::RGBA8) {
+    width = w;
+    height = h;
+    format = layout;
+    levels.clear();
+
+    size_t l_uBytes = 0;
+    for (uint32_t level = 0; level < GetFullLevelCount(w, h); level++) {
+      levels.push_back(l_uBytes);
+      l_uBytes += GetLevelSize(level);
+    }
+    pixels.resize(l_uBytes);
+  }
+};
+
+// 2x2 box filter, an odd last row or column is averaged with itself
+inline void DownsampleLevel(const uint8_t *src, uint32_t srcWidth,
+                            uint32_t srcHeight, uint8_t *dst,
+                            uint32_t dstWidth, uint32_t dstHeight) {
+  for (uint32_t y = 0; y < dstHeight; y++) {
+    const uint32_t y0 = std::min(y * 2, srcHeight - 1);
+    const uint32_t y1 = std::min(y * 2 + 1, srcHeight - 1);
+    const uint8_t *row0 = src + size_t(y0) * srcWidth * 4;
+    const uint8_t *row1 = src + size_t(y1) * srcWidth * 4;
+    uint8_t *out = dst + size_t(y) * dstWidth * 4;
+
+    for (uint32_t x = 0; x < dstWidth; x++) {
+      const size_t x0 = size_t(std::min(x * 2, srcWidth - 1)) * 4;
+      const size_t x1 = size_t(std::min(x * 2 + 1, srcWidth - 1)) * 4;
+      for (size_t c = 0; c < 4; c++)
+        out[size_t(x) * 4 + c] = static_cast<uint8_t>(
+            (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) /
+            4);
+    }
+  }
+}
+
+inline void GenerateMips(STextureImage &image) {
+  for (uint32_t level = 1; level < image.GetLevelCount(); level++)
+    DownsampleLevel(image.pixels.data() + image.levels[level - 1],
+                    image.GetLevelWidth(level - 1),
+                    image.GetLevelHeight(level - 1),
+                    image.pixels.data() + image.levels[level],
+                    image.GetLevelWidth(level), image.GetLevelHeight(level));
+}
+
+inline bool CheckImageSize(uint32_t width, uint32_t height,
+                           std::string &error) {
+  if (width == 0 || height == 0 || width > STextureImage::s_uMaxSize ||
+      height > STextureImage::s_uMaxSize) {
+    error = "unsupported size " + std::to_string(width) + "x" +
+            std::to_string(height);
+    return false;
+  }
+  return true;
+}
+
+inline bool DecodePng(const uint8_t *data, size_t size, STextureImage &out,
+                      std::string &error) {
+  png_image l_image;
+  std::memset(&l_image, 0, sizeof(l_image));
+  l_image.version = PNG_IMAGE_VERSION;
+
+  if (!png_image_begin_read_from_memory(&l_image, data, size)) {
+    error = l_image.message;
+    return false;
+  }
+  if (!CheckImageSize(l_image.width, l_image.height, error)) {
+    png_image_free(&l_image);
+    return false;
+  }
+
+  l_image.format = PNG_FORMAT_RGBA;
+  out.Allocate(l_image.width, l_image.height);
+  if (!png_image_finish_read(&l_image, nullptr, out.pixels.data(), 0,
+                             nullptr)) {
+    error = l_image.message;
+    return false;
+  }
+  return true;
+}
+
+// RGBA8 rows, bottomUp for rows the way GL reads them back
+inline bool SavePng(const char *path, const uint8_t *pixels, uint32_t width,
+                    uint32_t height, bool bottomUp, std::string &error) {
+  png_image l_image;
+  std::memset(&l_image, 0, sizeof(l_image));
+  l_image.version = PNG_IMAGE_VERSION;
+  l_image.width = width;
+  l_image.height = height;
+  l_image.format = PNG_FORMAT_RGBA;
+
+  const png_int_32 l_iStride = static_cast<png_int_32>(width * 4);
+  if (!png_image_write_to_file(&l_image, path, 0, pixels,
+                               bottomUp ? -l_iStride : l_iStride, nullptr)) {
+    error = l_image.message;
+    return false;
+  }
+  return true;
+}
+
+// libjpeg reports errors by calling error_exit, which must not return
+struct SJpegError {
+  jpeg_error_mgr mgr;
+  std::jmp_buf jump;
+  char message[JMSG_LENGTH_MAX];
+};
+
+// warnings about damaged data would go to stderr, the decoder goes on
+inline void JpegIgnoreMessage(j_common_ptr) {}
+
+[[noreturn]] inline void JpegErrorExit(j_common_ptr info) {
+  auto *l_error = reinterpret_cast<SJpegError *>(info->err);
+  (*info->err->format_message)(info, l_error->message);
+  std::longjmp(l_error->jump, 1);
+}
+
+// nothing between setjmp and the longjmp has a destructor to skip
+inline bool DecodeJpeg(const uint8_t *data, size_t size, STextureImage &out,
+                       std::string &error) {
+  jpeg_decompress_struct l_info;
+  SJpegError l_error;
+  l_info.err = jpeg_std_error(&l_error.mgr);
+  l_error.mgr.error_exit = JpegErrorExit;
+  l_error.mgr.output_message = JpegIgnoreMessage;
+
+  if (setjmp(l_error.jump)) {
+    jpeg_destroy_decompress(&l_info);
+    error = l_error.message;
+    return false;
+  }
+
+  jpeg_create_decompress(&l_info);
+  jpeg_mem_src(&l_info, data, static_cast<unsigned long>(size));
+  jpeg_read_header(&l_info, TRUE);
+  l_info.out_color_space = JCS_RGB; // grayscale is expanded too
+  jpeg_start_decompress(&l_info);
+
+  if (!CheckImageSize(l_info.output_width, l_info.output_height, error)) {
+    jpeg_destroy_decompress(&l_info);
+    return false;
+  }
+
+  // RGB rows go to the front of each RGBA row and are spread out after
+  const uint32_t width = l_info.output_width;
+  out.Allocate(width, l_info.output_height);
+  while (l_info.output_scanline < l_info.output_height) {
+    JSAMPROW row =
+        out.pixels.data() + size_t(l_info.output_scanline) * width * 4;
+    jpeg_read_scanlines(&l_info, &row, 1);
+
+    for (size_t x = width; x-- > 0;) {
+      row[x * 4 + 3] = 255;
+      row[x * 4 + 2] = row[x * 3 + 2];
+      row[x * 4 + 1] = row[x * 3 + 1];
+      row[x * 4] = row[x * 3];
+    }
+  }
+
+  jpeg_finish_decompress(&l_info);
+  jpeg_destroy_decompress(&l_info);
+  return true;
+}
+
+// png or jpeg by their signature, with the whole mip chain
+inline bool DecodeImage(const uint8_t *data, size_t size, STextureImage &out,
+                        std::string &error) {
+  static constexpr uint8_t s_pngSignature[8] = {0x89, 'P',  'N',  'G',
+                                                '\r', '\n', 0x1a, '\n'};
+  bool decoded = false;
+  if (size >= 8 && std::memcmp(data, s_pngSignature, 8) == 0)
+    decoded = DecodePng(data, size, out, error);
+  else if (size >= 3 && data[0] == 0xff && data[1] == 0xd8 && data[2] == 0xff)
+    decoded = DecodeJpeg(data, size, out, error);
+  else
+    error = "not a png or jpeg";
+
+  if (!decoded) {
+    out = STextureImage{};
+    return false;
+  }
+  GenerateMips(out);
+  return true;
+}
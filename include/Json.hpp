@@ -0,0 +1,454 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// just enough json for glTF. objects keep their member order so a file that
+// is read and written again only differs where it was changed.
+class CJson {
+public:
+  enum class EType : uint8_t { Null, Bool, Number, String, Array, Object };
+  using Member = std::pair<std::string, CJson>;
+
+  CJson() = default;
+  CJson(bool value) : m_type(EType::Bool), m_bValue(value) {}
+  CJson(double value) : m_type(EType::Number), m_dValue(value) {}
+  CJson(int64_t value)
+      : m_type(EType::Number), m_dValue(static_cast<double>(value)) {}
+  CJson(uint32_t value) : m_type(EType::Number), m_dValue(value) {}
+  CJson(std::string value) : m_type(EType::String), m_sValue(std::move(value)) {}
+  CJson(const char *value) : m_type(EType::String), m_sValue(value) {}
+
+  static CJson MakeArray() {
+    CJson json;
+    json.m_type = EType::Array;
+    return json;
+  }
+
+  static CJson MakeObject() {
+    CJson json;
+    json.m_type = EType::Object;
+    return json;
+  }
+
+  EType GetType() const { return m_type; }
+  bool IsNull() const { return m_type == EType::Null; }
+  bool IsNumber() const { return m_type == EType::Number; }
+  bool IsString() const { return m_type == EType::String; }
+  bool IsArray() const { return m_type == EType::Array; }
+  bool IsObject() const { return m_type == EType::Object; }
+
+  bool AsBool(bool fallback = false) const {
+    return m_type == EType::Bool ? m_bValue : fallback;
+  }
+
+  double AsNumber(double fallback = 0.0) const {
+    return m_type == EType::Number ? m_dValue : fallback;
+  }
+
+  // glTF indices and counts, anything negative or fractional is invalid
+  int64_t AsInt(int64_t fallback = -1) const {
+    if (m_type != EType::Number || m_dValue != std::floor(m_dValue))
+      return fallback;
+    return static_cast<int64_t>(m_dValue);
+  }
+
+  const std::string &AsString() const { return m_sValue; }
+
+  std::vector<CJson> &GetArray() { return m_vArray; }
+  const std::vector<CJson> &GetArray() const { return m_vArray; }
+  std::vector<Member> &GetMembers() { return m_vMembers; }
+  const std::vector<Member> &GetMembers() const { return m_vMembers; }
+
+  size_t Size() const {
+    return m_type == EType::Array ? m_vArray.size() : m_vMembers.size();
+  }
+
+  const CJson *Find(std::string_view key) const {
+    for (const Member &member : m_vMembers)
+      if (member.first == key)
+        return &member.second;
+    return nullptr;
+  }
+
+  CJson *Find(std::string_view key) {
+    for (Member &member : m_vMembers)
+      if (member.first == key)
+        return &member.second;
+    return nullptr;
+  }
+
+  // inserts a null member if there is none, turns null into an object
+  CJson &operator[](std::string_view key) {
+    if (m_type == EType::Null)
+      m_type = EType::Object;
+    if (CJson *found = Find(key))
+      return *found;
+    m_vMembers.emplace_back(std::string(key), CJson());
+    return m_vMembers.back().second;
+  }
+
+  void Erase(std::string_view key) {
+    std::erase_if(m_vMembers,
+                  [key](const Member &member) { return member.first == key; });
+  }
+
+  void PushBack(CJson value) {
+    if (m_type == EType::Null)
+      m_type = EType::Array;
+    m_vArray.push_back(std::move(value));
+  }
+
+  static bool Parse(std::string_view text, CJson &out, std::string &error) {
+    SParser l_parser{text, 0, error};
+    out = CJson();
+    if (!l_parser.ParseValue(out, 0))
+      return false;
+
+    l_parser.SkipSpace();
+    if (l_parser.pos != text.size())
+      return l_parser.Fail("trailing characters");
+    return true;
+  }
+
+  void Dump(std::string &out) const {
+    switch (m_type) {
+    case EType::Null:
+      out += "null";
+      break;
+    case EType::Bool:
+      out += m_bValue ? "true" : "false";
+      break;
+    case EType::Number:
+      DumpNumber(m_dValue, out);
+      break;
+    case EType::String:
+      DumpString(m_sValue, out);
+      break;
+    case EType::Array:
+      out += '[';
+      for (size_t i = 0; i < m_vArray.size(); i++) {
+        if (i)
+          out += ',';
+        m_vArray[i].Dump(out);
+      }
+      out += ']';
+      break;
+    case EType::Object:
+      out += '{';
+      for (size_t i = 0; i < m_vMembers.size(); i++) {
+        if (i)
+          out += ',';
+        DumpString(m_vMembers[i].first, out);
+        out += ':';
+        m_vMembers[i].second.Dump(out);
+      }
+      out += '}';
+      break;
+    }
+  }
+
+private:
+  EType m_type = EType::Null;
+  bool m_bValue = false;
+  double m_dValue = 0.0;
+  std::string m_sValue;
+  std::vector<CJson> m_vArray;
+  std::vector<Member> m_vMembers;
+
+  static void DumpNumber(double value, std::string &out) {
+    char l_buffer[32];
+    if (!std::isfinite(value))
+      out += "null";
+    else if (value == std::floor(value) && std::fabs(value) < 9007199254740992.0)
+      out.append(l_buffer,
+                 static_cast<size_t>(std::snprintf(
+                     l_buffer, sizeof(l_buffer), "%lld",
+                     static_cast<long long>(value))));
+    else
+      out.append(l_buffer,
+                 static_cast<size_t>(std::snprintf(l_buffer, sizeof(l_buffer),
+                                                   "%.17g", value)));
+  }
+
+  static void DumpString(const std::string &str, std::string &out) {
+    out += '"';
+    for (char c : str) {
+      switch (c) {
+      case '"':
+        out += "\\\"";
+        break;
+      case '\\':
+        out += "\\\\";
+        break;
+      case '\n':
+        out += "\\n";
+        break;
+      case '\r':
+        out += "\\r";
+        break;
+      case '\t':
+        out += "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          char l_buffer[8];
+          std::snprintf(l_buffer, sizeof(l_buffer), "\\u%04x",
+                        static_cast<unsigned>(c));
+          out += l_buffer;
+        } else {
+          out += c;
+        }
+      }
+    }
+    out += '"';
+  }
+
+  struct SParser {
+    std::string_view text;
+    size_t pos;
+    std::string &error;
+
+    static constexpr int s_iMaxDepth = 128;
+
+    bool Fail(const char *what) {
+      error = std::string(what) + " at offset " + std::to_string(pos);
+      return false;
+    }
+
+    void SkipSpace() {
+      while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' ||
+                                   text[pos] == '\n' || text[pos] == '\r'))
+        pos++;
+    }
+
+    bool Consume(std::string_view word) {
+      if (text.substr(pos, word.size()) != word)
+        return false;
+      pos += word.size();
+      return true;
+    }
+
+    bool ParseValue(CJson &out, int depth) {
+      if (depth > s_iMaxDepth)
+        return Fail("nested too deep");
+
+      SkipSpace();
+      if (pos >= text.size())
+        return Fail("unexpected end");
+
+      switch (text[pos]) {
+      case '{':
+        return ParseObject(out, depth);
+      case '[':
+        return ParseArray(out, depth);
+      case '"':
+        out.m_type = EType::String;
+        return ParseString(out.m_sValue);
+      case 't':
+      case 'f':
+        out.m_type = EType::Bool;
+        out.m_bValue = text[pos] == 't';
+        return Consume(out.m_bValue ? "true" : "false") || Fail("bad literal");
+      case 'n':
+        return Consume("null") || Fail("bad literal");
+      default:
+        return ParseNumber(out);
+      }
+    }
+
+    bool ParseObject(CJson &out, int depth) {
+      out.m_type = EType::Object;
+      pos++;
+
+      SkipSpace();
+      if (pos < text.size() && text[pos] == '}') {
+        pos++;
+        return true;
+      }
+
+      while (true) {
+        SkipSpace();
+        if (pos >= text.size() || text[pos] != '"')
+          return Fail("expected a key");
+
+        Member l_member;
+        if (!ParseString(l_member.first))
+          return false;
+
+        SkipSpace();
+        if (pos >= text.size() || text[pos] != ':')
+          return Fail("expected ':'");
+        pos++;
+
+        if (!ParseValue(l_member.second, depth + 1))
+          return false;
+        out.m_vMembers.push_back(std::move(l_member));
+
+        SkipSpace();
+        if (pos < text.size() && text[pos] == ',') {
+          pos++;
+          continue;
+        }
+        if (pos < text.size() && text[pos] == '}') {
+          pos++;
+          return true;
+        }
+        return Fail("expected ',' or '}'");
+      }
+    }
+
+    bool ParseArray(CJson &out, int depth) {
+      out.m_type = EType::Array;
+      pos++;
+
+      SkipSpace();
+      if (pos < text.size() && text[pos] == ']') {
+        pos++;
+        return true;
+      }
+
+      while (true) {
+        out.m_vArray.emplace_back();
+        if (!ParseValue(out.m_vArray.back(), depth + 1))
+          return false;
+
+        SkipSpace();
+        if (pos < text.size() && text[pos] == ',') {
+          pos++;
+          continue;
+        }
+        if (pos < text.size() && text[pos] == ']') {
+          pos++;
+          return true;
+        }
+        return Fail("expected ',' or ']'");
+      }
+    }
+
+    bool ParseNumber(CJson &out) {
+      const size_t start = pos;
+      while (pos < text.size() &&
+             (std::string_view("+-.eE0123456789").find(text[pos]) !=
+              std::string_view::npos))
+        pos++;
+
+      if (pos == start)
+        return Fail("unexpected character");
+
+      std::string l_sNumber(text.substr(start, pos - start));
+      char *end = nullptr;
+      out.m_type = EType::Number;
+      out.m_dValue = std::strtod(l_sNumber.c_str(), &end);
+      if (end != l_sNumber.c_str() + l_sNumber.size())
+        return Fail("bad number");
+      return true;
+    }
+
+    bool ParseHex4(uint32_t &code) {
+      if (pos + 4 > text.size())
+        return Fail("bad escape");
+      code = 0;
+      for (int i = 0; i < 4; i++) {
+        char c = text[pos++];
+        code <<= 4;
+        if (c >= '0' && c <= '9')
+          code |= static_cast<uint32_t>(c - '0');
+        else if (c >= 'a' && c <= 'f')
+          code |= static_cast<uint32_t>(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F')
+          code |= static_cast<uint32_t>(c - 'A' + 10);
+        else
+          return Fail("bad escape");
+      }
+      return true;
+    }
+
+    static void AppendUtf8(uint32_t code, std::string &out) {
+      auto put = [&out](uint32_t byte) { out += static_cast<char>(byte); };
+      if (code < 0x80) {
+        put(code);
+      } else if (code < 0x800) {
+        put(0xC0 | (code >> 6));
+        put(0x80 | (code & 0x3F));
+      } else if (code < 0x10000) {
+        put(0xE0 | (code >> 12));
+        put(0x80 | ((code >> 6) & 0x3F));
+        put(0x80 | (code & 0x3F));
+      } else {
+        put(0xF0 | (code >> 18));
+        put(0x80 | ((code >> 12) & 0x3F));
+        put(0x80 | ((code >> 6) & 0x3F));
+        put(0x80 | (code & 0x3F));
+      }
+    }
+
+    bool ParseString(std::string &out) {
+      pos++; // opening quote
+
+      while (pos < text.size()) {
+        char c = text[pos++];
+        if (c == '"')
+          return true;
+        if (c != '\\') {
+          out += c;
+          continue;
+        }
+
+        if (pos >= text.size())
+          break;
+
+        switch (text[pos++]) {
+        case '"':
+          out += '"';
+          break;
+        case '\\':
+          out += '\\';
+          break;
+        case '/':
+          out += '/';
+          break;
+        case 'b':
+          out += '\b';
+          break;
+        case 'f':
+          out += '\f';
+          break;
+        case 'n':
+          out += '\n';
+          break;
+        case 'r':
+          out += '\r';
+          break;
+        case 't':
+          out += '\t';
+          break;
+        case 'u': {
+          uint32_t code = 0;
+          if (!ParseHex4(code))
+            return false;
+
+          // surrogate pair
+          if (code >= 0xD800 && code < 0xDC00 && Consume("\\u")) {
+            uint32_t low = 0;
+            if (!ParseHex4(low))
+              return false;
+            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+          }
+          AppendUtf8(code, out);
+          break;
+        }
+        default:
+          return Fail("bad escape");
+        }
+      }
+      return Fail("unterminated string");
+    }
+  };
+};
@@ -0,0 +1,199 @@
+#pragma once
+
+#include "ImageDecoder.hpp"
+#include "MappedFile.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// the small part of KTX2 the texture cache needs: one 2D BC7 or BC5 image
+// with its whole mip chain, no supercompression and no key/value data.
+// other tools can open the files, the reader only takes what the writer
+// writes.
+inline constexpr uint8_t s_ktx2Identifier[12] = {
+    0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n'};
+
+// VkFormat values
+inline constexpr uint32_t s_uVkBC5Unorm = 141;
+inline constexpr uint32_t s_uVkBC7Unorm = 145;
+
+struct SKtx2Header {
+  uint8_t identifier[12];
+  uint32_t vkFormat;
+  uint32_t typeSize;
+  uint32_t pixelWidth;
+  uint32_t pixelHeight;
+  uint32_t pixelDepth;
+  uint32_t layerCount;
+  uint32_t faceCount;
+  uint32_t levelCount;
+  uint32_t supercompressionScheme;
+  uint32_t dfdByteOffset;
+  uint32_t dfdByteLength;
+  uint32_t kvdByteOffset;
+  uint32_t kvdByteLength;
+  uint64_t sgdByteOffset;
+  uint64_t sgdByteLength;
+};
+static_assert(sizeof(SKtx2Header) == 80);
+
+struct SKtx2Level {
+  uint64_t byteOffset;
+  uint64_t byteLength;
+  uint64_t uncompressedByteLength;
+};
+
+inline uint32_t GetKtx2VkFormat(ETextureFormat format) {
+  return format == ETextureFormat::BC5 ? s_uVkBC5Unorm : s_uVkBC7Unorm;
+}
+
+// the basic data format descriptor, 4x4 blocks of 16 bytes in linear
+// BT.709. BC7 is one sample over the block, BC5 a red and a green one.
+inline std::vector<uint32_t> MakeKtx2Descriptor(ETextureFormat format) {
+  const bool l_bBC5 = format == ETextureFormat::BC5;
+  const uint32_t l_uSamples = l_bBC5 ? 2 : 1;
+  const uint32_t l_uBlockSize = 24 + 16 * l_uSamples;
+
+  std::vector<uint32_t> dfd = {
+      4 + l_uBlockSize,         // total size
+      0,                        // khronos, basic descriptor
+      2 | (l_uBlockSize << 16), // version 2
+      (l_bBC5 ? 132u : 134u) | (1u << 8) | (1u << 16), // BT.709, linear
+      3 | (3 << 8),             // 4x4x1x1
+      16,                       // bytes in plane 0
+      0};
+  for (uint32_t sample = 0; sample < l_uSamples; sample++) {
+    const uint32_t l_uBits = l_bBC5 ? 64 : 128;
+    dfd.push_back((sample * l_uBits) | ((l_uBits - 1) << 16) | (sample << 24));
+    dfd.push_back(0);
+    dfd.push_back(0);
+    dfd.push_back(UINT32_MAX);
+  }
+  return dfd;
+}
+
+// the levels go smallest first, as the format wants, each on 16 bytes.
+// written to a temporary file first like a bake.
+inline bool SaveKtx2(const std::filesystem::path &path,
+                     const STextureImage &image) {
+  if (image.Empty() || image.format == ETextureFormat::RGBA8)
+    return false;
+
+  const std::vector<uint32_t> l_vuDfd = MakeKtx2Descriptor(image.format);
+  const uint32_t l_uLevels = image.GetLevelCount();
+
+  SKtx2Header l_header{};
+  std::memcpy(l_header.identifier, s_ktx2Identifier,
+              sizeof(s_ktx2Identifier));
+  l_header.vkFormat = GetKtx2VkFormat(image.format);
+  l_header.typeSize = 1;
+  l_header.pixelWidth = image.width;
+  l_header.pixelHeight = image.height;
+  l_header.faceCount = 1;
+  l_header.levelCount = l_uLevels;
+  l_header.dfdByteOffset = static_cast<uint32_t>(
+      sizeof(SKtx2Header) + sizeof(SKtx2Level) * l_uLevels);
+  l_header.dfdByteLength =
+      static_cast<uint32_t>(l_vuDfd.size() * sizeof(uint32_t));
+
+  std::vector<SKtx2Level> l_vLevels(l_uLevels);
+  uint64_t l_uOffset = l_header.dfdByteOffset + l_header.dfdByteLength;
+  for (uint32_t level = l_uLevels; level-- > 0;) {
+    l_uOffset = (l_uOffset + 15) & ~uint64_t(15);
+    l_vLevels[level] = {l_uOffset, image.GetLevelSize(level),
+                        image.GetLevelSize(level)};
+    l_uOffset += image.GetLevelSize(level);
+  }
+
+  std::error_code ec;
+  std::filesystem::create_directories(path.parent_path(), ec);
+
+  // the loader and the baker can write the same image at once
+  std::filesystem::path l_tmpPath = path;
+  l_tmpPath += ".tmp" + std::to_string(std::hash<std::thread::id>()(
+                            std::this_thread::get_id()));
+
+  FILE *out = std::fopen(l_tmpPath.c_str(), "wb");
+  if (!out)
+    return false;
+
+  bool ok = std::fwrite(&l_header, sizeof(l_header), 1, out) == 1;
+  ok = ok && std::fwrite(l_vLevels.data(), sizeof(SKtx2Level), l_uLevels,
+                         out) == l_uLevels;
+  ok = ok && std::fwrite(l_vuDfd.data(), sizeof(uint32_t), l_vuDfd.size(),
+                         out) == l_vuDfd.size();
+
+  uint64_t l_uWritten = l_header.dfdByteOffset + l_header.dfdByteLength;
+  const uint8_t l_zeros[16] = {};
+  for (uint32_t level = l_uLevels; ok && level-- > 0;) {
+    const size_t l_uPadding =
+        static_cast<size_t>(l_vLevels[level].byteOffset - l_uWritten);
+    ok = std::fwrite(l_zeros, 1, l_uPadding, out) == l_uPadding;
+    ok = ok && std::fwrite(image.GetLevelData(level), 1,
+                           image.GetLevelSize(level),
+                           out) == image.GetLevelSize(level);
+    l_uWritten = l_vLevels[level].byteOffset + image.GetLevelSize(level);
+  }
+  ok = (std::fclose(out) == 0) && ok;
+
+  if (ok)
+    std::filesystem::rename(l_tmpPath, path, ec);
+  if (!ok || ec) {
+    std::filesystem::remove(l_tmpPath, ec);
+    return false;
+  }
+  return true;
+}
+
+// false for anything that is not a complete BC7 or BC5 chain
+inline bool LoadKtx2(const std::filesystem::path &path, STextureImage &out) {
+  CMappedFile l_file;
+  if (!l_file.Open(path) || l_file.Size() < sizeof(SKtx2Header))
+    return false;
+
+  const auto *data = reinterpret_cast<const uint8_t *>(l_file.Data());
+  SKtx2Header l_header;
+  std::memcpy(&l_header, data, sizeof(l_header));
+
+  ETextureFormat l_format;
+  if (l_header.vkFormat == s_uVkBC7Unorm)
+    l_format = ETextureFormat::BC7;
+  else if (l_header.vkFormat == s_uVkBC5Unorm)
+    l_format = ETextureFormat::BC5;
+  else
+    return false;
+
+  std::string l_sError;
+  if (std::memcmp(l_header.identifier, s_ktx2Identifier,
+                  sizeof(s_ktx2Identifier)) ||
+      l_header.pixelDepth != 0 || l_header.layerCount != 0 ||
+      l_header.faceCount != 1 || l_header.supercompressionScheme != 0 ||
+      !CheckImageSize(l_header.pixelWidth, l_header.pixelHeight, l_sError) ||
+      l_header.levelCount != STextureImage::GetFullLevelCount(
+                                 l_header.pixelWidth, l_header.pixelHeight) ||
+      l_file.Size() <
+          sizeof(SKtx2Header) + sizeof(SKtx2Level) * l_header.levelCount)
+    return false;
+
+  out.Allocate(l_header.pixelWidth, l_header.pixelHeight, l_format);
+  for (uint32_t level = 0; level < l_header.levelCount; level++) {
+    SKtx2Level l_level;
+    std::memcpy(&l_level,
+                data + sizeof(SKtx2Header) + sizeof(SKtx2Level) * level,
+                sizeof(l_level));
+    if (l_level.byteLength != out.GetLevelSize(level) ||
+        l_level.byteOffset > l_file.Size() ||
+        l_level.byteLength > l_file.Size() - l_level.byteOffset) {
+      out = STextureImage{};
+      return false;
+    }
+    std::memcpy(out.pixels.data() + out.levels[level],
+                data + l_level.byteOffset, l_level.byteLength);
+  }
+  return true;
+}
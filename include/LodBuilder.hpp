@@ -0,0 +1,267 @@
+#pragma once
+
+#include "BakeCache.hpp"
+#include "GlbFile.hpp"
+#include "MaterialTextures.hpp"
+#include "Meshlets.hpp"
+#include "ModelBaker.hpp"
+#include <SDL3/SDL_log.h>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// one simplified level of a model, error is how far its surface is from the
+// full detail one in scene units. the meshlets and the images its
+// materials show are read on the builder thread, the render thread only
+// imports the file.
+struct SLodLevel {
+  std::string path;
+  float error = 0.0f;
+  uint64_t triangles = 0;
+  SModelMeshlets meshlets;
+  std::vector<MaterialImages> images;
+};
+
+struct SLodChain {
+  std::string path; // the source the chain was made for
+  std::vector<SLodLevel> levels; // coarser as the index grows
+};
+
+// picks the coarsest level whose error covers at most maxPixels of a
+// viewport viewportHeight pixels high at distance. errors are per level as in
+// SLodChain, 0 is the full detail model and i the level errors[i - 1].
+inline size_t SelectLod(const std::vector<float> &errors, float distance,
+                        float fovYDegrees, float viewportHeight,
+                        float maxPixels) {
+  const float l_fHalfFov = fovYDegrees * 0.5f * 3.14159265f / 180.0f;
+  const float l_fPixelsPerUnit =
+      viewportHeight * 0.5f / (std::max(distance, 1e-4f) * std::tan(l_fHalfFov));
+
+  size_t level = 0;
+  for (size_t i = 0; i < errors.size(); i++)
+    if (errors[i] * l_fPixelsPerUnit <= maxPixels)
+      level = i + 1;
+  return level;
+}
+
+// builds the LOD chain of a .glb on a thread of its own, the model is drawn
+// at full detail until the chain is ready. the levels halve the triangles
+// each and are stored in the bake cache as <hash>.lod<n>.glb, the list with
+// their errors as <hash>.lods, so a model's chain is built once.
+// like the loader only the newest request matters.
+class CLodBuilder {
+public:
+  static constexpr uint32_t s_uMaxLevels = 4;
+
+  explicit CLodBuilder(CBakeCache &bakeCache)
+      : m_bakeCache(bakeCache), m_thread([this] { Run(); }) {}
+
+  ~CLodBuilder() {
+    {
+      std::lock_guard<std::mutex> lock(m_mtx);
+      m_bStop = true;
+      m_uGeneration++;
+    }
+    m_cv.notify_one();
+    m_thread.join();
+  }
+
+  CLodBuilder(const CLodBuilder &) = delete;
+  CLodBuilder &operator=(const CLodBuilder &) = delete;
+
+  void Request(std::string path) {
+    {
+      std::lock_guard<std::mutex> lock(m_mtx);
+      m_sRequested = std::move(path);
+      m_uGeneration++;
+      m_bReady = false;
+    }
+    m_cv.notify_one();
+  }
+
+  bool TakeReady(SLodChain &chain) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (!m_bReady)
+      return false;
+
+    chain = std::move(m_ready);
+    m_bReady = false;
+    return true;
+  }
+
+  // a chain is being built or waits to be taken
+  bool IsBusy() const {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_uGeneration != m_uFinished || m_bReady;
+  }
+
+private:
+  CBakeCache &m_bakeCache;
+
+  mutable std::mutex m_mtx;
+  std::condition_variable m_cv;
+
+  std::string m_sRequested;
+  SLodChain m_ready;
+  uint64_t m_uGeneration = 0;
+  uint64_t m_uFinished = 0;
+  bool m_bReady = false;
+  bool m_bStop = false;
+
+  CModelBaker m_baker;
+  std::vector<char> m_vcChunk;
+  std::thread m_thread; // last, starts after everything above exists
+
+  bool IsCurrent(uint64_t generation) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return generation == m_uGeneration;
+  }
+
+  std::filesystem::path GetLevelPath(uint64_t hash, uint32_t level) const {
+    return m_bakeCache.GetBakedPath(hash,
+                                    ".lod" + std::to_string(level) + ".glb");
+  }
+
+  // parses the level while it is still in the page cache
+  static void ReadLevelExtras(SLodLevel &level) {
+    CGlbFile l_glb;
+    std::string l_sError;
+    if (!l_glb.Load(level.path, l_sError))
+      return;
+    LoadModelMeshlets(l_glb.json, l_glb.bin, level.meshlets);
+    level.images = ReadMaterialImages(l_glb.json, true);
+  }
+
+  // "<error> <triangles>" per level
+  static bool LoadChain(const std::filesystem::path &listPath,
+                        SLodChain &chain,
+                        const std::vector<std::filesystem::path> &levelPaths) {
+    std::ifstream in(listPath);
+    if (!in)
+      return false;
+
+    SLodLevel l_level;
+    while (in >> l_level.error >> l_level.triangles) {
+      if (chain.levels.size() >= levelPaths.size())
+        return false;
+      std::error_code ec;
+      l_level.path = levelPaths[chain.levels.size()].string();
+      if (!std::filesystem::is_regular_file(l_level.path, ec))
+        return false;
+      chain.levels.push_back(l_level);
+    }
+    return in.eof();
+  }
+
+  static bool SaveChain(const std::filesystem::path &listPath,
+                        const SLodChain &chain) {
+    std::filesystem::path l_tmpPath = listPath;
+    l_tmpPath += ".tmp";
+    {
+      std::ofstream out(l_tmpPath, std::ios::trunc);
+      for (const SLodLevel &level : chain.levels)
+        out << level.error << ' ' << level.triangles << '\n';
+      if (!out.flush())
+        return false;
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(l_tmpPath, listPath, ec);
+    return !ec;
+  }
+
+  // returns false if it was superseded before finishing
+  template <typename F> bool Build(SLodChain &chain, F &&keepGoing) {
+    if (std::filesystem::path(chain.path).extension() != ".glb")
+      return true; // nothing to simplify, the chain stays empty
+
+    uint64_t l_uHash = 0;
+    if (!m_bakeCache.LookupHash(chain.path, l_uHash)) {
+      if (!CBakeCache::HashFile(chain.path, m_vcChunk, l_uHash, keepGoing))
+        return keepGoing();
+      m_bakeCache.Remember(chain.path, l_uHash);
+    }
+
+    std::vector<std::filesystem::path> l_vLevelPaths;
+    for (uint32_t level = 1; level <= s_uMaxLevels; level++)
+      l_vLevelPaths.push_back(GetLevelPath(l_uHash, level));
+    const std::filesystem::path l_listPath =
+        m_bakeCache.GetBakedPath(l_uHash, ".lods");
+
+    if (LoadChain(l_listPath, chain, l_vLevelPaths))
+      return true;
+    chain.levels.clear();
+
+    std::error_code ec;
+    std::filesystem::create_directories(m_bakeCache.GetDir(), ec);
+
+    uint64_t l_uPrevious = 0;
+    for (uint32_t level = 1; level <= s_uMaxLevels; level++) {
+      if (!keepGoing())
+        return false;
+
+      const std::filesystem::path &target = l_vLevelPaths[level - 1];
+      std::string l_sError;
+      m_baker.SetSimplify(std::ldexp(1.0f, -int(level)));
+      if (!m_baker.Bake(chain.path, target, l_sError)) {
+        SDL_Log("no LOD %u for %s: %s", level, chain.path.c_str(),
+                l_sError.c_str());
+        break;
+      }
+
+      // borders and the error cap stop the simplifier at some point,
+      // another level that barely differs is not worth a model
+      const uint64_t l_uTriangles = m_baker.GetStatsAfter().triangles;
+      if (l_uPrevious == 0)
+        l_uPrevious = m_baker.GetStatsBefore().triangles;
+      if (l_uTriangles * 5 > l_uPrevious * 4) {
+        std::filesystem::remove(target, ec);
+        break;
+      }
+
+      SLodLevel &l_level = chain.levels.emplace_back();
+      l_level.path = target.string();
+      l_level.error = m_baker.GetSimplifyError();
+      l_level.triangles = l_uTriangles;
+      l_uPrevious = l_uTriangles;
+    }
+
+    if (!SaveChain(l_listPath, chain))
+      SDL_Log("could not write %s", l_listPath.string().c_str());
+    return true;
+  }
+
+  void Run() {
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    while (true) {
+      m_cv.wait(lock, [this] { return m_bStop || m_uGeneration != m_uFinished; });
+      if (m_bStop)
+        return;
+
+      const uint64_t generation = m_uGeneration;
+      SLodChain l_chain;
+      l_chain.path = m_sRequested;
+
+      lock.unlock();
+      bool current = Build(l_chain, [&] { return IsCurrent(generation); });
+      for (size_t i = 0; current && i < l_chain.levels.size(); i++) {
+        ReadLevelExtras(l_chain.levels[i]);
+        current = IsCurrent(generation);
+      }
+      lock.lock();
+
+      if (current && generation == m_uGeneration) {
+        m_ready = std::move(l_chain);
+        m_bReady = true;
+      }
+      m_uFinished = generation;
+    }
+  }
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// read only memory mapping of a whole file
+class CMappedFile {
+public:
+  CMappedFile() = default;
+  ~CMappedFile() { Close(); }
+
+  CMappedFile(const CMappedFile &) = delete;
+  CMappedFile &operator=(const CMappedFile &) = delete;
+
+  CMappedFile(CMappedFile &&other) noexcept { *this = std::move(other); }
+  CMappedFile &operator=(CMappedFile &&other) noexcept {
+    if (this != &other) {
+      Close();
+      m_pData = other.m_pData;
+      m_uSize = other.m_uSize;
+      other.m_pData = nullptr;
+      other.m_uSize = 0;
+    }
+    return *this;
+  }
+
+  bool Open(const std::filesystem::path &path) {
+    Close();
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      return false;
+
+    struct stat l_stat {};
+    if (::fstat(fd, &l_stat) != 0 || l_stat.st_size <= 0) {
+      ::close(fd);
+      return false;
+    }
+
+    size_t l_uSize = static_cast<size_t>(l_stat.st_size);
+    void *l_pData = ::mmap(nullptr, l_uSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps its own reference
+
+    if (l_pData == MAP_FAILED)
+      return false;
+
+    m_pData = static_cast<const std::byte *>(l_pData);
+    m_uSize = l_uSize;
+    return true;
+  }
+
+  void Close() {
+    if (m_pData)
+      ::munmap(const_cast<std::byte *>(m_pData), m_uSize);
+    m_pData = nullptr;
+    m_uSize = 0;
+  }
+
+  bool IsOpen() const { return m_pData != nullptr; }
+  const std::byte *Data() const { return m_pData; }
+  size_t Size() const { return m_uSize; }
+
+private:
+  const std::byte *m_pData = nullptr;
+  size_t m_uSize = 0;
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "MaterialTextures.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// one entry of the material SSBO, Material in assets/shader.frag. a bindless
+// sampler is its 64 bit handle.
+struct SGpuMaterial {
+  uint64_t textures[s_materialSlots.size()]; // albedo, prm, normalMap, emission
+  float luminance;
+  uint32_t padding;
+};
+static_assert(sizeof(SGpuMaterial) == 40);
+
+// the viewer's copy of the materials the material manager submits, with the
+// textures the viewer made itself patched in over the importer's. the SSBO
+// is allocated once for s_uCapacity materials, importing a model appends
+// its materials to the list. the materials changed since the last upload
+// are tracked, a frame that changes none uploads nothing.
+class CMaterialTable {
+public:
+  static constexpr uint32_t s_uCapacity = 4096;
+
+  CMaterialTable() : m_vMaterials(s_uCapacity) {}
+
+  // T is the material manager's PBRMaterial, the same bytes as SGpuMaterial
+  template <typename T> void Sync(const std::vector<T> &materials) {
+    static_assert(sizeof(T) == sizeof(SGpuMaterial),
+                  "the material no longer matches Material in shader.frag");
+
+    m_vSubmitted.resize(std::min<size_t>(materials.size(), s_uCapacity));
+    std::memcpy(m_vSubmitted.data(), materials.data(),
+                m_vSubmitted.size() * sizeof(SGpuMaterial));
+    std::copy(m_vSubmitted.begin(), m_vSubmitted.end(), m_vMaterials.begin());
+
+    for (const auto &[material, handles] : m_mapOverrides)
+      Apply(material);
+    m_uDirtyEnd = GetCount(); // entries can have moved or gone
+  }
+
+  uint32_t GetCount() const {
+    return static_cast<uint32_t>(m_vSubmitted.size());
+  }
+
+  // handle 0 gives the slot back to the importer's texture
+  void SetTexture(uint32_t material, size_t slot, uint64_t handle) {
+    m_mapOverrides[material][slot] = handle;
+    Apply(material);
+  }
+
+  void ClearTextures(uint32_t material) {
+    m_mapOverrides.erase(material);
+    if (material < m_vSubmitted.size()) {
+      m_vMaterials[material] = m_vSubmitted[material];
+      MarkDirty(material);
+    }
+  }
+
+  // the whole capacity, for allocating the SSBO
+  const SGpuMaterial *GetData() const { return m_vMaterials.data(); }
+  size_t GetCapacityBytes() const { return s_uCapacity * sizeof(SGpuMaterial); }
+
+  // the part in use, for updating it
+  size_t GetBytes() const { return m_vSubmitted.size() * sizeof(SGpuMaterial); }
+
+  // the bytes from the start of the data up to the last material changed
+  // since the previous call, 0 if none did. dynamic data is written from
+  // the start of its range, so the dirty part is a prefix.
+  size_t TakeDirtyBytes() {
+    const size_t l_uBytes = size_t(m_uDirtyEnd) * sizeof(SGpuMaterial);
+    m_uDirtyEnd = 0;
+    return l_uBytes;
+  }
+
+private:
+  std::vector<SGpuMaterial> m_vMaterials; // s_uCapacity entries
+  std::vector<SGpuMaterial> m_vSubmitted; // as the material manager has them
+  std::unordered_map<uint32_t, std::array<uint64_t, s_materialSlots.size()>>
+      m_mapOverrides;
+  uint32_t m_uDirtyEnd = 0; // one past the last changed material
+
+  void MarkDirty(uint32_t material) {
+    m_uDirtyEnd = std::max(m_uDirtyEnd, material + 1);
+  }
+
+  void Apply(uint32_t material) {
+    if (material >= m_vSubmitted.size())
+      return;
+
+    m_vMaterials[material] = m_vSubmitted[material];
+    const auto &handles = m_mapOverrides[material];
+    for (size_t slot = 0; slot < handles.size(); slot++)
+      if (handles[slot])
+        m_vMaterials[material].textures[slot] = handles[slot];
+    MarkDirty(material);
+  }
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "Json.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// the textures of Material in assets/shader.frag, in its order, and where a
+// glTF material keeps each of them
+struct SMaterialSlot {
+  std::string_view name;
+  std::string_view parent; // empty if the textureInfo is on the material
+  std::string_view key;
+};
+
+inline constexpr std::array<SMaterialSlot, 4> s_materialSlots = {{
+    {"albedo", "pbrMetallicRoughness", "baseColorTexture"},
+    {"prm", "pbrMetallicRoughness", "metallicRoughnessTexture"},
+    {"normalMap", "", "normalTexture"},
+    {"emission", "", "emissiveTexture"},
+}};
+
+// baked materials point their slots at a 1x1 stand-in so the importer has
+// nothing to decode, this extension keeps the texture index of each slot
+// for the viewer
+inline constexpr std::string_view s_deferredTexturesExt =
+    "EHAZ_deferred_textures";
+
+// the slot's textureInfo, null if the material has none
+inline const CJson *FindSlotTexture(const CJson &material,
+                                    const SMaterialSlot &slot) {
+  const CJson *parent =
+      slot.parent.empty() ? &material : material.Find(slot.parent);
+  return parent ? parent->Find(slot.key) : nullptr;
+}
+
+inline CJson *FindSlotTexture(CJson &material, const SMaterialSlot &slot) {
+  return const_cast<CJson *>(
+      FindSlotTexture(static_cast<const CJson &>(material), slot));
+}
+
+// image index per slot, -1 leaves the slot to the importer's texture
+using MaterialImages = std::array<int32_t, s_materialSlots.size()>;
+
+// which image each material shows in each slot, one entry per glTF
+// material. deferredOnly reads what the baker deferred, otherwise the
+// material's own textures.
+inline std::vector<MaterialImages> ReadMaterialImages(const CJson &json,
+                                                      bool deferredOnly) {
+  std::vector<MaterialImages> l_vImages;
+  const CJson *materials = json.Find("materials");
+  const CJson *textures = json.Find("textures");
+  const CJson *images = json.Find("images");
+  if (!materials || !textures || !images)
+    return l_vImages;
+
+  auto l_imageOf = [&](const CJson *texture) -> int32_t {
+    const int64_t index = texture ? texture->AsInt() : -1;
+    if (index < 0 || static_cast<size_t>(index) >= textures->Size())
+      return -1;
+    const CJson *source =
+        textures->GetArray()[static_cast<size_t>(index)].Find("source");
+    const int64_t image = source ? source->AsInt() : -1;
+    return image >= 0 && static_cast<size_t>(image) < images->Size()
+               ? static_cast<int32_t>(image)
+               : -1;
+  };
+
+  bool l_bAny = false;
+  for (const CJson &material : materials->GetArray()) {
+    MaterialImages &slots = l_vImages.emplace_back();
+    slots.fill(-1);
+
+    const CJson *extensions = material.Find("extensions");
+    const CJson *deferred =
+        extensions ? extensions->Find(s_deferredTexturesExt) : nullptr;
+
+    for (size_t s = 0; s < s_materialSlots.size(); s++) {
+      if (deferredOnly) {
+        slots[s] = deferred ? l_imageOf(deferred->Find(s_materialSlots[s].name))
+                            : -1;
+      } else if (const CJson *info =
+                     FindSlotTexture(material, s_materialSlots[s])) {
+        slots[s] = l_imageOf(info->Find("index"));
+      }
+      l_bAny = l_bAny || slots[s] >= 0;
+    }
+  }
+
+  if (!l_bAny)
+    l_vImages.clear();
+  return l_vImages;
+}
@@ -0,0 +1,435 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+// index/vertex reordering for triangle lists, run by the baker. every pass
+// keeps the exact same triangles, only the order changes.
+
+// post transform cache statistics of a FIFO cache, what most GPUs behave like.
+// ACMR = misses per triangle (0.5 is the best a regular grid gets, 3 is no
+// reuse at all), ATVR = misses per referenced vertex (1.0 is optimal).
+struct SVertexCacheStats {
+  uint64_t triangles = 0;
+  uint64_t vertices = 0; // distinct vertices referenced
+  uint64_t misses = 0;
+
+  double GetACMR() const {
+    return triangles ? double(misses) / double(triangles) : 0.0;
+  }
+  double GetATVR() const {
+    return vertices ? double(misses) / double(vertices) : 0.0;
+  }
+
+  SVertexCacheStats &operator+=(const SVertexCacheStats &other) {
+    triangles += other.triangles;
+    vertices += other.vertices;
+    misses += other.misses;
+    return *this;
+  }
+};
+
+inline SVertexCacheStats AnalyzeVertexCache(const std::vector<uint32_t> &indices,
+                                            uint32_t vertexCount,
+                                            uint32_t cacheSize = 16) {
+  SVertexCacheStats stats;
+  stats.triangles = indices.size() / 3;
+
+  // a vertex is cached if it missed less than cacheSize misses ago
+  std::vector<uint32_t> l_vuMissTime(vertexCount, 0);
+  uint32_t l_uTime = cacheSize + 1;
+
+  for (uint32_t index : indices) {
+    if (l_vuMissTime[index] == 0)
+      stats.vertices++;
+    if (l_uTime - l_vuMissTime[index] > cacheSize) {
+      l_vuMissTime[index] = l_uTime++;
+      stats.misses++;
+    }
+  }
+  return stats;
+}
+
+// exporters often write every triangle with its own three vertices, which
+// leaves the cache nothing to reuse. vertices whose bytes are identical in
+// every stream are merged, remap[old] = new and new ids are dense in first
+// seen order. returns the number of unique vertices.
+inline uint32_t WeldVertices(const std::vector<const uint8_t *> &streams,
+                             const std::vector<uint32_t> &elementSizes,
+                             uint32_t vertexCount,
+                             std::vector<uint32_t> &remap) {
+  auto l_hash = [&](uint32_t v) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t s = 0; s < streams.size(); s++) {
+      const uint8_t *element = streams[s] + size_t(v) * elementSizes[s];
+      for (uint32_t i = 0; i < elementSizes[s]; i++) {
+        hash ^= element[i];
+        hash *= 1099511628211ull;
+      }
+    }
+    return hash;
+  };
+  auto l_equal = [&](uint32_t a, uint32_t b) {
+    for (size_t s = 0; s < streams.size(); s++)
+      if (std::memcmp(streams[s] + size_t(a) * elementSizes[s],
+                      streams[s] + size_t(b) * elementSizes[s],
+                      elementSizes[s]) != 0)
+        return false;
+    return true;
+  };
+
+  // open addressing over vertex ids, the table never holds more than half
+  size_t l_uCapacity = 16;
+  while (l_uCapacity < size_t(vertexCount) * 2)
+    l_uCapacity *= 2;
+  std::vector<uint32_t> l_vuTable(l_uCapacity, UINT32_MAX);
+
+  remap.assign(vertexCount, 0);
+  uint32_t l_uUnique = 0;
+
+  for (uint32_t v = 0; v < vertexCount; v++) {
+    size_t slot = static_cast<size_t>(l_hash(v)) & (l_uCapacity - 1);
+    while (l_vuTable[slot] != UINT32_MAX && !l_equal(l_vuTable[slot], v))
+      slot = (slot + 1) & (l_uCapacity - 1);
+
+    if (l_vuTable[slot] == UINT32_MAX) {
+      l_vuTable[slot] = v;
+      remap[v] = l_uUnique++;
+    } else {
+      remap[v] = remap[l_vuTable[slot]];
+    }
+  }
+  return l_uUnique;
+}
+
+// Tom Forsyth's linear-speed vertex cache optimisation: triangles are emitted
+// greedily by the score of their vertices, which favours vertices that were
+// used recently and vertices with few triangles left.
+inline void OptimizeVertexCache(std::vector<uint32_t> &indices,
+                                uint32_t vertexCount) {
+  static constexpr uint32_t s_uCacheSize = 32;
+  static constexpr uint32_t s_uMaxValence = 64;
+
+  const size_t l_uTriangles = indices.size() / 3;
+  if (l_uTriangles < 2)
+    return;
+
+  // score tables, index = position in the LRU / remaining triangles
+  static const auto s_cacheScores = [] {
+    std::vector<float> scores(s_uCacheSize + 3);
+    for (uint32_t i = 0; i < scores.size(); i++) {
+      if (i < 3)
+        scores[i] = 0.75f;
+      else if (i < s_uCacheSize)
+        scores[i] = std::pow(
+            1.0f - float(i - 3) / float(s_uCacheSize - 3), 1.5f);
+      else
+        scores[i] = 0.0f;
+    }
+    return scores;
+  }();
+  static const auto s_valenceScores = [] {
+    std::vector<float> scores(s_uMaxValence + 1, 0.0f);
+    for (uint32_t i = 1; i <= s_uMaxValence; i++)
+      scores[i] = 2.0f / std::sqrt(float(i));
+    return scores;
+  }();
+
+  // triangles per vertex, packed
+  std::vector<uint32_t> l_vuLive(vertexCount, 0);
+  for (uint32_t index : indices)
+    l_vuLive[index]++;
+
+  std::vector<uint32_t> l_vuOffsets(vertexCount + 1, 0);
+  for (uint32_t v = 0; v < vertexCount; v++)
+    l_vuOffsets[v + 1] = l_vuOffsets[v] + l_vuLive[v];
+
+  std::vector<uint32_t> l_vuAdjacency(indices.size());
+  {
+    std::vector<uint32_t> l_vuFill(l_vuOffsets.begin(), l_vuOffsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++)
+      l_vuAdjacency[l_vuFill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+  }
+
+  std::vector<int32_t> l_viCachePos(vertexCount, -1);
+  auto l_vertexScore = [&](uint32_t v) {
+    const uint32_t live = l_vuLive[v];
+    if (live == 0)
+      return -1.0f;
+    const float cache =
+        l_viCachePos[v] >= 0 ? s_cacheScores[size_t(l_viCachePos[v])] : 0.0f;
+    return cache + s_valenceScores[std::min(live, s_uMaxValence)];
+  };
+
+  std::vector<float> l_vfVertexScore(vertexCount);
+  for (uint32_t v = 0; v < vertexCount; v++)
+    l_vfVertexScore[v] = l_vertexScore(v);
+
+  std::vector<float> l_vfTriScore(l_uTriangles);
+  for (size_t t = 0; t < l_uTriangles; t++)
+    l_vfTriScore[t] = l_vfVertexScore[indices[t * 3]] +
+                      l_vfVertexScore[indices[t * 3 + 1]] +
+                      l_vfVertexScore[indices[t * 3 + 2]];
+
+  std::vector<bool> l_vbEmitted(l_uTriangles, false);
+  std::vector<uint32_t> l_vuCache, l_vuNewCache;
+  l_vuCache.reserve(s_uCacheSize + 3);
+  l_vuNewCache.reserve(s_uCacheSize + 3);
+
+  std::vector<uint32_t> l_vuResult;
+  l_vuResult.reserve(indices.size());
+
+  size_t l_uBest = static_cast<size_t>(
+      std::max_element(l_vfTriScore.begin(), l_vfTriScore.end()) -
+      l_vfTriScore.begin());
+  size_t l_uCursor = 0; // fallback when nothing in the cache has triangles
+
+  while (true) {
+    const uint32_t *tri = &indices[l_uBest * 3];
+    l_vuResult.insert(l_vuResult.end(), tri, tri + 3);
+    l_vbEmitted[l_uBest] = true;
+
+    // the triangle is no longer live for its vertices
+    for (int k = 0; k < 3; k++) {
+      const uint32_t v = tri[k];
+      uint32_t *begin = &l_vuAdjacency[l_vuOffsets[v]];
+      uint32_t *end = begin + l_vuLive[v];
+      uint32_t *found = std::find(begin, end, static_cast<uint32_t>(l_uBest));
+      *found = *(end - 1);
+      l_vuLive[v]--;
+    }
+
+    // LRU: the triangle's vertices move to the front
+    l_vuNewCache.assign(tri, tri + 3);
+    for (uint32_t v : l_vuCache)
+      if (v != tri[0] && v != tri[1] && v != tri[2])
+        l_vuNewCache.push_back(v);
+
+    for (size_t i = 0; i < l_vuNewCache.size(); i++)
+      l_viCachePos[l_vuNewCache[i]] =
+          i < s_uCacheSize ? static_cast<int32_t>(i) : -1;
+
+    // rescore everything that was touched, including what fell out
+    float l_fBestScore = -1.0f;
+    size_t l_uNext = SIZE_MAX;
+    for (uint32_t v : l_vuNewCache) {
+      const float score = l_vertexScore(v);
+      const float delta = score - l_vfVertexScore[v];
+      l_vfVertexScore[v] = score;
+
+      for (uint32_t i = 0; i < l_vuLive[v]; i++) {
+        const uint32_t t = l_vuAdjacency[l_vuOffsets[v] + i];
+        l_vfTriScore[t] += delta;
+        if (l_vfTriScore[t] > l_fBestScore) {
+          l_fBestScore = l_vfTriScore[t];
+          l_uNext = t;
+        }
+      }
+    }
+
+    if (l_vuNewCache.size() > s_uCacheSize)
+      l_vuNewCache.resize(s_uCacheSize);
+    l_vuCache.swap(l_vuNewCache);
+
+    if (l_uNext == SIZE_MAX) {
+      while (l_uCursor < l_uTriangles && l_vbEmitted[l_uCursor])
+        l_uCursor++;
+      if (l_uCursor == l_uTriangles)
+        break;
+      l_uNext = l_uCursor;
+    }
+    l_uBest = l_uNext;
+  }
+
+  indices.swap(l_vuResult);
+}
+
+// Sander et al. "Fast Triangle Reordering for Vertex Locality and Reduced
+// Overdraw": the cache optimised order is cut into clusters where the cache
+// has to start over anyway (plus where cutting costs little), then the
+// clusters are sorted so the ones facing out of the mesh are drawn first.
+// threshold is how much ACMR may get worse, 1.05 = 5%.
+inline void OptimizeOverdraw(std::vector<uint32_t> &indices,
+                             const float *positions, size_t positionStride,
+                             uint32_t vertexCount, float threshold = 1.05f) {
+  static constexpr uint32_t s_uCacheSize = 16;
+
+  const size_t l_uTriangles = indices.size() / 3;
+  if (l_uTriangles < 2 || !positions)
+    return;
+
+  auto l_position = [&](uint32_t v) {
+    return positions + size_t(v) * positionStride;
+  };
+
+  // cluster starts, in triangles
+  std::vector<uint32_t> l_vuClusters;
+  {
+    std::vector<uint32_t> l_vuMissTime(vertexCount, 0);
+    uint32_t l_uTime = s_uCacheSize + 1;
+    auto l_misses = [&](size_t t) {
+      uint32_t misses = 0;
+      for (int k = 0; k < 3; k++) {
+        const uint32_t v = indices[t * 3 + size_t(k)];
+        if (l_uTime - l_vuMissTime[v] > s_uCacheSize) {
+          l_vuMissTime[v] = l_uTime++;
+          misses++;
+        }
+      }
+      return misses;
+    };
+
+    // hard boundaries: a triangle that misses on all three vertices
+    std::vector<uint32_t> l_vuHard;
+    for (size_t t = 0; t < l_uTriangles; t++)
+      if (l_misses(t) == 3)
+        l_vuHard.push_back(static_cast<uint32_t>(t));
+    l_vuHard.push_back(static_cast<uint32_t>(l_uTriangles));
+    if (l_vuHard[0] != 0)
+      l_vuHard.insert(l_vuHard.begin(), 0);
+
+    // soft boundaries: inside a hard cluster, cut wherever the cache run so
+    // far is already within threshold of the whole cluster
+    for (size_t h = 0; h + 1 < l_vuHard.size(); h++) {
+      const uint32_t start = l_vuHard[h];
+      const uint32_t end = l_vuHard[h + 1];
+
+      l_uTime += s_uCacheSize + 1; // flush
+      uint32_t l_uClusterMisses = 0;
+      for (uint32_t t = start; t < end; t++)
+        l_uClusterMisses += l_misses(t);
+      const float l_fTarget =
+          threshold * float(l_uClusterMisses) / float(end - start);
+
+      l_vuClusters.push_back(start);
+      l_uTime += s_uCacheSize + 1;
+      uint32_t l_uRunStart = start, l_uRunMisses = 0;
+      for (uint32_t t = start; t < end; t++) {
+        l_uRunMisses += l_misses(t);
+        const uint32_t l_uRunLength = t + 1 - l_uRunStart;
+        if (t + 1 < end && l_uRunLength >= 8 &&
+            float(l_uRunMisses) / float(l_uRunLength) <= l_fTarget) {
+          l_vuClusters.push_back(t + 1);
+          l_uRunStart = t + 1;
+          l_uRunMisses = 0;
+          l_uTime += s_uCacheSize + 1;
+        }
+      }
+    }
+    l_vuClusters.push_back(static_cast<uint32_t>(l_uTriangles));
+  }
+
+  const size_t l_uClusterCount = l_vuClusters.size() - 1;
+  if (l_uClusterCount < 2)
+    return;
+
+  // area weighted centroid of the whole mesh
+  double l_adMesh[3] = {0, 0, 0};
+  double l_dMeshArea = 0;
+  std::vector<float> l_vfSortKey(l_uClusterCount);
+  std::vector<double> l_vdCluster(l_uClusterCount * 7, 0.0);
+
+  for (size_t c = 0; c < l_uClusterCount; c++) {
+    double *cluster = &l_vdCluster[c * 7]; // centroid, normal, area
+    for (uint32_t t = l_vuClusters[c]; t < l_vuClusters[c + 1]; t++) {
+      const float *a = l_position(indices[size_t(t) * 3]);
+      const float *b = l_position(indices[size_t(t) * 3 + 1]);
+      const float *p = l_position(indices[size_t(t) * 3 + 2]);
+
+      const double e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+      const double e2[3] = {p[0] - a[0], p[1] - a[1], p[2] - a[2]};
+      const double n[3] = {e1[1] * e2[2] - e1[2] * e2[1],
+                           e1[2] * e2[0] - e1[0] * e2[2],
+                           e1[0] * e2[1] - e1[1] * e2[0]};
+      const double area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+      for (int k = 0; k < 3; k++) {
+        const double centre =
+            (double(a[k]) + double(b[k]) + double(p[k])) / 3.0;
+        cluster[k] += centre * area;
+        cluster[3 + k] += n[k];
+      }
+      cluster[6] += area;
+    }
+
+    for (int k = 0; k < 3; k++)
+      l_adMesh[k] += cluster[k];
+    l_dMeshArea += cluster[6];
+  }
+
+  if (l_dMeshArea <= 0)
+    return;
+  for (double &axis : l_adMesh)
+    axis /= l_dMeshArea;
+
+  for (size_t c = 0; c < l_uClusterCount; c++) {
+    const double *cluster = &l_vdCluster[c * 7];
+    const double area = cluster[6] > 0 ? cluster[6] : 1.0;
+    const double length =
+        std::sqrt(cluster[3] * cluster[3] + cluster[4] * cluster[4] +
+                  cluster[5] * cluster[5]);
+
+    double dot = 0;
+    for (int k = 0; k < 3; k++)
+      dot += (cluster[k] / area - l_adMesh[k]) *
+             (length > 0 ? cluster[3 + k] / length : 0.0);
+    l_vfSortKey[c] = static_cast<float>(dot);
+  }
+
+  // outward facing clusters first, they occlude the rest
+  std::vector<uint32_t> l_vuOrder(l_uClusterCount);
+  std::iota(l_vuOrder.begin(), l_vuOrder.end(), 0u);
+  std::stable_sort(l_vuOrder.begin(), l_vuOrder.end(),
+                   [&](uint32_t a, uint32_t b) {
+                     return l_vfSortKey[a] > l_vfSortKey[b];
+                   });
+
+  std::vector<uint32_t> l_vuResult;
+  l_vuResult.reserve(indices.size());
+  for (uint32_t c : l_vuOrder)
+    l_vuResult.insert(l_vuResult.end(),
+                      indices.begin() + ptrdiff_t(l_vuClusters[c]) * 3,
+                      indices.begin() + ptrdiff_t(l_vuClusters[c + 1]) * 3);
+  indices.swap(l_vuResult);
+}
+
+// vertices in the order the index lists first use them, so fetches walk the
+// vertex buffer forwards. several index lists can share the vertices, the
+// remap covers all of them. vertices nothing uses end up at the back.
+// returns remap[old] = new.
+inline std::vector<uint32_t>
+OptimizeVertexFetch(std::vector<std::vector<uint32_t> *> &indexLists,
+                    uint32_t vertexCount) {
+  std::vector<uint32_t> l_vuRemap(vertexCount, UINT32_MAX);
+  uint32_t l_uNext = 0;
+
+  for (std::vector<uint32_t> *indices : indexLists)
+    for (uint32_t &index : *indices) {
+      if (l_vuRemap[index] == UINT32_MAX)
+        l_vuRemap[index] = l_uNext++;
+      index = l_vuRemap[index];
+    }
+
+  for (uint32_t &slot : l_vuRemap)
+    if (slot == UINT32_MAX)
+      slot = l_uNext++;
+
+  return l_vuRemap;
+}
+
+// applies a remap from WeldVertices or OptimizeVertexFetch to tightly packed
+// vertex data, newCount is the number of vertices after the remap
+inline void RemapVertices(std::vector<uint8_t> &data, uint32_t elementSize,
+                          const std::vector<uint32_t> &remap,
+                          uint32_t newCount) {
+  std::vector<uint8_t> l_vuResult(size_t(newCount) * elementSize);
+  for (size_t v = 0; v < remap.size(); v++)
+    std::memcpy(l_vuResult.data() + size_t(remap[v]) * elementSize,
+                data.data() + v * elementSize, elementSize);
+  data.swap(l_vuResult);
+}
@@ -0,0 +1,402 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// triangle list simplification for the LOD chain. edges are collapsed into
+// one of their end points, so no vertex ever moves and attributes never have
+// to be interpolated. a position can have several vertices (wedges) with
+// different normals or uvs, they all go along, each into the closest wedge
+// on the other end. the cost of a collapse is the Garland-Heckbert quadric
+// error of the removed position at its new place plus the largest attribute
+// difference of a wedge and where it went, so seams move only where that is
+// cheap.
+// positions on an open border or a non manifold edge never go away, which
+// keeps the silhouette of open meshes.
+
+// plane quadric, area weighted so the error stays a distance
+struct SQuadric {
+  double a00 = 0, a11 = 0, a22 = 0, a01 = 0, a02 = 0, a12 = 0;
+  double b0 = 0, b1 = 0, b2 = 0, c = 0;
+  double weight = 0;
+
+  static SQuadric FromPlane(double nx, double ny, double nz, double d,
+                            double weight) {
+    SQuadric q;
+    q.a00 = weight * nx * nx;
+    q.a11 = weight * ny * ny;
+    q.a22 = weight * nz * nz;
+    q.a01 = weight * nx * ny;
+    q.a02 = weight * nx * nz;
+    q.a12 = weight * ny * nz;
+    q.b0 = weight * nx * d;
+    q.b1 = weight * ny * d;
+    q.b2 = weight * nz * d;
+    q.c = weight * d * d;
+    q.weight = weight;
+    return q;
+  }
+
+  SQuadric &operator+=(const SQuadric &other) {
+    a00 += other.a00;
+    a11 += other.a11;
+    a22 += other.a22;
+    a01 += other.a01;
+    a02 += other.a02;
+    a12 += other.a12;
+    b0 += other.b0;
+    b1 += other.b1;
+    b2 += other.b2;
+    c += other.c;
+    weight += other.weight;
+    return *this;
+  }
+
+  // mean squared distance of p to the accumulated planes
+  double Evaluate(const float *p) const {
+    const double x = p[0], y = p[1], z = p[2];
+    const double sum = a00 * x * x + a11 * y * y + a22 * z * z +
+                       2 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                       2 * (b0 * x + b1 * y + b2 * z) + c;
+    return weight > 0 ? std::abs(sum) / weight : 0.0;
+  }
+};
+
+// reduces indices to about targetIndexCount, stopping early where a collapse
+// would cost more than maxError. positions are xyz, attributes are
+// attributeCount floats per vertex (or null), scaled so a difference of 1
+// matters as much as a distance of attributeScale. returns the largest error
+// of a collapse that was made, in position units.
+inline float SimplifyMesh(std::vector<uint32_t> &indices,
+                          const float *positions, const float *attributes,
+                          uint32_t attributeCount, float attributeScale,
+                          uint32_t vertexCount, size_t targetIndexCount,
+                          float maxError) {
+  if (indices.size() <= targetIndexCount || vertexCount == 0)
+    return 0.0f;
+
+  // vertices sharing a position are one corner of the surface
+  std::vector<uint32_t> l_vuPosition(vertexCount);
+  {
+    std::unordered_map<uint64_t, uint32_t> l_mapFirst;
+    l_mapFirst.reserve(vertexCount);
+    for (uint32_t v = 0; v < vertexCount; v++) {
+      uint32_t bits[3];
+      std::memcpy(bits, positions + size_t(v) * 3, sizeof(bits));
+      uint64_t hash = 14695981039346656037ull;
+      for (uint32_t word : bits) {
+        hash ^= word;
+        hash *= 1099511628211ull;
+      }
+
+      // collisions fall back to a linear probe on the key
+      while (true) {
+        auto [found, inserted] = l_mapFirst.try_emplace(hash, v);
+        if (inserted ||
+            std::memcmp(positions + size_t(found->second) * 3,
+                        positions + size_t(v) * 3, sizeof(bits)) == 0) {
+          l_vuPosition[v] = found->second;
+          break;
+        }
+        hash++;
+      }
+    }
+  }
+
+  // the wedges of every position, the vertices that share it
+  std::vector<uint32_t> l_vuWedgeOffsets(size_t(vertexCount) + 1, 0);
+  std::vector<uint32_t> l_vuWedges;
+  {
+    std::vector<bool> l_vbUsed(vertexCount, false);
+    for (uint32_t index : indices)
+      if (!l_vbUsed[index]) {
+        l_vbUsed[index] = true;
+        l_vuWedgeOffsets[l_vuPosition[index] + 1]++;
+      }
+    for (uint32_t p = 0; p < vertexCount; p++)
+      l_vuWedgeOffsets[p + 1] += l_vuWedgeOffsets[p];
+
+    l_vuWedges.resize(l_vuWedgeOffsets[vertexCount]);
+    std::vector<uint32_t> l_vuFill(l_vuWedgeOffsets.begin(),
+                                   l_vuWedgeOffsets.end() - 1);
+    for (uint32_t v = 0; v < vertexCount; v++)
+      if (l_vbUsed[v])
+        l_vuWedges[l_vuFill[l_vuPosition[v]]++] = v;
+  }
+
+  // every undirected edge of a closed manifold is used exactly twice
+  std::vector<bool> l_vbLocked(vertexCount, false);
+  {
+    std::unordered_map<uint64_t, uint32_t> l_mapEdges;
+    l_mapEdges.reserve(indices.size());
+    for (size_t t = 0; t + 2 < indices.size(); t += 3)
+      for (size_t k = 0; k < 3; k++) {
+        uint32_t a = l_vuPosition[indices[t + k]];
+        uint32_t b = l_vuPosition[indices[t + (k + 1) % 3]];
+        if (a > b)
+          std::swap(a, b);
+        l_mapEdges[(uint64_t(a) << 32) | b]++;
+      }
+    for (const auto &[edge, count] : l_mapEdges)
+      if (count != 2) {
+        l_vbLocked[uint32_t(edge >> 32)] = true;
+        l_vbLocked[uint32_t(edge & 0xffffffffu)] = true;
+      }
+  }
+
+  auto l_position = [&](uint32_t v) { return positions + size_t(v) * 3; };
+  auto l_normal = [&](uint32_t a, uint32_t b, uint32_t c, double out[3]) {
+    const float *p0 = l_position(a), *p1 = l_position(b), *p2 = l_position(c);
+    double e0[3], e1[3];
+    for (size_t i = 0; i < 3; i++) {
+      e0[i] = double(p1[i]) - double(p0[i]);
+      e1[i] = double(p2[i]) - double(p0[i]);
+    }
+    out[0] = e0[1] * e1[2] - e0[2] * e1[1];
+    out[1] = e0[2] * e1[0] - e0[0] * e1[2];
+    out[2] = e0[0] * e1[1] - e0[1] * e1[0];
+  };
+
+  // quadrics live on positions, every wedge sees the same surface
+  std::vector<SQuadric> l_vQuadrics(vertexCount);
+  for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+    double n[3];
+    l_normal(indices[t], indices[t + 1], indices[t + 2], n);
+    const double l_dLength = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (l_dLength <= 0)
+      continue;
+
+    for (double &component : n)
+      component /= l_dLength;
+    const float *p = l_position(indices[t]);
+    const double d =
+        -(n[0] * double(p[0]) + n[1] * double(p[1]) + n[2] * double(p[2]));
+    const SQuadric q = SQuadric::FromPlane(n[0], n[1], n[2], d, l_dLength * 0.5);
+    for (size_t k = 0; k < 3; k++)
+      l_vQuadrics[l_vuPosition[indices[t + k]]] += q;
+  }
+
+  auto l_attributeDistance = [&](uint32_t a, uint32_t b) {
+    double distance = 0;
+    for (uint32_t i = 0; i < attributeCount; i++) {
+      const double delta = double(attributes[size_t(a) * attributeCount + i]) -
+                           double(attributes[size_t(b) * attributeCount + i]);
+      distance += delta * delta;
+    }
+    return distance;
+  };
+
+  std::vector<uint32_t> l_vuOffsets, l_vuAdjacency;
+
+  // where each wedge of from goes when from is merged into to: the wedge of
+  // to it shares a triangle with, otherwise the one with the closest
+  // attributes. returns the attribute part of the cost.
+  auto l_matchWedges = [&](uint32_t from, uint32_t to,
+                           std::vector<std::pair<uint32_t, uint32_t>> &out) {
+    out.clear();
+    double l_dWorst = 0;
+    for (uint32_t w = l_vuWedgeOffsets[from]; w < l_vuWedgeOffsets[from + 1];
+         w++) {
+      const uint32_t wedge = l_vuWedges[w];
+      uint32_t target = UINT32_MAX;
+
+      for (uint32_t i = l_vuOffsets[from];
+           i < l_vuOffsets[from + 1] && target == UINT32_MAX; i++) {
+        const size_t t = size_t(l_vuAdjacency[i]) * 3;
+        if (indices[t] != wedge && indices[t + 1] != wedge &&
+            indices[t + 2] != wedge)
+          continue;
+        for (size_t k = 0; k < 3; k++)
+          if (l_vuPosition[indices[t + k]] == to)
+            target = indices[t + k];
+      }
+
+      double distance = 0;
+      if (target == UINT32_MAX) {
+        double l_dBest = INFINITY;
+        for (uint32_t o = l_vuWedgeOffsets[to]; o < l_vuWedgeOffsets[to + 1];
+             o++) {
+          const double candidate =
+              attributes ? l_attributeDistance(wedge, l_vuWedges[o]) : 0.0;
+          if (candidate < l_dBest) {
+            l_dBest = candidate;
+            target = l_vuWedges[o];
+          }
+        }
+        if (target == UINT32_MAX)
+          return double(INFINITY);
+        distance = l_dBest;
+      } else if (attributes) {
+        distance = l_attributeDistance(wedge, target);
+      }
+
+      l_dWorst = std::max(l_dWorst, distance);
+      out.emplace_back(wedge, target);
+    }
+    return l_dWorst * double(attributeScale) * double(attributeScale);
+  };
+
+  struct SCollapse {
+    uint32_t from; // positions
+    uint32_t to;
+    double cost;
+  };
+
+  const double l_dMaxCost = double(maxError) * double(maxError);
+  double l_dWorst = 0;
+  std::vector<uint32_t> l_vuRemap(vertexCount);
+  std::vector<SCollapse> l_vCollapses;
+  std::vector<bool> l_vbTouched(vertexCount);
+  std::vector<bool> l_vbGone(vertexCount, false);
+  std::vector<std::pair<uint32_t, uint32_t>> l_vMatches;
+
+  while (indices.size() > targetIndexCount) {
+    // triangles around every position, rebuilt per pass
+    l_vuOffsets.assign(size_t(vertexCount) + 1, 0);
+    for (uint32_t index : indices)
+      l_vuOffsets[l_vuPosition[index] + 1]++;
+    for (uint32_t p = 0; p < vertexCount; p++)
+      l_vuOffsets[p + 1] += l_vuOffsets[p];
+    l_vuAdjacency.resize(indices.size());
+    {
+      std::vector<uint32_t> l_vuFill(l_vuOffsets.begin(),
+                                     l_vuOffsets.end() - 1);
+      for (size_t i = 0; i < indices.size(); i++)
+        l_vuAdjacency[l_vuFill[l_vuPosition[indices[i]]]++] =
+            static_cast<uint32_t>(i / 3);
+    }
+
+    // cheapest way to get rid of each position
+    l_vCollapses.clear();
+    for (uint32_t p = 0; p < vertexCount; p++) {
+      if (l_vbLocked[p] || l_vbGone[p] || l_vuOffsets[p] == l_vuOffsets[p + 1])
+        continue;
+
+      SCollapse best{p, p, INFINITY};
+      for (uint32_t i = l_vuOffsets[p]; i < l_vuOffsets[p + 1]; i++) {
+        const size_t t = size_t(l_vuAdjacency[i]) * 3;
+        for (size_t k = 0; k < 3; k++) {
+          const uint32_t other = l_vuPosition[indices[t + k]];
+          if (other == p || other == best.to)
+            continue;
+          // the wedge matching is the expensive part, only for contenders
+          double cost = l_vQuadrics[p].Evaluate(l_position(other));
+          if (cost >= best.cost)
+            continue;
+          cost += l_matchWedges(p, other, l_vMatches);
+          if (cost < best.cost)
+            best = {p, other, cost};
+        }
+      }
+      if (best.to != p && best.cost <= l_dMaxCost)
+        l_vCollapses.push_back(best);
+    }
+    if (l_vCollapses.empty())
+      break;
+
+    std::sort(l_vCollapses.begin(), l_vCollapses.end(),
+              [](const SCollapse &a, const SCollapse &b) {
+                return a.cost < b.cost;
+              });
+
+    // mostly the cheaper part of the candidates per pass, the costs of the
+    // rest change once their neighbourhood did. cheap ones that would flip a
+    // triangle stay blocked though, a pass always gets some work done.
+    const double l_dPassLimit =
+        l_vCollapses[l_vCollapses.size() / 2].cost * 1.5;
+    const size_t l_uTriangles = indices.size() / 3;
+    const size_t l_uTargetTriangles = targetIndexCount / 3;
+    const size_t l_uMinRemoved = std::max<size_t>(l_uTriangles / 64, 1);
+    size_t l_uRemoved = 0;
+
+    for (uint32_t v = 0; v < vertexCount; v++)
+      l_vuRemap[v] = v;
+    std::fill(l_vbTouched.begin(), l_vbTouched.end(), false);
+
+    for (const SCollapse &collapse : l_vCollapses) {
+      if (collapse.cost > l_dPassLimit && l_uRemoved >= l_uMinRemoved)
+        break;
+      if (l_uTriangles - l_uRemoved <= l_uTargetTriangles)
+        break;
+
+      const uint32_t from = collapse.from;
+      const uint32_t to = collapse.to;
+      if (l_vbTouched[from] || l_vbTouched[to])
+        continue;
+
+      // no triangle around from may turn over
+      bool l_bFlips = false;
+      size_t l_uGone = 0;
+      for (uint32_t i = l_vuOffsets[from];
+           i < l_vuOffsets[from + 1] && !l_bFlips; i++) {
+        const size_t t = size_t(l_vuAdjacency[i]) * 3;
+        uint32_t tri[3];
+        for (size_t k = 0; k < 3; k++)
+          tri[k] = l_vuPosition[indices[t + k]];
+        if (tri[0] == to || tri[1] == to || tri[2] == to) {
+          l_uGone++;
+          continue;
+        }
+
+        double before[3], after[3];
+        l_normal(tri[0], tri[1], tri[2], before);
+        for (uint32_t &corner : tri)
+          if (corner == from)
+            corner = to;
+        l_normal(tri[0], tri[1], tri[2], after);
+
+        const double dot = before[0] * after[0] + before[1] * after[1] +
+                           before[2] * after[2];
+        const double lengths =
+            std::sqrt(before[0] * before[0] + before[1] * before[1] +
+                      before[2] * before[2]) *
+            std::sqrt(after[0] * after[0] + after[1] * after[1] +
+                      after[2] * after[2]);
+        l_bFlips = dot <= 0.25 * lengths;
+      }
+      if (l_bFlips)
+        continue;
+
+      // the neighbourhood of both ends is settled for this pass
+      for (uint32_t i = l_vuOffsets[from]; i < l_vuOffsets[from + 1]; i++) {
+        const size_t t = size_t(l_vuAdjacency[i]) * 3;
+        for (size_t k = 0; k < 3; k++)
+          l_vbTouched[l_vuPosition[indices[t + k]]] = true;
+      }
+      l_vbTouched[to] = true;
+
+      l_matchWedges(from, to, l_vMatches);
+      for (const auto &[wedge, target] : l_vMatches)
+        l_vuRemap[wedge] = target;
+      l_vQuadrics[to] += l_vQuadrics[from];
+      l_vbGone[from] = true;
+      l_dWorst = std::max(l_dWorst, collapse.cost);
+      l_uRemoved += l_uGone;
+    }
+
+    if (l_uRemoved == 0)
+      break;
+
+    size_t l_uWrite = 0;
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+      const uint32_t a = l_vuRemap[indices[t]];
+      const uint32_t b = l_vuRemap[indices[t + 1]];
+      const uint32_t c = l_vuRemap[indices[t + 2]];
+      if (l_vuPosition[a] == l_vuPosition[b] ||
+          l_vuPosition[b] == l_vuPosition[c] ||
+          l_vuPosition[a] == l_vuPosition[c])
+        continue;
+      indices[l_uWrite++] = a;
+      indices[l_uWrite++] = b;
+      indices[l_uWrite++] = c;
+    }
+    indices.resize(l_uWrite);
+  }
+
+  return static_cast<float>(std::sqrt(l_dWorst));
+}
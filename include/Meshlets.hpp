@@ -0,0 +1,470 @@
+#pragma once
+
+#include "GlbFile.hpp"
+#include "Json.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// small clusters of neighbouring triangles. the data is for measurement
+// only: the viewer culls meshlets to report what they would save in the
+// stats overlay, and the render queue keeps drawing whole models until it
+// accepts per-meshlet ranges.
+// the baker groups every triangle list into meshlets and stores them per
+// primitive, the triangles of meshlet i are the indices
+// [firstIndex, firstIndex + triangleCount * 3) of the primitive.
+// the sphere bounds every vertex of the meshlet, every triangle faces within
+// the cone around coneAxis. both are in the space of the mesh's positions.
+struct SMeshlet {
+  uint32_t firstIndex = 0;
+  uint32_t triangleCount = 0;
+  float center[3] = {};
+  float radius = 0.0f;
+  float coneAxis[3] = {0.0f, 0.0f, 1.0f};
+  float coneCutoff = 1.0f; // 1 never culls, the triangles face every way
+};
+static_assert(sizeof(SMeshlet) == 40);
+
+// what a meshlet shader could take in one workgroup
+inline constexpr uint32_t s_uMeshletMaxVertices = 64;
+inline constexpr uint32_t s_uMeshletMaxTriangles = 124;
+
+inline void ComputeMeshletBounds(const uint32_t *indices,
+                                 uint32_t triangleCount,
+                                 const float *positions, SMeshlet &meshlet) {
+  float l_min[3] = {INFINITY, INFINITY, INFINITY};
+  float l_max[3] = {-INFINITY, -INFINITY, -INFINITY};
+  for (size_t i = 0; i < size_t(triangleCount) * 3; i++)
+    for (size_t c = 0; c < 3; c++) {
+      l_min[c] = std::min(l_min[c], positions[size_t(indices[i]) * 3 + c]);
+      l_max[c] = std::max(l_max[c], positions[size_t(indices[i]) * 3 + c]);
+    }
+
+  float l_fRadius2 = 0.0f;
+  for (size_t c = 0; c < 3; c++)
+    meshlet.center[c] = (l_min[c] + l_max[c]) * 0.5f;
+  for (size_t i = 0; i < size_t(triangleCount) * 3; i++) {
+    float l_fDistance2 = 0.0f;
+    for (size_t c = 0; c < 3; c++) {
+      const float delta =
+          positions[size_t(indices[i]) * 3 + c] - meshlet.center[c];
+      l_fDistance2 += delta * delta;
+    }
+    l_fRadius2 = std::max(l_fRadius2, l_fDistance2);
+  }
+  meshlet.radius = std::sqrt(l_fRadius2);
+
+  // the axis is the average facing, the cutoff how far the widest triangle
+  // leans away from it
+  std::vector<float> l_vfNormals;
+  l_vfNormals.reserve(size_t(triangleCount) * 3);
+  float l_axis[3] = {};
+  for (size_t t = 0; t < triangleCount; t++) {
+    const float *a = positions + size_t(indices[t * 3]) * 3;
+    const float *b = positions + size_t(indices[t * 3 + 1]) * 3;
+    const float *c = positions + size_t(indices[t * 3 + 2]) * 3;
+    const float e0[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+    const float e1[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+    const float n[3] = {e0[1] * e1[2] - e0[2] * e1[1],
+                        e0[2] * e1[0] - e0[0] * e1[2],
+                        e0[0] * e1[1] - e0[1] * e1[0]};
+    const float l_fLength = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (!(l_fLength > 0.0f))
+      continue; // degenerate triangles face nowhere
+    for (size_t k = 0; k < 3; k++) {
+      l_vfNormals.push_back(n[k] / l_fLength);
+      l_axis[k] += n[k] / l_fLength;
+    }
+  }
+
+  meshlet.coneAxis[0] = meshlet.coneAxis[1] = 0.0f;
+  meshlet.coneAxis[2] = 1.0f;
+  meshlet.coneCutoff = 1.0f;
+  const float l_fAxisLength = std::sqrt(
+      l_axis[0] * l_axis[0] + l_axis[1] * l_axis[1] + l_axis[2] * l_axis[2]);
+  if (l_vfNormals.empty() || !(l_fAxisLength > 1e-6f))
+    return;
+
+  for (size_t k = 0; k < 3; k++)
+    l_axis[k] /= l_fAxisLength;
+
+  float l_fMinDot = 1.0f;
+  for (size_t n = 0; n < l_vfNormals.size(); n += 3)
+    l_fMinDot = std::min(l_fMinDot, l_vfNormals[n] * l_axis[0] +
+                                        l_vfNormals[n + 1] * l_axis[1] +
+                                        l_vfNormals[n + 2] * l_axis[2]);
+
+  // past about 84 degrees the cone culls next to nothing
+  if (l_fMinDot <= 0.1f)
+    return;
+
+  std::memcpy(meshlet.coneAxis, l_axis, sizeof(l_axis));
+  meshlet.coneCutoff = std::sqrt(1.0f - l_fMinDot * l_fMinDot);
+}
+
+// groups the triangles into meshlets and reorders indices so every meshlet
+// is contiguous. a meshlet grows by the neighbouring triangle that adds the
+// fewest new vertices, and starts over from the earliest unused triangle
+// when it is full or has no neighbours left, so the vertex cache and
+// overdraw order survives at meshlet granularity.
+inline void BuildMeshlets(std::vector<uint32_t> &indices,
+                          const float *positions, uint32_t vertexCount,
+                          std::vector<SMeshlet> &meshlets) {
+  meshlets.clear();
+  const size_t l_uTriangles = indices.size() / 3;
+  if (l_uTriangles == 0)
+    return;
+
+  // triangles around every vertex
+  std::vector<uint32_t> l_vuOffsets(size_t(vertexCount) + 1, 0);
+  for (uint32_t index : indices)
+    l_vuOffsets[size_t(index) + 1]++;
+  for (size_t v = 0; v < vertexCount; v++)
+    l_vuOffsets[v + 1] += l_vuOffsets[v];
+  std::vector<uint32_t> l_vuAdjacency(indices.size());
+  {
+    std::vector<uint32_t> l_vuFill(l_vuOffsets.begin(), l_vuOffsets.end() - 1);
+    for (size_t i = 0; i < l_uTriangles * 3; i++)
+      l_vuAdjacency[l_vuFill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+  }
+
+  std::vector<bool> l_vbUsed(l_uTriangles, false);
+  // the meshlet a vertex was last added to, + 1
+  std::vector<uint32_t> l_vuVertexMeshlet(vertexCount, 0);
+  std::vector<uint32_t> l_vuOut;
+  l_vuOut.reserve(indices.size());
+
+  std::vector<uint32_t> l_vuVertices; // of the meshlet being built
+  size_t l_uSeed = 0;
+
+  auto l_newVertices = [&](size_t triangle, uint32_t stamp) {
+    uint32_t count = 0;
+    for (size_t k = 0; k < 3; k++)
+      count += l_vuVertexMeshlet[indices[triangle * 3 + k]] != stamp;
+    return count;
+  };
+
+  while (true) {
+    while (l_uSeed < l_uTriangles && l_vbUsed[l_uSeed])
+      l_uSeed++;
+    if (l_uSeed == l_uTriangles)
+      break;
+
+    SMeshlet &meshlet = meshlets.emplace_back();
+    meshlet.firstIndex = static_cast<uint32_t>(l_vuOut.size());
+    const uint32_t stamp = static_cast<uint32_t>(meshlets.size());
+    l_vuVertices.clear();
+
+    size_t triangle = l_uSeed;
+    while (true) {
+      l_vbUsed[triangle] = true;
+      meshlet.triangleCount++;
+      for (size_t k = 0; k < 3; k++) {
+        const uint32_t vertex = indices[triangle * 3 + k];
+        l_vuOut.push_back(vertex);
+        if (l_vuVertexMeshlet[vertex] != stamp) {
+          l_vuVertexMeshlet[vertex] = stamp;
+          l_vuVertices.push_back(vertex);
+        }
+      }
+      if (meshlet.triangleCount == s_uMeshletMaxTriangles)
+        break;
+
+      // around the last triangle first, it is where the meshlet grows
+      // and it keeps the search short, then around the whole meshlet
+      const size_t l_uLast = triangle;
+      size_t l_uBest = SIZE_MAX;
+      uint32_t l_uBestNew = 4;
+      auto l_consider = [&](uint32_t vertex) {
+        for (uint32_t a = l_vuOffsets[vertex]; a < l_vuOffsets[vertex + 1];
+             a++) {
+          const uint32_t candidate = l_vuAdjacency[a];
+          if (l_vbUsed[candidate])
+            continue;
+          const uint32_t l_uNew = l_newVertices(candidate, stamp);
+          if (l_uNew < l_uBestNew ||
+              (l_uNew == l_uBestNew && candidate < l_uBest)) {
+            l_uBest = candidate;
+            l_uBestNew = l_uNew;
+          }
+        }
+      };
+      for (size_t k = 0; k < 3; k++)
+        l_consider(indices[l_uLast * 3 + k]);
+      if (l_uBest == SIZE_MAX)
+        for (uint32_t vertex : l_vuVertices)
+          l_consider(vertex);
+
+      if (l_uBest == SIZE_MAX) {
+        // nothing connected is left, carry on with the next unused one
+        while (l_uSeed < l_uTriangles && l_vbUsed[l_uSeed])
+          l_uSeed++;
+        if (l_uSeed == l_uTriangles)
+          break;
+        l_uBest = l_uSeed;
+        l_uBestNew = l_newVertices(l_uBest, stamp);
+      }
+
+      if (l_vuVertices.size() + l_uBestNew > s_uMeshletMaxVertices)
+        break;
+      triangle = l_uBest;
+    }
+
+    ComputeMeshletBounds(l_vuOut.data() + meshlet.firstIndex,
+                         meshlet.triangleCount, positions, meshlet);
+  }
+
+  indices = std::move(l_vuOut);
+}
+
+// every meshlet of a model with the transform of each node that draws it,
+// read from a bake. the bounds are kept structure of arrays so the culling
+// loop is a straight run the compiler vectorizes.
+struct SModelMeshlets {
+  struct SInstance {
+    float matrix[16]; // column major, mesh space to model space
+    uint32_t first = 0;
+    uint32_t count = 0;
+  };
+
+  std::vector<SInstance> instances;
+  std::vector<float> centerX, centerY, centerZ, radius;
+  std::vector<float> axisX, axisY, axisZ, cutoff;
+  std::vector<uint8_t> visible; // filled by CullMeshlets
+
+  bool Empty() const { return radius.empty(); }
+  size_t Size() const { return radius.size(); }
+
+  void Append(const SMeshlet &meshlet) {
+    centerX.push_back(meshlet.center[0]);
+    centerY.push_back(meshlet.center[1]);
+    centerZ.push_back(meshlet.center[2]);
+    radius.push_back(meshlet.radius);
+    axisX.push_back(meshlet.coneAxis[0]);
+    axisY.push_back(meshlet.coneAxis[1]);
+    axisZ.push_back(meshlet.coneAxis[2]);
+    cutoff.push_back(meshlet.coneCutoff);
+  }
+};
+
+// column major like glTF and glm
+inline void MultiplyMatrix(const float *a, const float *b, float *out) {
+  float l_result[16];
+  for (size_t column = 0; column < 4; column++)
+    for (size_t row = 0; row < 4; row++) {
+      float sum = 0.0f;
+      for (size_t k = 0; k < 4; k++)
+        sum += a[k * 4 + row] * b[column * 4 + k];
+      l_result[column * 4 + row] = sum;
+    }
+  std::memcpy(out, l_result, sizeof(l_result));
+}
+
+inline void GetNodeMatrix(const CJson &node, float *out) {
+  static constexpr float s_identity[16] = {1, 0, 0, 0, 0, 1, 0, 0,
+                                           0, 0, 1, 0, 0, 0, 0, 1};
+  std::memcpy(out, s_identity, sizeof(s_identity));
+
+  if (const CJson *matrix = node.Find("matrix");
+      matrix && matrix->Size() == 16) {
+    for (size_t i = 0; i < 16; i++)
+      out[i] = static_cast<float>(matrix->GetArray()[i].AsNumber());
+    return;
+  }
+
+  auto l_read = [&](const char *key, float *values, size_t count) {
+    if (const CJson *array = node.Find(key); array && array->Size() == count)
+      for (size_t i = 0; i < count; i++)
+        values[i] = static_cast<float>(array->GetArray()[i].AsNumber());
+  };
+  float t[3] = {0, 0, 0}, q[4] = {0, 0, 0, 1}, s[3] = {1, 1, 1};
+  l_read("translation", t, 3);
+  l_read("rotation", q, 4);
+  l_read("scale", s, 3);
+
+  const float x = q[0], y = q[1], z = q[2], w = q[3];
+  const float l_rotation[9] = {
+      1 - 2 * (y * y + z * z), 2 * (x * y + z * w),     2 * (x * z - y * w),
+      2 * (x * y - z * w),     1 - 2 * (x * x + z * z), 2 * (y * z + x * w),
+      2 * (x * z + y * w),     2 * (y * z - x * w),     1 - 2 * (x * x + y * y)};
+  for (size_t column = 0; column < 3; column++)
+    for (size_t row = 0; row < 3; row++)
+      out[column * 4 + row] = l_rotation[column * 3 + row] * s[column];
+  for (size_t row = 0; row < 3; row++)
+    out[12 + row] = t[row];
+}
+
+// reads the meshlets of every primitive in json/bin and instances them per
+// node. false if there are none.
+inline bool LoadModelMeshlets(const CJson &json, const std::vector<uint8_t> &bin,
+                              SModelMeshlets &out) {
+  out = SModelMeshlets{};
+  const CJson *meshes = json.Find("meshes");
+  const CJson *nodes = json.Find("nodes");
+  const CJson *views = json.Find("bufferViews");
+  if (!meshes || !nodes || !views)
+    return false;
+
+  // every meshlet of a mesh is contiguous in out
+  std::vector<std::pair<uint32_t, uint32_t>> l_vMeshRanges(meshes->Size());
+  for (size_t m = 0; m < meshes->Size(); m++) {
+    l_vMeshRanges[m].first = static_cast<uint32_t>(out.Size());
+    const CJson *primitives = meshes->GetArray()[m].Find("primitives");
+    if (!primitives)
+      continue;
+
+    for (const CJson &primitive : primitives->GetArray()) {
+      const CJson *extension = primitive.Find("extensions");
+      extension = extension ? extension->Find("EHAZ_meshlets") : nullptr;
+      const CJson *view = extension ? extension->Find("bufferView") : nullptr;
+      if (!view || view->AsInt() < 0 ||
+          static_cast<size_t>(view->AsInt()) >= views->Size())
+        continue;
+
+      const CJson &bufferView =
+          views->GetArray()[static_cast<size_t>(view->AsInt())];
+      const uint64_t offset = CGlbFile::GetOptional(bufferView, "byteOffset");
+      const uint64_t length = CGlbFile::GetOptional(bufferView, "byteLength");
+      if (offset + length > bin.size() || length % sizeof(SMeshlet))
+        continue;
+
+      SMeshlet l_meshlet;
+      for (uint64_t at = offset; at < offset + length; at += sizeof(SMeshlet)) {
+        std::memcpy(&l_meshlet, bin.data() + at, sizeof(SMeshlet));
+        out.Append(l_meshlet);
+      }
+    }
+    l_vMeshRanges[m].second =
+        static_cast<uint32_t>(out.Size()) - l_vMeshRanges[m].first;
+  }
+  if (out.Empty())
+    return false;
+
+  std::vector<bool> l_vbChild(nodes->Size(), false);
+  for (const CJson &node : nodes->GetArray())
+    if (const CJson *children = node.Find("children"))
+      for (const CJson &child : children->GetArray())
+        if (child.AsInt() >= 0 &&
+            static_cast<size_t>(child.AsInt()) < l_vbChild.size())
+          l_vbChild[static_cast<size_t>(child.AsInt())] = true;
+
+  struct SVisit {
+    size_t node;
+    float matrix[16];
+  };
+  std::vector<SVisit> l_vStack;
+  for (size_t n = 0; n < nodes->Size(); n++)
+    if (!l_vbChild[n]) {
+      SVisit &visit = l_vStack.emplace_back();
+      visit.node = n;
+      GetNodeMatrix(CJson::MakeObject(), visit.matrix);
+    }
+
+  // cycles in a broken file end with the budget
+  size_t l_uBudget = nodes->Size() * 64;
+  while (!l_vStack.empty() && l_uBudget-- > 0) {
+    SVisit visit = l_vStack.back();
+    l_vStack.pop_back();
+    const CJson &node = nodes->GetArray()[visit.node];
+
+    float l_local[16];
+    GetNodeMatrix(node, l_local);
+    MultiplyMatrix(visit.matrix, l_local, visit.matrix);
+
+    const CJson *mesh = node.Find("mesh");
+    if (mesh && !node.Find("skin") && mesh->AsInt() >= 0 &&
+        static_cast<size_t>(mesh->AsInt()) < l_vMeshRanges.size()) {
+      const auto [first, count] =
+          l_vMeshRanges[static_cast<size_t>(mesh->AsInt())];
+      if (count) {
+        SModelMeshlets::SInstance &instance = out.instances.emplace_back();
+        std::memcpy(instance.matrix, visit.matrix, sizeof(visit.matrix));
+        instance.first = first;
+        instance.count = count;
+      }
+    }
+
+    if (const CJson *children = node.Find("children"))
+      for (const CJson &child : children->GetArray())
+        if (child.AsInt() >= 0 &&
+            static_cast<size_t>(child.AsInt()) < nodes->Size()) {
+          SVisit &next = l_vStack.emplace_back();
+          next.node = static_cast<size_t>(child.AsInt());
+          std::memcpy(next.matrix, visit.matrix, sizeof(visit.matrix));
+        }
+  }
+  return !out.instances.empty();
+}
+
+// of one culling pass, for the stats overlay. nothing is left out of the
+// draw, the numbers are what meshlet culling could save
+struct SMeshletCullStats {
+  uint64_t meshlets = 0;
+  uint64_t frustumCulled = 0;
+  uint64_t coneCulled = 0; // inside the frustum but facing away
+
+  uint64_t GetVisible() const { return meshlets - frustumCulled - coneCulled; }
+};
+
+// the six planes of clip = projection * view * model, normalized and facing
+// inwards. for a clip matrix that includes the model they are in model space.
+inline void ExtractFrustumPlanes(const float *clip, float planes[6][4]) {
+  for (size_t p = 0; p < 6; p++) {
+    const size_t row = p / 2;
+    const float sign = p % 2 ? -1.0f : 1.0f;
+    for (size_t column = 0; column < 4; column++)
+      planes[p][column] =
+          clip[column * 4 + 3] + sign * clip[column * 4 + row];
+
+    const float l_fLength =
+        std::sqrt(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] +
+                  planes[p][2] * planes[p][2]);
+    if (l_fLength > 0.0f)
+      for (size_t column = 0; column < 4; column++)
+        planes[p][column] /= l_fLength;
+  }
+}
+
+// tests the meshlets of instance against planes and camera, both in the
+// instance's mesh space, and sets their visible flags. testing in mesh space
+// keeps it exact under any affine transform, and it is branch free so the
+// loop vectorizes.
+inline void CullMeshlets(SModelMeshlets &meshlets,
+                         const SModelMeshlets::SInstance &instance,
+                         const float planes[6][4], const float camera[3],
+                         SMeshletCullStats &stats) {
+  meshlets.visible.resize(meshlets.Size());
+  const float *cx = meshlets.centerX.data(), *cy = meshlets.centerY.data(),
+              *cz = meshlets.centerZ.data(), *r = meshlets.radius.data();
+  const float *ax = meshlets.axisX.data(), *ay = meshlets.axisY.data(),
+              *az = meshlets.axisZ.data(), *cutoff = meshlets.cutoff.data();
+  uint8_t *visible = meshlets.visible.data();
+
+  uint32_t l_uOutside = 0, l_uBackFacing = 0;
+  const size_t l_uEnd = size_t(instance.first) + instance.count;
+  for (size_t i = instance.first; i < l_uEnd; i++) {
+    float l_fDistance = INFINITY;
+    for (size_t p = 0; p < 6; p++)
+      l_fDistance =
+          std::min(l_fDistance, planes[p][0] * cx[i] + planes[p][1] * cy[i] +
+                                    planes[p][2] * cz[i] + planes[p][3]);
+    const uint32_t inside = l_fDistance > -r[i];
+
+    const float dx = cx[i] - camera[0], dy = cy[i] - camera[1],
+                dz = cz[i] - camera[2];
+    const float l_fLength = std::sqrt(dx * dx + dy * dy + dz * dz);
+    const uint32_t away =
+        dx * ax[i] + dy * ay[i] + dz * az[i] >= cutoff[i] * l_fLength + r[i];
+
+    visible[i] = static_cast<uint8_t>(inside & (away ^ 1u));
+    l_uOutside += inside ^ 1u;
+    l_uBackFacing += inside & away;
+  }
+
+  stats.meshlets += instance.count;
+  stats.frustumCulled += l_uOutside;
+  stats.coneCulled += l_uBackFacing;
+}
@@ -0,0 +1,1025 @@
+#pragma once
+
+#include "GlbFile.hpp"
+#include "Json.hpp"
+#include "MaterialTextures.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+#include "Meshlets.hpp"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// turns an exported .glb into one that is cheap to import and to draw:
+// triangles reordered for the post transform cache and for overdraw, vertices
+// reordered for fetch locality, every vertex stream interleaved into a single
+// bufferView, indices tightly packed in the smallest type that fits,
+// primitives sorted so the ones sharing a material are drawn back to back,
+// and everything nothing references dropped.
+// every triangle list is also grouped into meshlets for the viewer's culling,
+// stored as EHAZ_meshlets on the primitive. the triangles of a meshlet are
+// contiguous in the index buffer.
+// png and jpeg textures are left to the viewer, which decodes them on its
+// own threads, see MaterialTextures.hpp.
+// primitives the baker does not understand (points, lines, morph targets,
+// sparse or compressed data) are carried over untouched.
+// with SetSimplify the triangles are reduced first, which is how the levels
+// of a LOD chain are made.
+class CModelBaker {
+public:
+  // bumped whenever the output changes, it is part of the cache key
+  static constexpr uint32_t s_uVersion = 4;
+
+  // of the last bake, over every primitive that was optimized
+  const SVertexCacheStats &GetStatsBefore() const { return m_statsBefore; }
+  const SVertexCacheStats &GetStatsAfter() const { return m_statsAfter; }
+
+  // keeps about ratio of the triangles, 1 turns it off
+  void SetSimplify(float ratio) { m_fSimplifyRatio = ratio; }
+
+  // largest error a collapse made in the last bake, in scene units
+  float GetSimplifyError() const { return m_fSimplifyError; }
+
+  bool Bake(const std::filesystem::path &source,
+            const std::filesystem::path &target, std::string &error) {
+    m_vStreams.clear();
+    m_vPrimitives.clear();
+    m_statsBefore = {};
+    m_statsAfter = {};
+    m_fSimplifyError = 0.0f;
+
+    if (!m_glb.Load(source, error))
+      return false;
+
+    if (!m_glb.IsSelfContained()) {
+      error = "external buffers are not baked";
+      return false;
+    }
+    if (!CheckExtensions(error))
+      return false;
+
+    RebaseImageUris(source.parent_path());
+    DeferTextures(source.parent_path());
+    SortPrimitives();
+    Decode();
+    Optimize();
+    Encode();
+    Compact();
+
+    if (!m_glb.Save(target)) {
+      error = "could not write " + target.string();
+      return false;
+    }
+    return true;
+  }
+
+private:
+  // one attribute of a vertex stream, tightly packed
+  struct SAttribute {
+    std::string name;
+    CJson accessor; // the source accessor without its view
+    uint32_t elementSize = 0;
+    uint32_t componentSize = 0;
+    std::vector<uint8_t> data;
+  };
+
+  // vertices shared by every primitive that uses the same accessors
+  struct SVertexStream {
+    uint32_t vertexCount = 0;
+    std::vector<SAttribute> attributes;
+  };
+
+  struct SPrimitive {
+    size_t mesh;
+    size_t primitive;
+    uint32_t stream;
+    std::vector<uint32_t> indices;
+    std::vector<SMeshlet> meshlets; // empty without float positions
+  };
+
+  static constexpr uint32_t s_uTargetVertices = 34962; // ARRAY_BUFFER
+  static constexpr uint32_t s_uTargetIndices = 34963;  // ELEMENT_ARRAY_BUFFER
+
+  CGlbFile m_glb;
+  std::vector<SVertexStream> m_vStreams;
+  std::vector<SPrimitive> m_vPrimitives;
+  SVertexCacheStats m_statsBefore, m_statsAfter;
+  float m_fSimplifyRatio = 1.0f;
+  float m_fSimplifyError = 0.0f;
+
+  // extensions that could reference accessors or views in places the
+  // compaction does not know about make the file unsafe to rewrite
+  bool CheckExtensions(std::string &error) const {
+    static constexpr std::array<std::string_view, 4> s_safePrefixes = {
+        "KHR_materials_", "KHR_texture_", "KHR_lights_", "EXT_texture_"};
+
+    const CJson *used = m_glb.json.Find("extensionsUsed");
+    if (!used)
+      return true;
+
+    for (const CJson &extension : used->GetArray()) {
+      const std::string &name = extension.AsString();
+      bool safe = name == "KHR_mesh_quantization" || name.starts_with("EHAZ_");
+      for (std::string_view prefix : s_safePrefixes)
+        safe = safe || name.starts_with(prefix);
+
+      if (!safe) {
+        error = "uses " + name;
+        return false;
+      }
+    }
+    return true;
+  }
+
+  CJson *GetArray(std::string_view key) {
+    CJson *array = m_glb.json.Find(key);
+    return array && array->IsArray() ? array : nullptr;
+  }
+
+  // the bake lives in the cache, relative image uris have to keep pointing
+  // next to the source
+  void RebaseImageUris(const std::filesystem::path &sourceDir) {
+    CJson *images = GetArray("images");
+    if (!images)
+      return;
+
+    std::error_code ec;
+    std::filesystem::path l_absDir = std::filesystem::absolute(sourceDir, ec);
+    if (ec)
+      return;
+
+    // the uri is percent encoded, so has to be the prefix
+    std::string l_sPrefix;
+    for (char c : l_absDir.generic_string()) {
+      if (c == ' ' || c == '%' || c == '#' || c == '?') {
+        char l_escaped[4];
+        std::snprintf(l_escaped, sizeof(l_escaped), "%%%02X",
+                      static_cast<unsigned char>(c));
+        l_sPrefix += l_escaped;
+      } else {
+        l_sPrefix += c;
+      }
+    }
+    l_sPrefix += '/';
+
+    for (CJson &image : images->GetArray()) {
+      CJson *uri = image.Find("uri");
+      if (!uri || !uri->IsString())
+        continue;
+
+      const std::string &value = uri->AsString();
+      const bool l_bAbsolute = value.starts_with('/') ||
+                               value.find(':') != std::string::npos;
+      if (!value.empty() && !l_bAbsolute)
+        *uri = CJson(l_sPrefix + value);
+    }
+  }
+
+  // embedded ones need their mimeType, files have to exist by now
+  static bool CanDefer(const CJson &image,
+                       const std::filesystem::path &sourceDir) {
+    if (image.Find("bufferView")) {
+      const CJson *mime = image.Find("mimeType");
+      return mime && (mime->AsString() == "image/png" ||
+                      mime->AsString() == "image/jpeg");
+    }
+
+    const CJson *uri = image.Find("uri");
+    if (!uri)
+      return false;
+    const std::filesystem::path l_path =
+        CGlbFile::GetUriPath(uri->AsString(), sourceDir);
+    std::string l_sExt = l_path.extension().string();
+    for (char &c : l_sExt)
+      c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+
+    std::error_code ec;
+    return (l_sExt == ".png" || l_sExt == ".jpg" || l_sExt == ".jpeg") &&
+           std::filesystem::is_regular_file(l_path, ec);
+  }
+
+  // the importer gets a white 1x1 png for every deferred slot, the slot's
+  // real texture index goes to EHAZ_deferred_textures
+  void DeferTextures(const std::filesystem::path &sourceDir) {
+    static constexpr uint8_t s_standIn[] = {
+        0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0x00, 0x00, 0x00,
+        0x0d, 0x49, 0x48, 0x44, 0x52, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00,
+        0x00, 0x01, 0x08, 0x06, 0x00, 0x00, 0x00, 0x1f, 0x15, 0xc4, 0x89,
+        0x00, 0x00, 0x00, 0x0b, 0x49, 0x44, 0x41, 0x54, 0x78, 0xda, 0x63,
+        0xf8, 0x0f, 0x04, 0x00, 0x09, 0xfb, 0x03, 0xfd, 0x68, 0xfa, 0x1c,
+        0xcc, 0x00, 0x00, 0x00, 0x00, 0x49, 0x45, 0x4e, 0x44, 0xae, 0x42,
+        0x60, 0x82};
+
+    const CJson *materials = GetArray("materials");
+    const CJson *textures = GetArray("textures");
+    const CJson *images = GetArray("images");
+    if (!materials || !textures || !images)
+      return;
+
+    std::vector<bool> l_vbDeferrable;
+    for (const CJson &image : images->GetArray())
+      l_vbDeferrable.push_back(CanDefer(image, sourceDir));
+
+    // material, slot and texture, collected first since adding the stand-in
+    // can move the arrays
+    struct SDeferred {
+      size_t material;
+      size_t slot;
+      int64_t texture;
+    };
+    std::vector<SDeferred> l_vDeferred;
+
+    for (size_t m = 0; m < materials->Size(); m++) {
+      const CJson &material = materials->GetArray()[m];
+      const CJson *extensions = material.Find("extensions");
+      if (extensions && extensions->Find(s_deferredTexturesExt))
+        continue; // already a bake
+
+      for (size_t s = 0; s < s_materialSlots.size(); s++) {
+        const CJson *info = FindSlotTexture(material, s_materialSlots[s]);
+        const CJson *index = info ? info->Find("index") : nullptr;
+        const int64_t texture = index ? index->AsInt() : -1;
+        if (texture < 0 || static_cast<size_t>(texture) >= textures->Size())
+          continue;
+
+        const CJson *source =
+            textures->GetArray()[static_cast<size_t>(texture)].Find("source");
+        const int64_t image = source ? source->AsInt() : -1;
+        if (image >= 0 && static_cast<size_t>(image) < l_vbDeferrable.size() &&
+            l_vbDeferrable[static_cast<size_t>(image)])
+          l_vDeferred.push_back({m, s, texture});
+      }
+    }
+    if (l_vDeferred.empty())
+      return;
+
+    CJson l_image = CJson::MakeObject();
+    l_image["bufferView"] =
+        CJson(AddBufferView(s_standIn, sizeof(s_standIn), 0, 0));
+    l_image["mimeType"] = CJson("image/png");
+    CJson &imageArray = m_glb.json["images"];
+    imageArray.PushBack(std::move(l_image));
+
+    CJson l_texture = CJson::MakeObject();
+    l_texture["source"] = CJson(static_cast<uint32_t>(imageArray.Size() - 1));
+    CJson &textureArray = m_glb.json["textures"];
+    textureArray.PushBack(std::move(l_texture));
+    const uint32_t l_uStandIn = static_cast<uint32_t>(textureArray.Size() - 1);
+
+    CJson &materialArray = m_glb.json["materials"];
+    for (const SDeferred &deferred : l_vDeferred) {
+      CJson &material = materialArray.GetArray()[deferred.material];
+      const SMaterialSlot &slot = s_materialSlots[deferred.slot];
+      (*FindSlotTexture(material, slot))["index"] = CJson(l_uStandIn);
+      material["extensions"][s_deferredTexturesExt][slot.name] =
+          CJson(deferred.texture);
+    }
+
+    // other importers just show the stand-in
+    CJson &used = m_glb.json["extensionsUsed"];
+    bool found = false;
+    for (const CJson &extension : used.GetArray())
+      found = found || extension.AsString() == s_deferredTexturesExt;
+    if (!found)
+      used.PushBack(CJson(std::string(s_deferredTexturesExt)));
+  }
+
+  // opaque before blended so the order stays valid, then by material
+  void SortPrimitives() {
+    CJson *meshes = GetArray("meshes");
+    if (!meshes)
+      return;
+
+    const CJson *materials = GetArray("materials");
+    auto l_sortKey = [materials](const CJson &primitive) {
+      const CJson *material = primitive.Find("material");
+      const int64_t index = material ? material->AsInt() : -1;
+
+      bool blend = false;
+      if (materials && index >= 0 &&
+          static_cast<size_t>(index) < materials->Size()) {
+        const CJson *mode =
+            materials->GetArray()[static_cast<size_t>(index)].Find("alphaMode");
+        blend = mode && mode->AsString() == "BLEND";
+      }
+      return std::make_pair(blend, index);
+    };
+
+    for (CJson &mesh : meshes->GetArray()) {
+      if (CJson *primitives = mesh.Find("primitives"))
+        std::stable_sort(primitives->GetArray().begin(),
+                         primitives->GetArray().end(),
+                         [&](const CJson &a, const CJson &b) {
+                           return l_sortKey(a) < l_sortKey(b);
+                         });
+    }
+  }
+
+  void Decode() {
+    CJson *meshes = GetArray("meshes");
+    if (!meshes)
+      return;
+
+    // streams are keyed by the sorted (attribute, accessor) pairs
+    std::map<std::vector<std::pair<std::string, int64_t>>, uint32_t>
+        l_mapStreams;
+
+    for (size_t m = 0; m < meshes->Size(); m++) {
+      CJson *primitives = meshes->GetArray()[m].Find("primitives");
+      if (!primitives)
+        continue;
+
+      for (size_t p = 0; p < primitives->Size(); p++) {
+        const CJson &primitive = primitives->GetArray()[p];
+        const CJson *attributes = primitive.Find("attributes");
+        const CJson *mode = primitive.Find("mode");
+
+        if (!attributes || attributes->Size() == 0 ||
+            (mode && mode->AsInt() != 4) || primitive.Find("targets") ||
+            primitive.Find("extensions"))
+          continue;
+
+        std::vector<std::pair<std::string, int64_t>> l_key;
+        for (const CJson::Member &attribute : attributes->GetMembers())
+          l_key.emplace_back(attribute.first, attribute.second.AsInt());
+        std::sort(l_key.begin(), l_key.end());
+
+        auto found = l_mapStreams.find(l_key);
+        uint32_t stream = 0;
+        if (found != l_mapStreams.end()) {
+          stream = found->second;
+        } else {
+          SVertexStream l_stream;
+          if (!DecodeStream(l_key, l_stream))
+            continue;
+
+          stream = static_cast<uint32_t>(m_vStreams.size());
+          m_vStreams.push_back(std::move(l_stream));
+          l_mapStreams.emplace(std::move(l_key), stream);
+        }
+
+        SPrimitive l_primitive{m, p, stream, {}, {}};
+        if (DecodeIndices(primitive, m_vStreams[stream].vertexCount,
+                          l_primitive.indices))
+          m_vPrimitives.push_back(std::move(l_primitive));
+      }
+    }
+  }
+
+  bool DecodeStream(const std::vector<std::pair<std::string, int64_t>> &key,
+                    SVertexStream &stream) const {
+    const CJson &accessors = *m_glb.json.Find("accessors");
+
+    for (size_t i = 0; i < key.size(); i++) {
+      CGlbFile::SAccessor l_view;
+      if (!m_glb.GetAccessor(key[i].second, l_view) || !l_view.data ||
+          l_view.sparse || (i > 0 && l_view.count != stream.vertexCount))
+        return false;
+
+      stream.vertexCount = l_view.count;
+
+      SAttribute l_attribute;
+      l_attribute.name = key[i].first;
+      l_attribute.accessor =
+          accessors.GetArray()[static_cast<size_t>(key[i].second)];
+      l_attribute.accessor.Erase("bufferView");
+      l_attribute.accessor.Erase("byteOffset");
+      l_attribute.elementSize = l_view.elementSize;
+      l_attribute.componentSize =
+          CGlbFile::GetComponentSize(l_view.componentType);
+
+      l_attribute.data.resize(size_t(l_view.count) * l_view.elementSize);
+      for (uint32_t v = 0; v < l_view.count; v++)
+        std::memcpy(l_attribute.data.data() + size_t(v) * l_view.elementSize,
+                    l_view.data + size_t(v) * l_view.stride,
+                    l_view.elementSize);
+
+      stream.attributes.push_back(std::move(l_attribute));
+    }
+    return stream.vertexCount > 0;
+  }
+
+  bool DecodeIndices(const CJson &primitive, uint32_t vertexCount,
+                     std::vector<uint32_t> &indices) const {
+    const CJson *accessor = primitive.Find("indices");
+    if (!accessor) {
+      // non indexed, every three vertices are a triangle
+      indices.resize(vertexCount - vertexCount % 3);
+      for (uint32_t i = 0; i < indices.size(); i++)
+        indices[i] = i;
+      return true;
+    }
+
+    CGlbFile::SAccessor l_view;
+    if (!m_glb.GetAccessor(accessor->AsInt(), l_view) || !l_view.data ||
+        l_view.sparse || l_view.components != 1)
+      return false;
+
+    indices.resize(l_view.count);
+    for (uint32_t i = 0; i < l_view.count; i++) {
+      const uint8_t *element = l_view.data + size_t(i) * l_view.stride;
+      switch (l_view.componentType) {
+      case 5121:
+        indices[i] = *element;
+        break;
+      case 5123: {
+        uint16_t value;
+        std::memcpy(&value, element, sizeof(value));
+        indices[i] = value;
+        break;
+      }
+      case 5125:
+        std::memcpy(&indices[i], element, sizeof(uint32_t));
+        break;
+      default:
+        return false;
+      }
+
+      if (indices[i] >= vertexCount)
+        return false;
+    }
+
+    indices.resize(indices.size() - indices.size() % 3);
+    return true;
+  }
+
+  // float xyz positions of a stream, empty if it has none
+  static std::vector<float> GetPositions(const SVertexStream &stream) {
+    for (const SAttribute &attribute : stream.attributes) {
+      if (attribute.name != "POSITION" || attribute.componentSize != 4 ||
+          attribute.elementSize != 12 ||
+          attribute.accessor.Find("componentType")->AsInt() != 5126)
+        continue;
+
+      std::vector<float> l_vfPositions(size_t(stream.vertexCount) * 3);
+      std::memcpy(l_vfPositions.data(), attribute.data.data(),
+                  attribute.data.size());
+      return l_vfPositions;
+    }
+    return {};
+  }
+
+  void WeldStream(SVertexStream &stream,
+                  std::vector<std::vector<uint32_t> *> &indexLists) {
+    std::vector<const uint8_t *> l_vpData;
+    std::vector<uint32_t> l_vuSizes;
+    for (const SAttribute &attribute : stream.attributes) {
+      l_vpData.push_back(attribute.data.data());
+      l_vuSizes.push_back(attribute.elementSize);
+    }
+
+    std::vector<uint32_t> l_vuRemap;
+    const uint32_t l_uUnique =
+        WeldVertices(l_vpData, l_vuSizes, stream.vertexCount, l_vuRemap);
+    if (l_uUnique == stream.vertexCount)
+      return;
+
+    for (SAttribute &attribute : stream.attributes) {
+      RemapVertices(attribute.data, attribute.elementSize, l_vuRemap,
+                    l_uUnique);
+      attribute.accessor["count"] = CJson(l_uUnique);
+    }
+    for (std::vector<uint32_t> *indices : indexLists)
+      for (uint32_t &index : *indices)
+        index = l_vuRemap[index];
+
+    stream.vertexCount = l_uUnique;
+  }
+
+  // the largest scale any node draws each mesh with, 1 if none does
+  std::vector<float> GetMeshScales() {
+    const CJson *meshes = GetArray("meshes");
+    std::vector<float> l_vfScales(meshes ? meshes->Size() : 0, 0.0f);
+    const CJson *nodes = GetArray("nodes");
+    if (!nodes) {
+      std::fill(l_vfScales.begin(), l_vfScales.end(), 1.0f);
+      return l_vfScales;
+    }
+
+    auto l_nodeScale = [](const CJson &node) {
+      float scale = 1.0f;
+      if (const CJson *matrix = node.Find("matrix");
+          matrix && matrix->Size() == 16) {
+        scale = 0.0f;
+        for (size_t column = 0; column < 3; column++) {
+          double l_dLength = 0;
+          for (size_t row = 0; row < 3; row++) {
+            const double value =
+                matrix->GetArray()[column * 4 + row].AsNumber();
+            l_dLength += value * value;
+          }
+          scale = std::max(scale, static_cast<float>(std::sqrt(l_dLength)));
+        }
+      } else if (const CJson *factors = node.Find("scale")) {
+        scale = 0.0f;
+        for (const CJson &factor : factors->GetArray())
+          scale = std::max(scale,
+                           static_cast<float>(std::abs(factor.AsNumber())));
+      }
+      return scale;
+    };
+
+    // roots are the nodes nobody lists as a child
+    std::vector<bool> l_vbChild(nodes->Size(), false);
+    for (const CJson &node : nodes->GetArray())
+      if (const CJson *children = node.Find("children"))
+        for (const CJson &child : children->GetArray())
+          if (child.AsInt() >= 0 &&
+              static_cast<size_t>(child.AsInt()) < l_vbChild.size())
+            l_vbChild[static_cast<size_t>(child.AsInt())] = true;
+
+    std::vector<std::pair<size_t, float>> l_vStack;
+    for (size_t n = 0; n < nodes->Size(); n++)
+      if (!l_vbChild[n])
+        l_vStack.emplace_back(n, 1.0f);
+
+    // a broken file could have cycles, every node is entered a bounded
+    // number of times
+    size_t l_uBudget = nodes->Size() * 64;
+    while (!l_vStack.empty() && l_uBudget-- > 0) {
+      auto [n, parentScale] = l_vStack.back();
+      l_vStack.pop_back();
+      const CJson &node = nodes->GetArray()[n];
+      const float scale = parentScale * l_nodeScale(node);
+
+      if (const CJson *mesh = node.Find("mesh"))
+        if (mesh->AsInt() >= 0 &&
+            static_cast<size_t>(mesh->AsInt()) < l_vfScales.size()) {
+          float &slot = l_vfScales[static_cast<size_t>(mesh->AsInt())];
+          slot = std::max(slot, scale);
+        }
+
+      if (const CJson *children = node.Find("children"))
+        for (const CJson &child : children->GetArray())
+          if (child.AsInt() >= 0 &&
+              static_cast<size_t>(child.AsInt()) < nodes->Size())
+            l_vStack.emplace_back(static_cast<size_t>(child.AsInt()), scale);
+    }
+
+    for (float &scale : l_vfScales)
+      if (scale <= 0.0f)
+        scale = 1.0f;
+    return l_vfScales;
+  }
+
+  // normals and uvs per vertex for the simplifier, whatever of them exists
+  static std::vector<float> GetSimplifyAttributes(const SVertexStream &stream,
+                                                  uint32_t &count) {
+    count = 0;
+    std::vector<const SAttribute *> l_vpUsed;
+    for (const SAttribute &attribute : stream.attributes)
+      if ((attribute.name == "NORMAL" || attribute.name == "TEXCOORD_0") &&
+          attribute.componentSize == 4 &&
+          attribute.accessor.Find("componentType")->AsInt() == 5126) {
+        l_vpUsed.push_back(&attribute);
+        count += attribute.elementSize / 4;
+      }
+
+    std::vector<float> l_vfAttributes(size_t(stream.vertexCount) * count);
+    uint32_t l_uOffset = 0;
+    for (const SAttribute *attribute : l_vpUsed) {
+      const uint32_t components = attribute->elementSize / 4;
+      for (size_t v = 0; v < stream.vertexCount; v++)
+        std::memcpy(&l_vfAttributes[v * count + l_uOffset],
+                    attribute->data.data() + v * attribute->elementSize,
+                    attribute->elementSize);
+      l_uOffset += components;
+    }
+    return l_vfAttributes;
+  }
+
+  void SimplifyStream(const SVertexStream &stream,
+                      std::vector<SPrimitive *> &primitives,
+                      const std::vector<float> &meshScales) {
+    const std::vector<float> l_vfPositions = GetPositions(stream);
+    if (l_vfPositions.empty())
+      return;
+
+    float l_min[3], l_max[3];
+    for (size_t c = 0; c < 3; c++)
+      l_min[c] = l_max[c] = l_vfPositions[c];
+    for (size_t v = 1; v < stream.vertexCount; v++)
+      for (size_t c = 0; c < 3; c++) {
+        l_min[c] = std::min(l_min[c], l_vfPositions[v * 3 + c]);
+        l_max[c] = std::max(l_max[c], l_vfPositions[v * 3 + c]);
+      }
+    float l_fDiagonal2 = 0.0f;
+    for (size_t c = 0; c < 3; c++)
+      l_fDiagonal2 += (l_max[c] - l_min[c]) * (l_max[c] - l_min[c]);
+    const float l_fRadius = 0.5f * std::sqrt(l_fDiagonal2);
+
+    uint32_t l_uAttributes = 0;
+    const std::vector<float> l_vfAttributes =
+        GetSimplifyAttributes(stream, l_uAttributes);
+
+    // an attribute difference of 1 weighs like a tenth of the radius, past
+    // a twentieth of the radius a level looks like a different model
+    for (SPrimitive *primitive : primitives) {
+      const size_t l_uTarget =
+          static_cast<size_t>(float(primitive->indices.size() / 3) *
+                              m_fSimplifyRatio) *
+          3;
+      const float error = SimplifyMesh(
+          primitive->indices, l_vfPositions.data(),
+          l_uAttributes ? l_vfAttributes.data() : nullptr, l_uAttributes,
+          0.1f * l_fRadius, stream.vertexCount, l_uTarget, 0.05f * l_fRadius);
+      m_fSimplifyError =
+          std::max(m_fSimplifyError, error * meshScales[primitive->mesh]);
+    }
+  }
+
+  // drops what a simplified level no longer references, the vertex fetch
+  // order already put it at the end
+  static void TrimStream(SVertexStream &stream,
+                         const std::vector<std::vector<uint32_t> *> &indexLists) {
+    uint32_t l_uUsed = 0;
+    for (const std::vector<uint32_t> *indices : indexLists)
+      for (uint32_t index : *indices)
+        l_uUsed = std::max(l_uUsed, index + 1);
+    if (l_uUsed == stream.vertexCount)
+      return;
+
+    for (SAttribute &attribute : stream.attributes) {
+      attribute.data.resize(size_t(l_uUsed) * attribute.elementSize);
+      attribute.accessor["count"] = CJson(l_uUsed);
+    }
+    stream.vertexCount = l_uUsed;
+
+    // min and max of the positions have to stay exact
+    for (SAttribute &attribute : stream.attributes) {
+      if (attribute.name != "POSITION" || !attribute.accessor.Find("min"))
+        continue;
+      const std::vector<float> l_vfPositions = GetPositions(stream);
+      if (l_vfPositions.empty() || l_uUsed == 0)
+        break;
+
+      float l_min[3], l_max[3];
+      for (size_t c = 0; c < 3; c++)
+        l_min[c] = l_max[c] = l_vfPositions[c];
+      for (size_t v = 1; v < l_uUsed; v++)
+        for (size_t c = 0; c < 3; c++) {
+          l_min[c] = std::min(l_min[c], l_vfPositions[v * 3 + c]);
+          l_max[c] = std::max(l_max[c], l_vfPositions[v * 3 + c]);
+        }
+      attribute.accessor["min"] = MakeNumberArray(l_min, 3);
+      attribute.accessor["max"] = MakeNumberArray(l_max, 3);
+    }
+  }
+
+  void Optimize() {
+    std::vector<std::vector<std::vector<uint32_t> *>> l_vvpStreamIndices(
+        m_vStreams.size());
+
+    std::vector<std::vector<SPrimitive *>> l_vvpStreamPrimitives(
+        m_vStreams.size());
+
+    for (SPrimitive &primitive : m_vPrimitives) {
+      const SVertexStream &stream = m_vStreams[primitive.stream];
+      m_statsBefore += AnalyzeVertexCache(primitive.indices, stream.vertexCount);
+      l_vvpStreamIndices[primitive.stream].push_back(&primitive.indices);
+      l_vvpStreamPrimitives[primitive.stream].push_back(&primitive);
+    }
+
+    const bool l_bSimplify = m_fSimplifyRatio < 1.0f;
+    const std::vector<float> l_vfMeshScales =
+        l_bSimplify ? GetMeshScales() : std::vector<float>();
+
+    for (size_t s = 0; s < m_vStreams.size(); s++) {
+      SVertexStream &stream = m_vStreams[s];
+      WeldStream(stream, l_vvpStreamIndices[s]);
+      if (l_bSimplify)
+        SimplifyStream(stream, l_vvpStreamPrimitives[s], l_vfMeshScales);
+      const std::vector<float> l_vfPositions = GetPositions(stream);
+
+      for (std::vector<uint32_t> *indices : l_vvpStreamIndices[s]) {
+        OptimizeVertexCache(*indices, stream.vertexCount);
+        if (!l_vfPositions.empty())
+          OptimizeOverdraw(*indices, l_vfPositions.data(), 3,
+                           stream.vertexCount);
+      }
+
+      const std::vector<uint32_t> l_vuRemap =
+          OptimizeVertexFetch(l_vvpStreamIndices[s], stream.vertexCount);
+      for (SAttribute &attribute : stream.attributes)
+        RemapVertices(attribute.data, attribute.elementSize, l_vuRemap,
+                      stream.vertexCount);
+      if (l_bSimplify)
+        TrimStream(stream, l_vvpStreamIndices[s]);
+
+      // after everything that moves vertices
+      const std::vector<float> l_vfFinalPositions = GetPositions(stream);
+      if (!l_vfFinalPositions.empty())
+        for (SPrimitive *primitive : l_vvpStreamPrimitives[s])
+          BuildMeshlets(primitive->indices, l_vfFinalPositions.data(),
+                        stream.vertexCount, primitive->meshlets);
+    }
+
+    for (const SPrimitive &primitive : m_vPrimitives)
+      m_statsAfter += AnalyzeVertexCache(primitive.indices,
+                                         m_vStreams[primitive.stream].vertexCount);
+  }
+
+  static CJson MakeNumberArray(const float *values, size_t count) {
+    CJson array = CJson::MakeArray();
+    for (size_t i = 0; i < count; i++)
+      array.PushBack(CJson(double(values[i])));
+    return array;
+  }
+
+  // appends at a 4 byte boundary and returns the new view's index
+  uint32_t AddBufferView(const uint8_t *data, size_t size, uint32_t stride,
+                         uint32_t target) {
+    std::vector<uint8_t> &bin = m_glb.bin;
+    bin.resize((bin.size() + 3) & ~size_t(3));
+
+    const size_t offset = bin.size();
+    bin.insert(bin.end(), data, data + size);
+
+    CJson l_view = CJson::MakeObject();
+    l_view["buffer"] = CJson(uint32_t(0));
+    l_view["byteOffset"] = CJson(static_cast<int64_t>(offset));
+    l_view["byteLength"] = CJson(static_cast<int64_t>(size));
+    if (stride)
+      l_view["byteStride"] = CJson(stride);
+    if (target)
+      l_view["target"] = CJson(target);
+
+    CJson &views = m_glb.json["bufferViews"];
+    views.PushBack(std::move(l_view));
+    return static_cast<uint32_t>(views.Size() - 1);
+  }
+
+  uint32_t AddAccessor(CJson accessor) {
+    CJson &accessors = m_glb.json["accessors"];
+    accessors.PushBack(std::move(accessor));
+    return static_cast<uint32_t>(accessors.Size() - 1);
+  }
+
+  CJson &GetPrimitiveJson(const SPrimitive &primitive) {
+    return (*GetArray("meshes"))
+        .GetArray()[primitive.mesh]
+        .Find("primitives")
+        ->GetArray()[primitive.primitive];
+  }
+
+  void Encode() {
+    std::vector<std::vector<uint32_t>> l_vvuStreamAccessors(m_vStreams.size());
+
+    for (size_t s = 0; s < m_vStreams.size(); s++) {
+      const SVertexStream &stream = m_vStreams[s];
+
+      // vertex elements have to start on 4 byte boundaries
+      std::vector<uint32_t> l_vuOffsets;
+      uint32_t l_uStride = 0;
+      for (const SAttribute &attribute : stream.attributes) {
+        l_vuOffsets.push_back(l_uStride);
+        l_uStride += (attribute.elementSize + 3) & ~3u;
+      }
+
+      // the spec caps byteStride at 252, very wide vertices stay planar
+      const bool l_bInterleave = l_uStride <= 252;
+      std::vector<uint32_t> &accessors = l_vvuStreamAccessors[s];
+
+      if (l_bInterleave) {
+        std::vector<uint8_t> l_vuInterleaved(size_t(l_uStride) *
+                                             stream.vertexCount);
+        for (size_t a = 0; a < stream.attributes.size(); a++) {
+          const SAttribute &attribute = stream.attributes[a];
+          for (uint32_t v = 0; v < stream.vertexCount; v++)
+            std::memcpy(l_vuInterleaved.data() + size_t(v) * l_uStride +
+                            l_vuOffsets[a],
+                        attribute.data.data() + size_t(v) * attribute.elementSize,
+                        attribute.elementSize);
+        }
+
+        const uint32_t view =
+            AddBufferView(l_vuInterleaved.data(), l_vuInterleaved.size(),
+                          l_uStride, s_uTargetVertices);
+
+        for (size_t a = 0; a < stream.attributes.size(); a++) {
+          CJson l_accessor = stream.attributes[a].accessor;
+          l_accessor["bufferView"] = CJson(view);
+          l_accessor["byteOffset"] = CJson(l_vuOffsets[a]);
+          accessors.push_back(AddAccessor(std::move(l_accessor)));
+        }
+      } else {
+        for (const SAttribute &attribute : stream.attributes) {
+          const uint32_t view =
+              AddBufferView(attribute.data.data(), attribute.data.size(), 0,
+                            s_uTargetVertices);
+          CJson l_accessor = attribute.accessor;
+          l_accessor["bufferView"] = CJson(view);
+          accessors.push_back(AddAccessor(std::move(l_accessor)));
+        }
+      }
+    }
+
+    bool l_bMeshlets = false;
+    for (const SPrimitive &primitive : m_vPrimitives) {
+      CJson &json = GetPrimitiveJson(primitive);
+      const SVertexStream &stream = m_vStreams[primitive.stream];
+
+      CJson &attributes = json["attributes"];
+      for (size_t a = 0; a < stream.attributes.size(); a++)
+        attributes[stream.attributes[a].name] =
+            CJson(l_vvuStreamAccessors[primitive.stream][a]);
+
+      json["indices"] = CJson(EncodeIndices(primitive.indices));
+
+      if (!primitive.meshlets.empty()) {
+        const uint32_t view = AddBufferView(
+            reinterpret_cast<const uint8_t *>(primitive.meshlets.data()),
+            primitive.meshlets.size() * sizeof(SMeshlet), 0, 0);
+        json["extensions"]["EHAZ_meshlets"]["bufferView"] = CJson(view);
+        l_bMeshlets = true;
+      }
+    }
+
+    // only the viewer reads them, other importers can ignore them
+    if (l_bMeshlets) {
+      CJson &used = m_glb.json["extensionsUsed"];
+      bool found = false;
+      for (const CJson &extension : used.GetArray())
+        found = found || extension.AsString() == "EHAZ_meshlets";
+      if (!found)
+        used.PushBack(CJson("EHAZ_meshlets"));
+    }
+  }
+
+  uint32_t EncodeIndices(const std::vector<uint32_t> &indices) {
+    uint32_t l_uMax = 0;
+    for (uint32_t index : indices)
+      l_uMax = std::max(l_uMax, index);
+
+    uint32_t view = 0;
+    uint32_t componentType = 5125;
+    if (l_uMax <= UINT16_MAX) {
+      std::vector<uint16_t> l_vuShort(indices.begin(), indices.end());
+      componentType = 5123;
+      view = AddBufferView(reinterpret_cast<const uint8_t *>(l_vuShort.data()),
+                           l_vuShort.size() * sizeof(uint16_t), 0,
+                           s_uTargetIndices);
+    } else {
+      view = AddBufferView(reinterpret_cast<const uint8_t *>(indices.data()),
+                           indices.size() * sizeof(uint32_t), 0,
+                           s_uTargetIndices);
+    }
+
+    CJson l_accessor = CJson::MakeObject();
+    l_accessor["bufferView"] = CJson(view);
+    l_accessor["componentType"] = CJson(componentType);
+    l_accessor["count"] = CJson(static_cast<uint32_t>(indices.size()));
+    l_accessor["type"] = CJson("SCALAR");
+    return AddAccessor(std::move(l_accessor));
+  }
+
+  // calls func on every json value that holds an accessor index
+  template <typename F> void ForEachAccessorRef(F &&func) {
+    if (CJson *meshes = GetArray("meshes"))
+      for (CJson &mesh : meshes->GetArray()) {
+        CJson *primitives = mesh.Find("primitives");
+        if (!primitives)
+          continue;
+        for (CJson &primitive : primitives->GetArray()) {
+          if (CJson *indices = primitive.Find("indices"))
+            func(*indices);
+          if (CJson *attributes = primitive.Find("attributes"))
+            for (CJson::Member &attribute : attributes->GetMembers())
+              func(attribute.second);
+          if (CJson *targets = primitive.Find("targets"))
+            for (CJson &target : targets->GetArray())
+              for (CJson::Member &attribute : target.GetMembers())
+                func(attribute.second);
+        }
+      }
+
+    if (CJson *skins = GetArray("skins"))
+      for (CJson &skin : skins->GetArray())
+        if (CJson *matrices = skin.Find("inverseBindMatrices"))
+          func(*matrices);
+
+    if (CJson *animations = GetArray("animations"))
+      for (CJson &animation : animations->GetArray())
+        if (CJson *samplers = animation.Find("samplers"))
+          for (CJson &sampler : samplers->GetArray()) {
+            if (CJson *input = sampler.Find("input"))
+              func(*input);
+            if (CJson *output = sampler.Find("output"))
+              func(*output);
+          }
+  }
+
+  // calls func on every json value that holds a bufferView index
+  template <typename F> void ForEachViewRef(F &&func) {
+    if (CJson *accessors = GetArray("accessors"))
+      for (CJson &accessor : accessors->GetArray()) {
+        if (CJson *view = accessor.Find("bufferView"))
+          func(*view);
+        if (CJson *sparse = accessor.Find("sparse")) {
+          for (const char *part : {"indices", "values"})
+            if (CJson *object = sparse->Find(part))
+              if (CJson *view = object->Find("bufferView"))
+                func(*view);
+        }
+      }
+
+    if (CJson *images = GetArray("images"))
+      for (CJson &image : images->GetArray())
+        if (CJson *view = image.Find("bufferView"))
+          func(*view);
+
+    if (CJson *meshes = GetArray("meshes"))
+      for (CJson &mesh : meshes->GetArray())
+        if (CJson *primitives = mesh.Find("primitives"))
+          for (CJson &primitive : primitives->GetArray())
+            if (CJson *extensions = primitive.Find("extensions"))
+              if (CJson *meshlets = extensions->Find("EHAZ_meshlets"))
+                if (CJson *view = meshlets->Find("bufferView"))
+                  func(*view);
+  }
+
+  // keeps only what something still points at and renumbers it
+  static std::vector<int64_t> BuildRemap(std::vector<CJson> &items,
+                                         const std::vector<bool> &used) {
+    std::vector<int64_t> l_viRemap(items.size(), -1);
+    std::vector<CJson> l_vKept;
+    for (size_t i = 0; i < items.size(); i++) {
+      if (!used[i])
+        continue;
+      l_viRemap[i] = static_cast<int64_t>(l_vKept.size());
+      l_vKept.push_back(std::move(items[i]));
+    }
+    items = std::move(l_vKept);
+    return l_viRemap;
+  }
+
+  void Compact() {
+    CJson *accessors = GetArray("accessors");
+    if (accessors) {
+      std::vector<bool> l_vbUsed(accessors->Size(), false);
+      ForEachAccessorRef([&](CJson &ref) {
+        const int64_t index = ref.AsInt();
+        if (index >= 0 && static_cast<size_t>(index) < l_vbUsed.size())
+          l_vbUsed[static_cast<size_t>(index)] = true;
+      });
+
+      auto l_viRemap = BuildRemap(accessors->GetArray(), l_vbUsed);
+      ForEachAccessorRef([&](CJson &ref) {
+        const int64_t index = ref.AsInt();
+        if (index >= 0 && static_cast<size_t>(index) < l_viRemap.size())
+          ref = CJson(l_viRemap[static_cast<size_t>(index)]);
+      });
+    }
+
+    CJson *views = GetArray("bufferViews");
+    if (!views)
+      return;
+
+    std::vector<bool> l_vbUsed(views->Size(), false);
+    ForEachViewRef([&](CJson &ref) {
+      const int64_t index = ref.AsInt();
+      if (index >= 0 && static_cast<size_t>(index) < l_vbUsed.size())
+        l_vbUsed[static_cast<size_t>(index)] = true;
+    });
+
+    auto l_viRemap = BuildRemap(views->GetArray(), l_vbUsed);
+    ForEachViewRef([&](CJson &ref) {
+      const int64_t index = ref.AsInt();
+      if (index >= 0 && static_cast<size_t>(index) < l_viRemap.size())
+        ref = CJson(l_viRemap[static_cast<size_t>(index)]);
+    });
+
+    // the surviving views are copied into a fresh BIN chunk
+    std::vector<uint8_t> l_vuBin;
+    l_vuBin.reserve(m_glb.bin.size());
+    for (CJson &view : views->GetArray()) {
+      const uint64_t offset = CGlbFile::GetOptional(view, "byteOffset");
+      const uint64_t length = CGlbFile::GetOptional(view, "byteLength");
+      if (offset + length > m_glb.bin.size())
+        continue; // GetAccessor already refuses these
+
+      l_vuBin.resize((l_vuBin.size() + 3) & ~size_t(3));
+      view["byteOffset"] = CJson(static_cast<int64_t>(l_vuBin.size()));
+      l_vuBin.insert(l_vuBin.end(), m_glb.bin.begin() + static_cast<ptrdiff_t>(offset),
+                     m_glb.bin.begin() + static_cast<ptrdiff_t>(offset + length));
+    }
+    m_glb.bin = std::move(l_vuBin);
+
+    CJson &buffers = m_glb.json["buffers"];
+    if (buffers.Size() == 0)
+      buffers.PushBack(CJson::MakeObject());
+    buffers.GetArray()[0]["byteLength"] =
+        CJson(static_cast<int64_t>(m_glb.bin.size()));
+  }
+};
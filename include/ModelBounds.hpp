@@ -0,0 +1,130 @@
+#pragma once
+
+#include "Json.hpp"
+#include "Meshlets.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+// the box around a glTF model in the space it is submitted in, from the
+// min and max every POSITION accessor has to carry. each node that draws a
+// mesh puts the corners of its primitives' boxes through its world matrix,
+// so the box can be looser than the vertices but never tighter. skinned
+// meshes are posed by their joints and taken as they are stored. false if
+// no node draws a primitive with bounds.
+inline bool GetModelBounds(const CJson &json, float min[3], float max[3]) {
+  const CJson *meshes = json.Find("meshes");
+  const CJson *nodes = json.Find("nodes");
+  const CJson *accessors = json.Find("accessors");
+  if (!meshes || !nodes || !accessors)
+    return false;
+
+  // the box of every mesh in its own space
+  struct SBox {
+    float min[3], max[3];
+    bool valid = false;
+  };
+  std::vector<SBox> l_vMeshBoxes(meshes->Size());
+  for (size_t m = 0; m < meshes->Size(); m++) {
+    const CJson *primitives = meshes->GetArray()[m].Find("primitives");
+    if (!primitives)
+      continue;
+
+    SBox &box = l_vMeshBoxes[m];
+    for (const CJson &primitive : primitives->GetArray()) {
+      const CJson *attributes = primitive.Find("attributes");
+      const CJson *position = attributes ? attributes->Find("POSITION")
+                                         : nullptr;
+      if (!position || position->AsInt() < 0 ||
+          static_cast<size_t>(position->AsInt()) >= accessors->Size())
+        continue;
+
+      const CJson &accessor =
+          accessors->GetArray()[static_cast<size_t>(position->AsInt())];
+      const CJson *low = accessor.Find("min");
+      const CJson *high = accessor.Find("max");
+      if (!low || !high || low->Size() != 3 || high->Size() != 3)
+        continue;
+
+      for (size_t c = 0; c < 3; c++) {
+        const float l_fLow = static_cast<float>(low->GetArray()[c].AsNumber());
+        const float l_fHigh =
+            static_cast<float>(high->GetArray()[c].AsNumber());
+        box.min[c] = box.valid ? std::min(box.min[c], l_fLow) : l_fLow;
+        box.max[c] = box.valid ? std::max(box.max[c], l_fHigh) : l_fHigh;
+      }
+      box.valid = true;
+    }
+  }
+
+  std::vector<bool> l_vbChild(nodes->Size(), false);
+  for (const CJson &node : nodes->GetArray())
+    if (const CJson *children = node.Find("children"))
+      for (const CJson &child : children->GetArray())
+        if (child.AsInt() >= 0 &&
+            static_cast<size_t>(child.AsInt()) < l_vbChild.size())
+          l_vbChild[static_cast<size_t>(child.AsInt())] = true;
+
+  struct SVisit {
+    size_t node;
+    float matrix[16];
+  };
+  std::vector<SVisit> l_vStack;
+  for (size_t n = 0; n < nodes->Size(); n++)
+    if (!l_vbChild[n]) {
+      SVisit &visit = l_vStack.emplace_back();
+      visit.node = n;
+      GetNodeMatrix(CJson::MakeObject(), visit.matrix);
+    }
+
+  bool l_bFound = false;
+  // cycles in a broken file end with the budget
+  size_t l_uBudget = nodes->Size() * 64;
+  while (!l_vStack.empty() && l_uBudget-- > 0) {
+    SVisit visit = l_vStack.back();
+    l_vStack.pop_back();
+    const CJson &node = nodes->GetArray()[visit.node];
+
+    float l_local[16];
+    GetNodeMatrix(node, l_local);
+    MultiplyMatrix(visit.matrix, l_local, visit.matrix);
+
+    const CJson *mesh = node.Find("mesh");
+    if (mesh && mesh->AsInt() >= 0 &&
+        static_cast<size_t>(mesh->AsInt()) < l_vMeshBoxes.size()) {
+      const SBox &box = l_vMeshBoxes[static_cast<size_t>(mesh->AsInt())];
+      float l_matrix[16];
+      if (node.Find("skin"))
+        GetNodeMatrix(CJson::MakeObject(), l_matrix);
+      else
+        std::memcpy(l_matrix, visit.matrix, sizeof(l_matrix));
+
+      for (size_t corner = 0; box.valid && corner < 8; corner++) {
+        const float l_point[3] = {corner & 1 ? box.max[0] : box.min[0],
+                                  corner & 2 ? box.max[1] : box.min[1],
+                                  corner & 4 ? box.max[2] : box.min[2]};
+        for (size_t row = 0; row < 3; row++) {
+          const float value = l_matrix[row] * l_point[0] +
+                              l_matrix[4 + row] * l_point[1] +
+                              l_matrix[8 + row] * l_point[2] +
+                              l_matrix[12 + row];
+          min[row] = l_bFound ? std::min(min[row], value) : value;
+          max[row] = l_bFound ? std::max(max[row], value) : value;
+        }
+        // set once the first corner has filled every row
+        l_bFound = true;
+      }
+    }
+
+    if (const CJson *children = node.Find("children"))
+      for (const CJson &child : children->GetArray())
+        if (child.AsInt() >= 0 &&
+            static_cast<size_t>(child.AsInt()) < nodes->Size()) {
+          SVisit &next = l_vStack.emplace_back();
+          next.node = static_cast<size_t>(child.AsInt());
+          std::memcpy(next.matrix, visit.matrix, sizeof(visit.matrix));
+        }
+  }
+  return l_bFound;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+// keeps recently viewed models resident so going back to one is a pointer
+// swap. entries are keyed by path and validated against the file's mtime and
+// size, a re-exported file is loaded again. when the byte budget is exceeded
+// the least recently used entries are handed to the evict callback.
+template <typename TModel> class CModelCache {
+public:
+  using ModelPtr = std::shared_ptr<TModel>;
+  using EvictFunc = std::function<void(const ModelPtr &model)>;
+
+  void SetBudget(uint64_t bytes) { m_uBudget = bytes; }
+  void SetEvictCallback(EvictFunc evict) { m_evict = std::move(evict); }
+
+  bool IsEnabled() const { return m_uBudget > 0; }
+  uint64_t GetUsedBytes() const { return m_uUsed; }
+  size_t GetCount() const { return m_lEntries.size(); }
+
+  // returns the cached model and marks it as most recently used
+  ModelPtr Get(const std::string &path) {
+    auto found = m_mapEntries.find(path);
+    if (found == m_mapEntries.end())
+      return nullptr;
+
+    SFileStamp l_stamp = GetStamp(path);
+    if (l_stamp != found->second->stamp) {
+      Evict(found->second);
+      return nullptr;
+    }
+
+    m_lEntries.splice(m_lEntries.begin(), m_lEntries, found->second);
+    return found->second->model;
+  }
+
+  // bytes is the estimated resident cost of the model. the newly inserted
+  // model is never evicted, even if it alone is over the budget.
+  void Insert(const std::string &path, const ModelPtr &model, uint64_t bytes) {
+    if (!IsEnabled())
+      return;
+
+    if (auto found = m_mapEntries.find(path); found != m_mapEntries.end())
+      Evict(found->second);
+
+    m_lEntries.push_front({path, GetStamp(path), bytes, model});
+    m_mapEntries[path] = m_lEntries.begin();
+    m_uUsed += bytes;
+
+    while (m_uUsed > m_uBudget && m_lEntries.size() > 1)
+      Evict(std::prev(m_lEntries.end()));
+  }
+
+  bool Contains(const std::string &path) const {
+    return m_mapEntries.contains(path);
+  }
+
+  void Clear() {
+    while (!m_lEntries.empty())
+      Evict(std::prev(m_lEntries.end()));
+  }
+
+  static uint64_t GetFileSize(const std::string &path) {
+    std::error_code ec;
+    uint64_t size = std::filesystem::file_size(path, ec);
+    return ec ? 0 : size;
+  }
+
+private:
+  struct SFileStamp {
+    int64_t mtime = 0;
+    uint64_t size = 0;
+    bool operator==(const SFileStamp &) const = default;
+  };
+
+  struct SEntry {
+    std::string path;
+    SFileStamp stamp;
+    uint64_t bytes;
+    ModelPtr model;
+  };
+
+  using EntryIt = typename std::list<SEntry>::iterator;
+
+  std::list<SEntry> m_lEntries; // front = most recently used
+  std::unordered_map<std::string, EntryIt> m_mapEntries;
+  uint64_t m_uBudget = 0;
+  uint64_t m_uUsed = 0;
+  EvictFunc m_evict;
+
+  static SFileStamp GetStamp(const std::string &path) {
+    std::error_code ec;
+    SFileStamp stamp;
+    auto time = std::filesystem::last_write_time(path, ec);
+    if (!ec)
+      stamp.mtime = static_cast<int64_t>(time.time_since_epoch().count());
+    stamp.size = GetFileSize(path);
+    return stamp;
+  }
+
+  void Evict(EntryIt it) {
+    if (m_evict)
+      m_evict(it->model);
+
+    m_uUsed -= it->bytes;
+    m_mapEntries.erase(it->path);
+    m_lEntries.erase(it);
+  }
+};
@@ -0,0 +1,279 @@
+#pragma once
+
+#include "BakeCache.hpp"
+#include "GlbFile.hpp"
+#include "HazModelFile.hpp"
+#include "MappedFile.hpp"
+#include "Meshlets.hpp"
+#include "TextureDecodePool.hpp"
+#include <SDL3/SDL_log.h>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <fcntl.h>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// reads the file once so it sits in the page cache when the render thread
+// opens it. keepGoing is asked after every chunk, returns false if it said
+// no before the end of the file.
+template <typename F>
+inline bool ReadIntoPageCache(const std::string &path, std::vector<char> &chunk,
+                              F &&keepGoing) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return true; // let the real loader report the error
+
+  ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  chunk.resize(1 << 20);
+
+  bool finished = true;
+  while (::read(fd, chunk.data(), chunk.size()) > 0) {
+    if (!keepGoing()) {
+      finished = false;
+      break;
+    }
+  }
+
+  ::close(fd);
+  return finished;
+}
+
+// a file the loader thread got ready for the render thread, its bytes are
+// in the page cache
+struct SStagedModel {
+  std::string path;
+  std::string bakedPath; // loaded instead of path if the cache has a bake
+  std::string error; // empty if the file looked fine
+  SModelMeshlets meshlets; // empty unless a .glb bake was staged
+  SModelTextures textures; // what the bake deferred, decoded
+
+  const std::string &GetLoadPath() const {
+    return bakedPath.empty() ? path : bakedPath;
+  }
+};
+
+inline constexpr std::string_view s_hazModelExt = ".hzmdl";
+
+// gets one file ready to be loaded without blocking on I/O, shared by the
+// loader and the prefetcher. returns false if keepGoing said no.
+template <typename F>
+inline bool StageModelFile(const std::string &path, SStagedModel &staged,
+                           std::vector<char> &chunk, F &&keepGoing) {
+  if (std::filesystem::path(path).extension() != s_hazModelExt)
+    return ReadIntoPageCache(path, chunk, keepGoing);
+
+  // .hzmdl files only have their archive header checked here, so a
+  // truncated or foreign file is rejected before it reaches the render
+  // thread. LoadHazModel reads and deserializes the whole file itself, the
+  // mapping only touches the first page and nothing else is read ahead.
+  CMappedFile l_file;
+  if (!l_file.Open(path)) {
+    staged.error = "could not map file";
+    return true;
+  }
+  ValidateHazModel(l_file, staged.error);
+  return true;
+}
+
+// only bakes have meshlets and deferred textures, reading them parses the
+// file once more while it is still in the page cache. the textures decode on
+// texturePool, or one after another on this thread without one, and come
+// from textureCache where it has them. returns false if keepGoing said no.
+template <typename F>
+inline bool ReadBakeExtras(SStagedModel &staged,
+                           CTextureDecodePool *texturePool,
+                           CTextureCache *textureCache, F &&keepGoing) {
+  const std::filesystem::path l_path = staged.bakedPath;
+  CGlbFile l_glb;
+  std::string l_sError;
+  if (l_path.extension() != ".glb" || !l_glb.Load(l_path, l_sError))
+    return true;
+
+  LoadModelMeshlets(l_glb.json, l_glb.bin, staged.meshlets);
+  if (texturePool)
+    return texturePool->Decode(l_glb, l_path.parent_path(), true,
+                               staged.textures, textureCache, keepGoing);
+  return DecodeModelTextures(l_glb, l_path.parent_path(), true,
+                             staged.textures, nullptr, textureCache,
+                             keepGoing);
+}
+
+// bakes on the calling loader thread, one baker per thread. SDL_Log keeps
+// the lines of concurrent bakes from interleaving.
+inline bool BakeForStage(const std::string &source,
+                         const std::filesystem::path &target) {
+  thread_local CModelBaker l_baker;
+
+  std::string l_sError;
+  if (!l_baker.Bake(source, target, l_sError)) {
+    SDL_Log("not baking %s: %s", source.c_str(), l_sError.c_str());
+    return false;
+  }
+
+  SDL_Log("baked %s, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", source.c_str(),
+          l_baker.GetStatsBefore().GetACMR(), l_baker.GetStatsAfter().GetACMR(),
+          l_baker.GetStatsBefore().GetATVR(),
+          l_baker.GetStatsAfter().GetATVR());
+  return true;
+}
+
+// stages staged.path, or its bake if bakeCache has one. hashing the source
+// reads it anyway, so it doubles as the page cache warm up when there is no
+// bake.
+template <typename F>
+inline bool StageModel(SStagedModel &staged, std::vector<char> &chunk,
+                       CBakeCache *bakeCache, CTextureDecodePool *texturePool,
+                       F &&keepGoing) {
+  if (!bakeCache ||
+      std::filesystem::path(staged.path).extension() == s_hazModelExt)
+    return StageModelFile(staged.path, staged, chunk, keepGoing);
+
+  uint64_t l_uHash = 0;
+  if (!bakeCache->LookupHash(staged.path, l_uHash)) {
+    if (!CBakeCache::HashFile(staged.path, chunk, l_uHash, keepGoing))
+      return keepGoing(); // unreadable, let the real loader report it
+    bakeCache->Remember(staged.path, l_uHash);
+  }
+
+  std::filesystem::path l_baked = bakeCache->Find(l_uHash);
+
+  if (l_baked.empty() && bakeCache->GetBakeMissing() &&
+      std::filesystem::path(staged.path).extension() == ".glb") {
+    std::filesystem::path l_target = bakeCache->GetBakedPath(l_uHash, ".glb");
+    if (BakeForStage(staged.path, l_target))
+      l_baked = l_target;
+  }
+  if (l_baked.empty())
+    return StageModelFile(staged.path, staged, chunk, keepGoing);
+
+  staged.bakedPath = l_baked.string();
+  if (!StageModelFile(staged.bakedPath, staged, chunk, keepGoing))
+    return false;
+  if (staged.error.empty())
+    return ReadBakeExtras(staged, texturePool,
+                            bakeCache->GetTextureCache(), keepGoing);
+
+  // a broken bake must not hide a good source
+  staged.bakedPath.clear();
+  staged.error.clear();
+  return StageModelFile(staged.path, staged, chunk, keepGoing);
+}
+
+// stages model files on a loader thread so the render thread never waits on
+// the disk. only the newest request matters: asking for another path while
+// one is still being read abandons the old one at the next chunk.
+// the previous model stays on screen until TakeReady hands out the new file.
+// a bake's deferred textures are decoded on a pool of textureThreads while
+// the thread waits.
+class CModelLoader {
+public:
+  explicit CModelLoader(CBakeCache *bakeCache = nullptr,
+                        uint32_t textureThreads = 0)
+      : m_pBakeCache(bakeCache), m_texturePool(textureThreads),
+        m_thread([this] { Run(); }) {}
+
+  ~CModelLoader() {
+    {
+      std::lock_guard<std::mutex> lock(m_mtx);
+      m_bStop = true;
+      m_uGeneration++;
+    }
+    m_cv.notify_one();
+    m_thread.join();
+  }
+
+  CModelLoader(const CModelLoader &) = delete;
+  CModelLoader &operator=(const CModelLoader &) = delete;
+
+  // supersedes whatever was requested before
+  void Request(std::string path) {
+    {
+      std::lock_guard<std::mutex> lock(m_mtx);
+      m_sRequested = std::move(path);
+      m_uGeneration++;
+      m_bReady = false;
+    }
+    m_cv.notify_one();
+  }
+
+  // a file staged elsewhere, read ahead by the prefetcher, supersedes the
+  // request and is ready right away
+  void Supply(SStagedModel staged) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_sRequested = staged.path;
+    m_ready = std::move(staged);
+    m_bReady = true;
+    m_uFinished = ++m_uGeneration;
+  }
+
+  // render thread, true once the latest request can be loaded without
+  // blocking on I/O
+  bool TakeReady(SStagedModel &staged) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (!m_bReady)
+      return false;
+
+    staged = std::move(m_ready);
+    m_bReady = false;
+    return true;
+  }
+
+  bool IsBusy() const {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_uGeneration != m_uFinished || m_bReady;
+  }
+
+private:
+  mutable std::mutex m_mtx;
+  std::condition_variable m_cv;
+
+  std::string m_sRequested;
+  SStagedModel m_ready;
+  uint64_t m_uGeneration = 0; // bumped on every request
+  uint64_t m_uFinished = 0;   // last generation the thread is done with
+  bool m_bReady = false;
+  bool m_bStop = false;
+
+  CBakeCache *m_pBakeCache;
+  std::vector<char> m_vcChunk;
+  CTextureDecodePool m_texturePool;
+  std::thread m_thread; // last, starts after everything above exists
+
+  bool IsCurrent(uint64_t generation) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return generation == m_uGeneration;
+  }
+
+  void Run() {
+    std::unique_lock<std::mutex> lock(m_mtx);
+
+    while (true) {
+      m_cv.wait(lock, [this] { return m_bStop || m_uGeneration != m_uFinished; });
+      if (m_bStop)
+        return;
+
+      const uint64_t generation = m_uGeneration;
+      SStagedModel l_staged;
+      l_staged.path = m_sRequested;
+
+      lock.unlock();
+      bool current =
+          StageModel(l_staged, m_vcChunk, m_pBakeCache, &m_texturePool,
+                     [&] { return IsCurrent(generation); });
+      lock.lock();
+
+      if (current && generation == m_uGeneration) {
+        m_ready = std::move(l_staged);
+        m_bReady = true;
+      }
+      // a supplied file may have finished a newer generation meanwhile
+      m_uFinished = std::max(m_uFinished, generation);
+    }
+  }
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "FileSystem.hpp"
+#include "FrameLimiter.hpp"
+#include <cstdint>
+#include <cstdio>
+
+// time that only moves when the limiter reads or sleeps, or a simulated
+// frame works
+struct SFakeClock {
+  uint64_t time = 1'000'000'000;
+  uint64_t oversleep = 0; // added to every sleep, like a real scheduler
+
+  uint64_t Now() { return time += 1'000; } // a read takes a microsecond
+  void SleepFor(uint64_t ns) { time += ns + oversleep; }
+};
+
+// --pacing-bench: runs every limiter mode on a fake clock with the same
+// simulated frames, 6 to 10 ms of work and a 10 ms spike every 50th, with
+// input every millisecond and a 60 Hz display for VSync. prints the frame
+// time and input to swap latency each mode gives, without a window.
+inline int RunPacingBenchmark(const CFileSystem &fileSystem) {
+  static constexpr uint32_t s_uFrames = 2000;
+  static constexpr uint64_t s_uInputPeriod = 1'000'000;
+  static constexpr uint64_t s_uRefresh = 1'000'000'000 / 60;
+  static constexpr const char *s_modeNames[] = {"vsync", "fixed", "adaptive",
+                                                "off"};
+
+  std::printf("%-9s %8s %14s %14s\n", "mode", "fps", "frame p50/p99",
+              "latency p50/p99");
+  for (EFrameLimit mode : {EFrameLimit::VSync, EFrameLimit::Fixed,
+                           EFrameLimit::Adaptive, EFrameLimit::Off}) {
+    SFakeClock l_clock;
+    l_clock.oversleep = 500'000;
+    CFrameLimiter<SFakeClock> l_limiter(mode, fileSystem.maxFps, l_clock);
+    SFakeClock &clock = l_limiter.GetClock();
+
+    uint32_t l_uSeed = 12345;
+    uint64_t l_uNextInput = clock.time;
+    const uint64_t l_uStart = clock.time;
+    for (uint32_t frame = 0; frame < s_uFrames; frame++) {
+      l_limiter.BeginFrame();
+
+      // every input since the last frame is read at once, the oldest is
+      // the one that waited longest
+      const uint64_t l_uOldest = l_uNextInput;
+      const bool l_bInput = l_uNextInput <= clock.time;
+      while (l_uNextInput <= clock.time)
+        l_uNextInput += s_uInputPeriod;
+
+      l_uSeed = l_uSeed * 1664525 + 1013904223;
+      clock.time += 6'000'000 + (l_uSeed >> 8) % 4'000'000;
+      if (frame % 50 == 49)
+        clock.time += 10'000'000;
+      if (mode == EFrameLimit::VSync)
+        clock.time = (clock.time + s_uRefresh - 1) / s_uRefresh * s_uRefresh;
+
+      l_limiter.EndFrame();
+      if (l_bInput)
+        l_limiter.AddInputLatency(l_uOldest);
+    }
+
+    const CFrameHistogram &frames = l_limiter.GetFrameTimes();
+    const CFrameHistogram &latency = l_limiter.GetInputLatency();
+    std::printf("%-9s %8.1f %6.2f/%6.2f ms %6.2f/%6.2f ms\n",
+                s_modeNames[static_cast<size_t>(mode)],
+                double(s_uFrames) * 1e9 / double(clock.time - l_uStart),
+                frames.GetPercentileMs(0.5), frames.GetPercentileMs(0.99),
+                latency.GetPercentileMs(0.5), latency.GetPercentileMs(0.99));
+  }
+  return 0;
+}
@@ -0,0 +1,289 @@
+#pragma once
+
+#include "Hash.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// file list storage. every directory is interned once, file names live in
+// one contiguous char arena and an entry is just (dir, offset, length), so a
+// million files cost a handful of allocations instead of a million.
+// ids are stable: removing a file leaves a hole that is never reused until
+// Clear().
+class CPathTable {
+public:
+  static constexpr uint32_t s_uInvalid = UINT32_MAX;
+
+  uint32_t GetIdCount() const { return static_cast<uint32_t>(m_vEntries.size()); }
+  size_t GetCount() const { return m_uAlive; }
+
+  bool IsAlive(uint32_t id) const {
+    return id < m_vEntries.size() && m_vEntries[id].dir != s_uInvalid;
+  }
+
+  std::string_view GetDir(uint32_t id) const {
+    return m_dqDirs[m_vEntries[id].dir];
+  }
+
+  // directories are interned, files in the same one share the dir id
+  uint32_t GetDirId(uint32_t id) const { return m_vEntries[id].dir; }
+  uint32_t GetDirCount() const { return static_cast<uint32_t>(m_dqDirs.size()); }
+  std::string_view GetDirPath(uint32_t dirId) const { return m_dqDirs[dirId]; }
+
+  std::string_view GetName(uint32_t id) const {
+    const SEntry &entry = m_vEntries[id];
+    return {m_vcNames.data() + entry.nameOffset, entry.nameLen};
+  }
+
+  // builds the full relative path into out, reusing its capacity
+  void GetPath(uint32_t id, std::string &out) const {
+    out.assign(GetDir(id));
+    out.append(GetName(id));
+  }
+
+  bool PathEquals(uint32_t id, std::string_view path) const {
+    std::string_view dir = GetDir(id);
+    std::string_view name = GetName(id);
+    return path.size() == dir.size() + name.size() && path.starts_with(dir) &&
+           path.substr(dir.size()) == name;
+  }
+
+  // dir has to end with '/' (or be empty for the root). returns the id of
+  // the existing entry if the path is already in the table.
+  uint32_t Add(std::string_view dir, std::string_view name) {
+    const uint32_t l_uDir = InternDir(dir);
+
+    uint32_t l_uFound = FindInDir(l_uDir, name);
+    if (l_uFound != s_uInvalid)
+      return l_uFound;
+
+    SEntry entry;
+    entry.dir = l_uDir;
+    entry.nameOffset = static_cast<uint32_t>(m_vcNames.size());
+    entry.nameLen = static_cast<uint32_t>(name.size());
+
+    Grow(m_vcNames, name.size());
+    m_vcNames.insert(m_vcNames.end(), name.begin(), name.end());
+
+    const uint32_t id = GetIdCount();
+    Grow(m_vEntries, 1);
+    m_vEntries.push_back(entry);
+    m_uAlive++;
+
+    InsertSlot(id);
+    return id;
+  }
+
+  uint32_t Add(std::string_view path) {
+    auto [dir, name] = SplitPath(path);
+    return Add(dir, name);
+  }
+
+  uint32_t Find(std::string_view path) const {
+    auto [dir, name] = SplitPath(path);
+    auto found = m_mapDirs.find(dir);
+    if (found == m_mapDirs.end())
+      return s_uInvalid;
+    return FindInDir(found->second, name);
+  }
+
+  bool Remove(uint32_t id) {
+    if (!IsAlive(id))
+      return false;
+
+    EraseSlot(id);
+    m_vEntries[id].dir = s_uInvalid;
+    m_uAlive--;
+    return true;
+  }
+
+  // removes every file at or below dirPrefix (which ends with '/')
+  size_t RemoveDir(std::string_view dirPrefix) {
+    std::vector<bool> l_vbMatch(m_dqDirs.size());
+    bool l_bAny = false;
+    for (size_t i = 0; i < m_dqDirs.size(); i++) {
+      l_vbMatch[i] = m_dqDirs[i].starts_with(dirPrefix);
+      l_bAny = l_bAny || l_vbMatch[i];
+    }
+
+    if (!l_bAny)
+      return 0;
+
+    size_t removed = 0;
+    for (uint32_t id = 0; id < GetIdCount(); id++) {
+      if (IsAlive(id) && l_vbMatch[m_vEntries[id].dir]) {
+        Remove(id);
+        removed++;
+      }
+    }
+    return removed;
+  }
+
+  void Clear() {
+    m_vEntries.clear();
+    m_vcNames.clear();
+    m_vuSlots.clear();
+    m_dqDirs.clear();
+    m_mapDirs.clear();
+    m_uAlive = 0;
+    m_uDeletedSlots = 0;
+  }
+
+  // lexicographic order of the full paths, without building them
+  bool Less(uint32_t a, uint32_t b) const {
+    std::string_view lhs[2] = {GetDir(a), GetName(a)};
+    std::string_view rhs[2] = {GetDir(b), GetName(b)};
+    if (m_vEntries[a].dir == m_vEntries[b].dir)
+      return lhs[1] < rhs[1];
+
+    size_t li = 0, ri = 0;
+    while (true) {
+      while (li < 2 && lhs[li].empty())
+        li++;
+      while (ri < 2 && rhs[ri].empty())
+        ri++;
+      if (li == 2 || ri == 2)
+        return li == 2 && ri != 2;
+
+      size_t len = std::min(lhs[li].size(), rhs[ri].size());
+      int cmp = std::memcmp(lhs[li].data(), rhs[ri].data(), len);
+      if (cmp != 0)
+        return cmp < 0;
+
+      lhs[li].remove_prefix(len);
+      rhs[ri].remove_prefix(len);
+    }
+  }
+
+  // bytes held by the table and how often its storage had to grow
+  size_t GetMemoryUsage() const {
+    size_t bytes = m_vEntries.capacity() * sizeof(SEntry) +
+                   m_vcNames.capacity() + m_vuSlots.capacity() * sizeof(uint32_t);
+    for (const std::string &dir : m_dqDirs)
+      bytes += sizeof(std::string) + dir.capacity();
+    return bytes;
+  }
+
+  size_t GetAllocationCount() const { return m_uAllocations + m_dqDirs.size(); }
+
+private:
+  struct SEntry {
+    uint32_t dir;
+    uint32_t nameOffset;
+    uint32_t nameLen;
+  };
+
+  static constexpr uint32_t s_uEmptySlot = UINT32_MAX;
+  static constexpr uint32_t s_uDeletedSlot = UINT32_MAX - 1;
+
+  std::vector<SEntry> m_vEntries;
+  std::vector<char> m_vcNames;
+
+  // deque keeps the strings in place so the map can view into them
+  std::deque<std::string> m_dqDirs;
+  std::unordered_map<std::string_view, uint32_t> m_mapDirs;
+
+  // open addressing set of entry ids keyed by (dir, name)
+  std::vector<uint32_t> m_vuSlots;
+  size_t m_uDeletedSlots = 0;
+
+  size_t m_uAlive = 0;
+  size_t m_uAllocations = 0;
+
+  static std::pair<std::string_view, std::string_view>
+  SplitPath(std::string_view path) {
+    size_t slash = path.rfind('/');
+    if (slash == std::string_view::npos)
+      return {std::string_view(), path};
+    return {path.substr(0, slash + 1), path.substr(slash + 1)};
+  }
+
+  template <typename T> void Grow(std::vector<T> &vec, size_t extra) {
+    if (vec.size() + extra <= vec.capacity())
+      return;
+    vec.reserve(std::max(vec.capacity() * 2, vec.size() + extra));
+    m_uAllocations++;
+  }
+
+  uint32_t InternDir(std::string_view dir) {
+    auto found = m_mapDirs.find(dir);
+    if (found != m_mapDirs.end())
+      return found->second;
+
+    const uint32_t id = static_cast<uint32_t>(m_dqDirs.size());
+    m_dqDirs.emplace_back(dir);
+    m_mapDirs.emplace(m_dqDirs.back(), id);
+    return id;
+  }
+
+  static uint64_t HashEntry(uint32_t dir, std::string_view name) {
+    return HashFNV1a(name, 14695981039346656037ull ^ (uint64_t(dir) << 17));
+  }
+
+  uint32_t FindInDir(uint32_t dir, std::string_view name) const {
+    if (m_vuSlots.empty())
+      return s_uInvalid;
+
+    const size_t mask = m_vuSlots.size() - 1;
+    for (size_t slot = HashEntry(dir, name) & mask;; slot = (slot + 1) & mask) {
+      uint32_t id = m_vuSlots[slot];
+      if (id == s_uEmptySlot)
+        return s_uInvalid;
+      if (id != s_uDeletedSlot && m_vEntries[id].dir == dir && GetName(id) == name)
+        return id;
+    }
+  }
+
+  // id has to be alive already, a rehash picks it up on its own
+  void InsertSlot(uint32_t id) {
+    if ((m_uAlive + m_uDeletedSlots) * 2 >= m_vuSlots.size()) {
+      Rehash(std::max<size_t>(1024, m_uAlive * 4));
+      return;
+    }
+
+    const size_t mask = m_vuSlots.size() - 1;
+    size_t slot = HashEntry(m_vEntries[id].dir, GetName(id)) & mask;
+    while (m_vuSlots[slot] != s_uEmptySlot && m_vuSlots[slot] != s_uDeletedSlot)
+      slot = (slot + 1) & mask;
+
+    if (m_vuSlots[slot] == s_uDeletedSlot)
+      m_uDeletedSlots--;
+    m_vuSlots[slot] = id;
+  }
+
+  void EraseSlot(uint32_t id) {
+    const size_t mask = m_vuSlots.size() - 1;
+    size_t slot = HashEntry(m_vEntries[id].dir, GetName(id)) & mask;
+    while (m_vuSlots[slot] != id)
+      slot = (slot + 1) & mask;
+
+    m_vuSlots[slot] = s_uDeletedSlot;
+    m_uDeletedSlots++;
+  }
+
+  void Rehash(size_t minSlots) {
+    size_t l_uSize = 1;
+    while (l_uSize < minSlots)
+      l_uSize <<= 1;
+
+    m_vuSlots.assign(l_uSize, s_uEmptySlot);
+    m_uDeletedSlots = 0;
+    m_uAllocations++;
+
+    const size_t mask = l_uSize - 1;
+    for (uint32_t id = 0; id < GetIdCount(); id++) {
+      if (!IsAlive(id))
+        continue;
+
+      size_t slot = HashEntry(m_vEntries[id].dir, GetName(id)) & mask;
+      while (m_vuSlots[slot] != s_uEmptySlot)
+        slot = (slot + 1) & mask;
+      m_vuSlots[slot] = id;
+    }
+  }
+};
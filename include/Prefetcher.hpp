@@ -0,0 +1,124 @@
+#pragma once
+
+#include "ModelLoader.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <vector>
+
+// speculatively stages the entries around the selection on low priority
+// threads. nothing is imported until a staged file is selected, the render
+// thread only takes it in place of a loader request. a new selection bumps
+// the generation, which abandons every read that is still going and drops
+// the staged files that are no longer neighbours. those that are stay
+// staged, they count against the byte budget until taken.
+class CPrefetcher {
+public:
+  explicit CPrefetcher(uint64_t maxInFlightBytes,
+                       CBakeCache *bakeCache = nullptr, uint32_t threads = 2)
+      : m_uMaxInFlight(maxInFlightBytes), m_pBakeCache(bakeCache),
+        m_pool(threads) {}
+
+  ~CPrefetcher() {
+    m_uGeneration.fetch_add(1, std::memory_order_relaxed);
+    m_pool.Wait();
+  }
+
+  CPrefetcher(const CPrefetcher &) = delete;
+  CPrefetcher &operator=(const CPrefetcher &) = delete;
+
+  // paths nearest first, stops queueing once the byte budget is used up
+  void Prefetch(const std::vector<std::string> &paths) {
+    const uint64_t generation =
+        m_uGeneration.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    std::vector<std::string> l_vsHeld;
+    {
+      std::lock_guard<std::mutex> lock(m_mtxReady);
+      std::erase_if(m_vReady, [&](const SStagedModel &staged) {
+        return std::find(paths.begin(), paths.end(), staged.path) ==
+               paths.end();
+      });
+      for (const SStagedModel &staged : m_vReady)
+        l_vsHeld.push_back(staged.path);
+    }
+
+    uint64_t l_uQueued = 0;
+    for (const std::string &path : paths) {
+      std::error_code ec;
+      uint64_t size = std::filesystem::file_size(path, ec);
+      if (ec || l_uQueued + size > m_uMaxInFlight)
+        break;
+      l_uQueued += size;
+      if (std::find(l_vsHeld.begin(), l_vsHeld.end(), path) != l_vsHeld.end())
+        continue; // staged for the previous selection already
+
+      m_pool.Submit([this, path, generation](uint32_t) {
+        if (!IsCurrent(generation))
+          return;
+
+        LowerThreadPriority();
+
+        // textures decode right here, the loader's pool is kept for the
+        // selection
+        thread_local std::vector<char> l_vcChunk;
+        SStagedModel l_staged;
+        l_staged.path = path;
+        if (!StageModel(l_staged, l_vcChunk, m_pBakeCache, nullptr,
+                        [&] { return IsCurrent(generation); }))
+          return;
+
+        std::lock_guard<std::mutex> lock(m_mtxReady);
+        if (IsCurrent(generation))
+          m_vReady.push_back(std::move(l_staged));
+      });
+    }
+  }
+
+  // drops all speculative work, e.g. when there is nothing selected
+  void Cancel() { Prefetch({}); }
+
+  // render thread, the staged file of a selected path if it was read ahead
+  bool Take(const std::string &path, SStagedModel &staged) {
+    std::lock_guard<std::mutex> lock(m_mtxReady);
+    auto l_found = std::find_if(
+        m_vReady.begin(), m_vReady.end(),
+        [&](const SStagedModel &ready) { return ready.path == path; });
+    if (l_found == m_vReady.end())
+      return false;
+
+    staged = std::move(*l_found);
+    m_vReady.erase(l_found);
+    return true;
+  }
+
+private:
+  uint64_t m_uMaxInFlight;
+  CBakeCache *m_pBakeCache;
+  std::atomic<uint64_t> m_uGeneration{0};
+
+  std::mutex m_mtxReady;
+  std::vector<SStagedModel> m_vReady;
+
+  CWorkStealingPool m_pool; // last, its workers use the members above
+
+  bool IsCurrent(uint64_t generation) const {
+    return m_uGeneration.load(std::memory_order_relaxed) == generation;
+  }
+
+  // on linux the nice value is per thread, the render thread keeps its own
+  static void LowerThreadPriority() {
+    thread_local bool s_bLowered = false;
+    if (s_bLowered)
+      return;
+
+    ::setpriority(PRIO_PROCESS, static_cast<id_t>(::gettid()), 10);
+    s_bLowered = true;
+  }
+};
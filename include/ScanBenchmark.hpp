@@ -0,0 +1,85 @@
+#pragma once
+
+#include "AllocationCounter.hpp"
+#include "BackgroundScan.hpp"
+#include "PathTable.hpp"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// --scan-bench: scans the root the same way the picker does and prints what
+// the file list costs, next to what the old std::vector<std::string> would
+inline int RunScanBenchmark(const CFileSystem &fileSystem) {
+  using Clock = std::chrono::steady_clock;
+
+  CPathTable l_table;
+  size_t l_uBatches = 0;
+
+  // everything the scan workers and the draining thread allocate, the
+  // table's own growth included
+  auto l_start = Clock::now();
+  SAllocationCounter::Start();
+  {
+    CBackgroundScan l_scan(fileSystem);
+    l_scan.Start();
+
+    while (true) {
+      const bool l_bDone = l_scan.IsDone();
+      l_scan.Drain([&](CBackgroundScan::FileBatch &batch) {
+        l_uBatches++;
+        for (const SScannedDir &dir : batch)
+          dir.ForEachFile(
+              [&](std::string_view name) { l_table.Add(dir.relDir, name); });
+      });
+      if (l_bDone)
+        break;
+      l_scan.WaitForBatch(std::chrono::milliseconds(100));
+    }
+  }
+  SAllocationCounter::Stop();
+  const double l_dScanMs =
+      std::chrono::duration<double, std::milli>(Clock::now() - l_start)
+          .count();
+  const size_t l_uScanAllocs =
+      SAllocationCounter::s_uCount.load(std::memory_order_relaxed);
+  const size_t l_uScanBytes =
+      SAllocationCounter::s_uBytes.load(std::memory_order_relaxed);
+
+  // the old list: one std::string per path, heap allocated past the SSO
+  size_t l_uVectorBytes = 0;
+  size_t l_uVectorAllocs = 0;
+  {
+    std::vector<std::string> l_vsPaths;
+    std::string l_sPath;
+    for (uint32_t id = 0; id < l_table.GetIdCount(); id++) {
+      if (l_vsPaths.size() == l_vsPaths.capacity())
+        l_uVectorAllocs++;
+
+      l_table.GetPath(id, l_sPath);
+      const std::string &added = l_vsPaths.emplace_back(l_sPath);
+      if (added.capacity() > std::string().capacity()) {
+        l_uVectorAllocs++;
+        l_uVectorBytes += added.capacity() + 1;
+      }
+    }
+    l_uVectorBytes += l_vsPaths.capacity() * sizeof(std::string);
+  }
+
+  const size_t l_uCount = l_table.GetCount();
+  const double l_dPerEntry =
+      l_uCount ? double(l_table.GetMemoryUsage()) / double(l_uCount) : 0.0;
+  const double l_dVectorPerEntry =
+      l_uCount ? double(l_uVectorBytes) / double(l_uCount) : 0.0;
+
+  std::printf("scan:            %zu files in %.1f ms (%zu batches)\n", l_uCount,
+              l_dScanMs, l_uBatches);
+  std::printf("scan allocations: %zu, %zu bytes requested\n", l_uScanAllocs,
+              l_uScanBytes);
+  std::printf("path table:      %zu bytes, %.1f bytes/entry, %zu allocations\n",
+              l_table.GetMemoryUsage(), l_dPerEntry,
+              l_table.GetAllocationCount());
+  std::printf("vector<string>:  %zu bytes, %.1f bytes/entry, %zu allocations\n",
+              l_uVectorBytes, l_dVectorPerEntry, l_uVectorAllocs);
+  return 0;
+}
@@ -0,0 +1,262 @@
+#pragma once
+
+#include "MappedFile.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// one directory as seen by the scanner. relDir is relative to the scan root
+// and ends with '/' ("" for the root itself) so relDir + name is the path
+// shown in the file list. children hold the relDir of every subdirectory.
+// file names are packed into one string, each one followed by '\0'.
+struct SScannedDir {
+  std::string relDir;
+  int64_t mtime = 0;
+  std::string fileNames;
+  uint32_t fileCount = 0;
+  std::vector<std::string> children;
+
+  void AddFile(std::string_view name) {
+    fileNames.append(name);
+    fileNames.push_back('\0');
+    fileCount++;
+  }
+
+  template <typename F> void ForEachFile(F &&func) const {
+    for (size_t pos = 0; pos < fileNames.size();) {
+      size_t end = fileNames.find('\0', pos);
+      func(std::string_view(fileNames).substr(pos, end - pos));
+      pos = end + 1;
+    }
+  }
+};
+
+// on disk layout, everything is native endian and tightly packed:
+//   SHeader | SDir[dirCount] | uint32_t child[childCount] |
+//   SFile[fileCount] | char strings[stringBytes]
+// dirs are sorted by relDir, so the root is always dir 0.
+class CScanIndex {
+public:
+  static constexpr char s_magic[8] = {'E', 'H', 'Z', 'S', 'C', 'A', 'N', '\0'};
+  static constexpr uint32_t s_uVersion = 1;
+
+  struct SHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t dirCount;
+    uint64_t key; // hash of the root path and the extension filter
+    uint32_t childCount;
+    uint32_t fileCount;
+    uint64_t stringBytes;
+  };
+
+  struct SDir {
+    int64_t mtime;
+    uint32_t pathOffset;
+    uint32_t pathLen;
+    uint32_t firstChild;
+    uint32_t childCount;
+    uint32_t firstFile;
+    uint32_t fileCount;
+  };
+
+  struct SFile {
+    uint32_t nameOffset;
+    uint32_t nameLen;
+  };
+
+  bool Load(const std::filesystem::path &file, uint64_t key) {
+    m_mapping.Close();
+    if (!m_mapping.Open(file))
+      return false;
+
+    if (!Validate(key)) {
+      m_mapping.Close();
+      return false;
+    }
+    return true;
+  }
+
+  bool IsLoaded() const { return m_mapping.IsOpen(); }
+  uint32_t GetDirCount() const { return IsLoaded() ? m_pHeader->dirCount : 0; }
+
+  const SDir &GetDir(uint32_t index) const { return m_pDirs[index]; }
+
+  std::string_view GetDirPath(const SDir &dir) const {
+    return {m_pStrings + dir.pathOffset, dir.pathLen};
+  }
+
+  uint32_t GetChild(const SDir &dir, uint32_t i) const {
+    return m_pChildren[dir.firstChild + i];
+  }
+
+  std::string_view GetFileName(const SDir &dir, uint32_t i) const {
+    const SFile &file = m_pFiles[dir.firstFile + i];
+    return {m_pStrings + file.nameOffset, file.nameLen};
+  }
+
+  // writes to a temporary file first so a crash never leaves a torn index
+  static bool Write(const std::filesystem::path &file, uint64_t key,
+                    std::vector<SScannedDir> &dirs) {
+    std::sort(dirs.begin(), dirs.end(),
+              [](const SScannedDir &a, const SScannedDir &b) {
+                return a.relDir < b.relDir;
+              });
+
+    std::unordered_map<std::string_view, uint32_t> l_mapDirIndex;
+    l_mapDirIndex.reserve(dirs.size());
+    for (size_t i = 0; i < dirs.size(); i++)
+      l_mapDirIndex.emplace(dirs[i].relDir, static_cast<uint32_t>(i));
+
+    std::vector<SDir> l_vDirs;
+    std::vector<uint32_t> l_vuChildren;
+    std::vector<SFile> l_vFiles;
+    std::string l_sStrings;
+    l_vDirs.reserve(dirs.size());
+
+    auto AddString = [&l_sStrings](std::string_view str) {
+      uint32_t offset = static_cast<uint32_t>(l_sStrings.size());
+      l_sStrings.append(str);
+      return offset;
+    };
+
+    for (const SScannedDir &dir : dirs) {
+      SDir l_dir{};
+      l_dir.mtime = dir.mtime;
+      l_dir.pathOffset = AddString(dir.relDir);
+      l_dir.pathLen = static_cast<uint32_t>(dir.relDir.size());
+
+      l_dir.firstChild = static_cast<uint32_t>(l_vuChildren.size());
+      for (const std::string &child : dir.children) {
+        auto it = l_mapDirIndex.find(child);
+        if (it != l_mapDirIndex.end())
+          l_vuChildren.push_back(it->second);
+      }
+      l_dir.childCount =
+          static_cast<uint32_t>(l_vuChildren.size()) - l_dir.firstChild;
+
+      l_dir.firstFile = static_cast<uint32_t>(l_vFiles.size());
+      l_dir.fileCount = dir.fileCount;
+      dir.ForEachFile([&](std::string_view name) {
+        l_vFiles.push_back(
+            {AddString(name), static_cast<uint32_t>(name.size())});
+      });
+
+      l_vDirs.push_back(l_dir);
+    }
+
+    if (l_sStrings.size() > UINT32_MAX)
+      return false;
+
+    SHeader l_header{};
+    std::memcpy(l_header.magic, s_magic, sizeof(s_magic));
+    l_header.version = s_uVersion;
+    l_header.dirCount = static_cast<uint32_t>(l_vDirs.size());
+    l_header.key = key;
+    l_header.childCount = static_cast<uint32_t>(l_vuChildren.size());
+    l_header.fileCount = static_cast<uint32_t>(l_vFiles.size());
+    l_header.stringBytes = l_sStrings.size();
+
+    std::error_code ec;
+    std::filesystem::create_directories(file.parent_path(), ec);
+
+    std::filesystem::path l_tmpPath = file;
+    l_tmpPath += ".tmp";
+
+    FILE *out = std::fopen(l_tmpPath.c_str(), "wb");
+    if (!out)
+      return false;
+
+    bool ok = std::fwrite(&l_header, sizeof(l_header), 1, out) == 1;
+    ok = ok && WriteArray(out, l_vDirs);
+    ok = ok && WriteArray(out, l_vuChildren);
+    ok = ok && WriteArray(out, l_vFiles);
+    ok = ok && WriteArray(out, l_sStrings);
+    ok = (std::fclose(out) == 0) && ok;
+
+    if (ok)
+      std::filesystem::rename(l_tmpPath, file, ec);
+    if (!ok || ec) {
+      std::filesystem::remove(l_tmpPath, ec);
+      return false;
+    }
+    return true;
+  }
+
+private:
+  CMappedFile m_mapping;
+  const SHeader *m_pHeader = nullptr;
+  const SDir *m_pDirs = nullptr;
+  const uint32_t *m_pChildren = nullptr;
+  const SFile *m_pFiles = nullptr;
+  const char *m_pStrings = nullptr;
+
+  template <typename T> static bool WriteArray(FILE *out, const T &array) {
+    if (array.empty())
+      return true;
+    return std::fwrite(array.data(), sizeof(array[0]), array.size(), out) ==
+           array.size();
+  }
+
+  // the index comes from disk, check every offset once here so the
+  // accessors above can stay unchecked
+  bool Validate(uint64_t key) {
+    const std::byte *data = m_mapping.Data();
+    const size_t size = m_mapping.Size();
+
+    if (size < sizeof(SHeader))
+      return false;
+
+    m_pHeader = reinterpret_cast<const SHeader *>(data);
+    if (std::memcmp(m_pHeader->magic, s_magic, sizeof(s_magic)) != 0 ||
+        m_pHeader->version != s_uVersion || m_pHeader->key != key ||
+        m_pHeader->dirCount == 0)
+      return false;
+
+    const uint64_t l_uDirBytes = uint64_t(m_pHeader->dirCount) * sizeof(SDir);
+    const uint64_t l_uChildBytes =
+        uint64_t(m_pHeader->childCount) * sizeof(uint32_t);
+    const uint64_t l_uFileBytes = uint64_t(m_pHeader->fileCount) * sizeof(SFile);
+
+    if (sizeof(SHeader) + l_uDirBytes + l_uChildBytes + l_uFileBytes +
+            m_pHeader->stringBytes !=
+        size)
+      return false;
+
+    const std::byte *cursor = data + sizeof(SHeader);
+    m_pDirs = reinterpret_cast<const SDir *>(cursor);
+    cursor += l_uDirBytes;
+    m_pChildren = reinterpret_cast<const uint32_t *>(cursor);
+    cursor += l_uChildBytes;
+    m_pFiles = reinterpret_cast<const SFile *>(cursor);
+    cursor += l_uFileBytes;
+    m_pStrings = reinterpret_cast<const char *>(cursor);
+
+    const uint64_t strings = m_pHeader->stringBytes;
+
+    for (uint32_t i = 0; i < m_pHeader->childCount; i++)
+      if (m_pChildren[i] >= m_pHeader->dirCount)
+        return false;
+
+    for (uint32_t i = 0; i < m_pHeader->fileCount; i++)
+      if (uint64_t(m_pFiles[i].nameOffset) + m_pFiles[i].nameLen > strings)
+        return false;
+
+    for (uint32_t i = 0; i < m_pHeader->dirCount; i++) {
+      const SDir &dir = m_pDirs[i];
+      if (uint64_t(dir.pathOffset) + dir.pathLen > strings ||
+          uint64_t(dir.firstChild) + dir.childCount > m_pHeader->childCount ||
+          uint64_t(dir.firstFile) + dir.fileCount > m_pHeader->fileCount)
+        return false;
+    }
+
+    // dir 0 has to be the root
+    return m_pDirs[0].pathLen == 0;
+  }
+};
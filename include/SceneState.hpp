@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// what a frame sent the renderer
+struct SSceneUploadStats {
+  uint32_t commandSubmits = 0; // render command rebuilds, 0 or 1
+  uint64_t bytes = 0;          // camera and material data written
+};
+
+// what the viewer last handed the renderer, and what it has to send again.
+// EnvHazGraphics may keep its command and dynamic buffers as a ring with a
+// segment per frame in flight, where a skipped write leaves the segment with
+// whatever was there a ring ago. its depth is not something the renderer
+// exposes, so by default every frame sends the whole scene. given the depth
+// with SetFramesInFlight a change is sent for that many frames in a row,
+// after that every segment has it and a static view sends nothing.
+class CSceneState {
+public:
+  static constexpr uint32_t s_uMaxFramesInFlight = 8;
+
+  // 0 when the depth is not known, set before the first frame. a deeper
+  // ring than this class tracks is sent every frame as well.
+  void SetFramesInFlight(uint32_t frames) {
+    m_uFramesInFlight = frames <= s_uMaxFramesInFlight ? frames : 0;
+    m_uCommandFrames = m_uCameraFrames = m_uFramesInFlight;
+  }
+  uint32_t GetFramesInFlight() const { return m_uFramesInFlight; }
+
+  // the model is compared by address, anything that loads or erases a model
+  // must also call InvalidateCommands since an address can come back
+  void SetInstance(const void *model, const float matrix[16]) {
+    if (model == m_pModel &&
+        std::memcmp(matrix, m_matrix, sizeof(m_matrix)) == 0)
+      return;
+    m_pModel = model;
+    std::memcpy(m_matrix, matrix, sizeof(m_matrix));
+    InvalidateCommands();
+  }
+
+  // the mesh manager's buffers moved under the submitted ranges
+  void InvalidateCommands() {
+    m_bInstanceChanged = true;
+    m_uCommandFrames = m_uFramesInFlight;
+  }
+
+  // true if the caller has to submit and rebuild this frame
+  bool TakeCommandsDirty() {
+    m_bInstanceChangedThisFrame = m_bInstanceChanged;
+    m_bInstanceChanged = false;
+    if (m_uFramesInFlight && m_uCommandFrames == 0)
+      return false;
+    if (m_uCommandFrames)
+      m_uCommandFrames--;
+    m_stats.commandSubmits++;
+    return true;
+  }
+
+  // true if the caller has to upload data this frame
+  bool TakeCameraDirty(const void *data, size_t size) {
+    const auto *bytes = static_cast<const uint8_t *>(data);
+    m_bCameraChanged = m_vCamera.size() != size ||
+                       std::memcmp(m_vCamera.data(), bytes, size) != 0;
+    if (m_bCameraChanged) {
+      m_vCamera.assign(bytes, bytes + size);
+      m_uCameraFrames = m_uFramesInFlight;
+    }
+    if (m_uFramesInFlight && m_uCameraFrames == 0)
+      return false;
+    if (m_uCameraFrames)
+      m_uCameraFrames--;
+    m_stats.bytes += size;
+    return true;
+  }
+
+  // dirtyBytes is the prefix of the material data changed since the last
+  // frame and usedBytes the part in use, returns the prefix to write
+  size_t TakeMaterialBytes(size_t dirtyBytes, size_t usedBytes) {
+    size_t l_uBytes = usedBytes;
+    if (m_uFramesInFlight) {
+      m_auMaterialBytes[m_uMaterialFrame++ % m_uFramesInFlight] = dirtyBytes;
+      l_uBytes = *std::max_element(
+          m_auMaterialBytes.begin(),
+          m_auMaterialBytes.begin() + m_uFramesInFlight);
+    }
+    m_stats.bytes += l_uBytes;
+    return l_uBytes;
+  }
+
+  // what changed in the frames' last Take calls, as opposed to what is
+  // only sent again
+  bool HasInstanceChanged() const { return m_bInstanceChangedThisFrame; }
+  bool HasCameraChanged() const { return m_bCameraChanged; }
+
+  // a change is still being written to the rest of the ring
+  bool IsSettling() const {
+    return m_uCommandFrames || m_uCameraFrames ||
+           std::any_of(m_auMaterialBytes.begin(),
+                       m_auMaterialBytes.begin() + m_uFramesInFlight,
+                       [](size_t bytes) { return bytes != 0; });
+  }
+
+  // what was sent since the last call, called once per frame
+  SSceneUploadStats TakeStats() {
+    SSceneUploadStats l_stats = m_stats;
+    m_stats = {};
+    return l_stats;
+  }
+
+private:
+  uint32_t m_uFramesInFlight = 0;
+
+  const void *m_pModel = nullptr;
+  float m_matrix[16] = {};
+  bool m_bInstanceChanged = true;
+  bool m_bInstanceChangedThisFrame = false;
+  uint32_t m_uCommandFrames = 0;
+
+  std::vector<uint8_t> m_vCamera;
+  bool m_bCameraChanged = false;
+  uint32_t m_uCameraFrames = 0;
+
+  std::array<size_t, s_uMaxFramesInFlight> m_auMaterialBytes{};
+  uint32_t m_uMaterialFrame = 0;
+
+  SSceneUploadStats m_stats;
+};
@@ -0,0 +1,341 @@
+#pragma once
+
+#include "PathTable.hpp"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// case insensitive search over a CPathTable. file names are indexed by
+// trigram, directories are few enough to be matched directly and expand to
+// the files inside them. entries are added as the scan streams them in.
+//
+// results are ranked: name starts with the query, name contains it, the
+// directory part contains it, then fuzzy hits that share at least half of
+// the query trigrams (typos, swapped letters). one or two characters are
+// too short for trigrams and only match name starts and directories.
+//
+// a query never walks every name: matches stop at s_uMaxResults, names
+// that are too short for trigrams come from lists by their first two
+// characters, and a trigram most names share (".gl", "glb") is probed
+// per candidate instead of merged.
+class CSearchIndex {
+public:
+  static constexpr size_t s_uMaxResults = 2000;
+  // the fuzzy pass is for typos, it only runs when little else matched
+  static constexpr size_t s_uFuzzyBelow = 32;
+
+  explicit CSearchIndex(const CPathTable &files) : m_files(files) {}
+
+  void Add(uint32_t id) {
+    const uint32_t dir = m_files.GetDirId(id);
+    if (dir >= m_vvuDirFiles.size()) {
+      m_vvuDirFiles.resize(dir + 1);
+      m_vsDirLower.resize(dir + 1);
+    }
+
+    if (m_vvuDirFiles[dir].empty() && m_vsDirLower[dir].empty())
+      m_vsDirLower[dir] = ToLower(m_files.GetDirPath(dir));
+    m_vvuDirFiles[dir].push_back(id);
+
+    // ids only grow, every list stays sorted
+    const std::string_view name = m_files.GetName(id);
+    if (!name.empty()) {
+      m_mapPrefixes[PrefixKey(name.substr(0, 1))].push_back(id);
+      if (name.size() > 1)
+        m_mapPrefixes[PrefixKey(name.substr(0, 2))].push_back(id);
+    }
+
+    CollectTrigrams(name, m_vuKeys);
+    for (uint32_t key : m_vuKeys)
+      m_mapPostings[key].push_back(id);
+  }
+
+  void Clear() {
+    m_mapPostings.clear();
+    m_mapPrefixes.clear();
+    m_vvuDirFiles.clear();
+    m_vsDirLower.clear();
+  }
+
+  // fills results with matching live ids, best match first. false if
+  // there were more than s_uMaxResults and the rest was left out.
+  bool Query(std::string_view query, std::vector<uint32_t> &results) {
+    results.clear();
+    m_sQuery = ToLower(query);
+    if (m_sQuery.empty())
+      return true;
+
+    // marks from older queries are told apart by their generation, only
+    // ids added since the last query need clearing
+    m_vuStamp.resize(m_files.GetIdCount(), 0);
+    m_vuMark.resize(m_files.GetIdCount(), 0);
+    if (++m_uGeneration == 0) {
+      std::fill(m_vuStamp.begin(), m_vuStamp.end(), 0);
+      m_uGeneration = 1;
+    }
+    m_uTaken = 0;
+    for (auto &bucket : m_vvuBuckets)
+      bucket.clear();
+
+    MatchNames();
+    MatchDirs();
+    if (m_uTaken < s_uFuzzyBelow)
+      MatchFuzzy();
+
+    // shorter names are closer to what was typed
+    auto l_byNameLength = [this](uint32_t a, uint32_t b) {
+      return m_files.GetName(a).size() < m_files.GetName(b).size();
+    };
+    std::stable_sort(m_vvuBuckets[0].begin(), m_vvuBuckets[0].end(),
+                     l_byNameLength);
+    std::stable_sort(m_vvuBuckets[1].begin(), m_vvuBuckets[1].end(),
+                     l_byNameLength);
+    std::stable_sort(m_vvuBuckets[3].begin(), m_vvuBuckets[3].end(),
+                     [this](uint32_t a, uint32_t b) {
+                       return m_vuMark[a] > m_vuMark[b];
+                     });
+
+    for (const auto &bucket : m_vvuBuckets)
+      results.insert(results.end(), bucket.begin(), bucket.end());
+    return !IsFull();
+  }
+
+private:
+  const CPathTable &m_files;
+
+  std::unordered_map<uint32_t, std::vector<uint32_t>> m_mapPostings;
+  // by the first one or two lowercase characters of the name
+  std::unordered_map<uint32_t, std::vector<uint32_t>> m_mapPrefixes;
+  std::vector<std::vector<uint32_t>> m_vvuDirFiles; // by dir id
+  std::vector<std::string> m_vsDirLower;            // by dir id
+
+  // scratch, kept around so typing does not allocate once warmed up
+  std::string m_sQuery;
+  std::vector<uint32_t> m_vuKeys;
+  std::vector<uint32_t> m_vuCandidates;
+  std::vector<const std::vector<uint32_t> *> m_vpLists;
+  std::vector<std::vector<uint32_t>::const_iterator> m_vItCursors;
+  // 1 = matched, fuzzy: trigram hit count. only valid where the stamp is
+  // the current generation, see GetMark
+  std::vector<uint8_t> m_vuMark;
+  std::vector<uint32_t> m_vuStamp;
+  uint32_t m_uGeneration = 0;
+  size_t m_uTaken = 0;
+  std::vector<uint32_t> m_vvuBuckets[4];
+
+  static char Lower(char c) {
+    return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  }
+
+  static std::string ToLower(std::string_view str) {
+    std::string out(str);
+    for (char &c : out)
+      c = Lower(c);
+    return out;
+  }
+
+  static uint32_t PrefixKey(std::string_view prefix) {
+    uint32_t key = uint32_t(prefix.size()) << 16;
+    for (size_t i = 0; i < prefix.size(); i++)
+      key |= uint32_t(static_cast<uint8_t>(Lower(prefix[i]))) << (8 * i);
+    return key;
+  }
+
+  static uint32_t TrigramKey(char a, char b, char c) {
+    return uint32_t(static_cast<uint8_t>(a)) << 16 |
+           uint32_t(static_cast<uint8_t>(b)) << 8 |
+           uint32_t(static_cast<uint8_t>(c));
+  }
+
+  static void CollectTrigrams(std::string_view str,
+                              std::vector<uint32_t> &keys) {
+    keys.clear();
+    for (size_t i = 0; i + 2 < str.size(); i++)
+      keys.push_back(
+          TrigramKey(Lower(str[i]), Lower(str[i + 1]), Lower(str[i + 2])));
+
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  }
+
+  static bool StartsWithNoCase(std::string_view str, std::string_view lower) {
+    if (str.size() < lower.size())
+      return false;
+    for (size_t i = 0; i < lower.size(); i++)
+      if (Lower(str[i]) != lower[i])
+        return false;
+    return true;
+  }
+
+  static size_t FindNoCase(std::string_view str, std::string_view lower) {
+    if (lower.empty())
+      return 0;
+    for (size_t i = 0; i + lower.size() <= str.size(); i++)
+      if (Lower(str[i]) == lower[0] &&
+          StartsWithNoCase(str.substr(i), lower))
+        return i;
+    return std::string_view::npos;
+  }
+
+  const std::vector<uint32_t> *GetPostings(uint32_t key) const {
+    auto found = m_mapPostings.find(key);
+    return found == m_mapPostings.end() ? nullptr : &found->second;
+  }
+
+  uint8_t &GetMark(uint32_t id) {
+    if (m_vuStamp[id] != m_uGeneration) {
+      m_vuStamp[id] = m_uGeneration;
+      m_vuMark[id] = 0;
+    }
+    return m_vuMark[id];
+  }
+
+  bool IsFull() const { return m_uTaken >= s_uMaxResults; }
+
+  void Take(uint32_t id, int bucket) {
+    if (IsFull() || !m_files.IsAlive(id))
+      return;
+    uint8_t &mark = GetMark(id);
+    if (mark)
+      return;
+    mark = 1;
+    m_vvuBuckets[bucket].push_back(id);
+    m_uTaken++;
+  }
+
+  void TakeIfNameMatches(uint32_t id) {
+    std::string_view name = m_files.GetName(id);
+    size_t pos = FindNoCase(name, m_sQuery);
+    if (pos != std::string_view::npos)
+      Take(id, pos == 0 ? 0 : 1);
+  }
+
+  void MatchNames() {
+    if (m_sQuery.size() < 3) {
+      // too short for trigrams, the names that start with it are listed
+      auto found = m_mapPrefixes.find(PrefixKey(m_sQuery));
+      if (found != m_mapPrefixes.end())
+        for (uint32_t id : found->second) {
+          if (IsFull())
+            break;
+          Take(id, 0);
+        }
+      return;
+    }
+
+    CollectTrigrams(m_sQuery, m_vuKeys);
+
+    m_vpLists.clear();
+    for (uint32_t key : m_vuKeys) {
+      const std::vector<uint32_t> *postings = GetPostings(key);
+      if (!postings)
+        return;
+      m_vpLists.push_back(postings);
+    }
+
+    // intersect starting from the rarest trigram
+    std::sort(m_vpLists.begin(), m_vpLists.end(),
+              [](const auto *a, const auto *b) { return a->size() < b->size(); });
+
+    // every id of the rarest list is looked up in the longer ones as it
+    // goes, a trigram every name has costs a binary search per candidate
+    // rather than a pass, and the walk stops once the results are full
+    m_vItCursors.clear();
+    for (size_t i = 1; i < m_vpLists.size(); i++)
+      m_vItCursors.push_back(m_vpLists[i]->begin());
+
+    for (uint32_t id : *m_vpLists[0]) {
+      if (IsFull())
+        return;
+
+      bool l_bInAll = true;
+      for (size_t i = 1; i < m_vpLists.size() && l_bInAll; i++) {
+        auto &it = m_vItCursors[i - 1];
+        it = std::lower_bound(it, m_vpLists[i]->end(), id);
+        l_bInAll = it != m_vpLists[i]->end() && *it == id;
+      }
+
+      // trigrams only say "maybe", the order of them still has to match
+      if (l_bInAll)
+        TakeIfNameMatches(id);
+    }
+  }
+
+  void MatchDirs() {
+    const size_t slash = m_sQuery.rfind('/');
+
+    for (uint32_t dir = 0; dir < m_vvuDirFiles.size(); dir++) {
+      const std::string &dirLower = m_vsDirLower[dir];
+
+      if (IsFull())
+        return;
+
+      if (dirLower.find(m_sQuery) != std::string::npos) {
+        for (uint32_t id : m_vvuDirFiles[dir]) {
+          if (IsFull())
+            return;
+          Take(id, 2);
+        }
+        continue;
+      }
+
+      // "models/sonic" -> dir ends with "models/", name starts with "sonic"
+      if (slash == std::string::npos ||
+          !dirLower.ends_with(std::string_view(m_sQuery).substr(0, slash + 1)))
+        continue;
+
+      std::string_view l_sNamePart = std::string_view(m_sQuery).substr(slash + 1);
+      for (uint32_t id : m_vvuDirFiles[dir])
+        if (StartsWithNoCase(m_files.GetName(id), l_sNamePart))
+          Take(id, 2);
+    }
+  }
+
+  void MatchFuzzy() {
+    if (m_sQuery.size() < 4)
+      return;
+
+    CollectTrigrams(m_sQuery, m_vuKeys);
+    const size_t l_uNeeded = (m_vuKeys.size() + 1) / 2;
+
+    // trigrams shared by a quarter of everything (".gl", "glb") carry no
+    // signal and would make this pass touch every file, nor would any
+    // list too long to walk per keystroke
+    static constexpr size_t s_uMaxFuzzyList = 16384;
+    const size_t l_uStopSize = std::min(
+        s_uMaxFuzzyList, std::max<size_t>(64, m_files.GetCount() / 4));
+
+    // marks start at 1 for ids already matched, fuzzy counts go from 2 up
+    m_vuCandidates.clear();
+    for (uint32_t key : m_vuKeys) {
+      const std::vector<uint32_t> *postings = GetPostings(key);
+      if (!postings || postings->size() > l_uStopSize)
+        continue;
+
+      for (uint32_t id : *postings) {
+        uint8_t &mark = GetMark(id);
+        if (mark == 1)
+          continue;
+        if (mark == 0) {
+          mark = 1;
+          m_vuCandidates.push_back(id);
+        }
+        if (mark < UINT8_MAX)
+          mark++;
+      }
+    }
+
+    for (uint32_t id : m_vuCandidates) {
+      if (size_t(m_vuMark[id] - 1) >= l_uNeeded && m_files.IsAlive(id) &&
+          !IsFull()) {
+        m_vvuBuckets[3].push_back(id);
+        m_uTaken++;
+      } else
+        m_vuMark[id] = 1; // keep it out of later passes, it is not a hit
+    }
+  }
+};
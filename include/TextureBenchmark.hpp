@@ -0,0 +1,66 @@
+#pragma once
+
+#include "FileSystem.hpp"
+#include "GlbFile.hpp"
+#include "TextureDecodePool.hpp"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+// --texture-bench <model.glb>: decodes the model's textures on 1, 2, 4...
+// threads up to every core and prints how the load time scales. a bake is
+// measured with the textures it deferred, a source with its own.
+inline int RunTextureBenchmark(const CFileSystem &fileSystem) {
+  using Clock = std::chrono::steady_clock;
+
+  CGlbFile l_glb;
+  std::string l_sError;
+  if (!l_glb.Load(fileSystem.textureBenchmark, l_sError)) {
+    std::printf("can not load %s: %s\n",
+                fileSystem.textureBenchmark.string().c_str(),
+                l_sError.c_str());
+    return 1;
+  }
+
+  const bool l_bDeferred = !ReadMaterialImages(l_glb.json, true).empty();
+  const std::filesystem::path l_dir =
+      fileSystem.textureBenchmark.parent_path();
+
+  const uint32_t l_uCores = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<uint32_t> l_vuThreads;
+  for (uint32_t threads = 1; threads < l_uCores; threads *= 2)
+    l_vuThreads.push_back(threads);
+  l_vuThreads.push_back(l_uCores);
+
+  double l_dSingleMs = 0.0;
+  for (uint32_t threads : l_vuThreads) {
+    CTextureDecodePool l_pool(threads);
+    SModelTextures l_textures;
+
+    auto l_start = Clock::now();
+    l_pool.Decode(l_glb, l_dir, l_bDeferred, l_textures, nullptr,
+                  [] { return true; });
+    const double l_dMs =
+        std::chrono::duration<double, std::milli>(Clock::now() - l_start)
+            .count();
+    if (threads == 1) {
+      l_dSingleMs = l_dMs;
+      for (const std::string &error : l_textures.errors)
+        std::printf("%s\n", error.c_str());
+    }
+
+    size_t l_uImages = 0;
+    for (const STextureImage &image : l_textures.images)
+      if (!image.Empty())
+        l_uImages++;
+
+    std::printf("%2u threads: %zu images, %.1f MB with mips in %.1f ms, "
+                "%.2fx\n",
+                threads, l_uImages,
+                double(l_textures.GetBytes()) / double(1 << 20), l_dMs,
+                l_dMs > 0.0 ? l_dSingleMs / l_dMs : 0.0);
+  }
+  return 0;
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include "BlockCompression.hpp"
+#include "Hash.hpp"
+#include "ImageDecoder.hpp"
+#include "Ktx2File.hpp"
+#include "MaterialTextures.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_set>
+#include <vector>
+
+// BC5 for images only ever used as normal maps, it keeps red and green and
+// a shader that samples one has to rebuild blue as sqrt(1 - x^2 - y^2).
+// assets/shader.frag only samples albedo so far. BC7 for the rest, RGBA8
+// marks an image no material uses.
+inline std::vector<ETextureFormat>
+ChooseImageFormats(const std::vector<MaterialImages> &materials,
+                   size_t imageCount) {
+  static constexpr size_t s_uNormalSlot = 2;
+  std::vector<ETextureFormat> l_vFormats(imageCount, ETextureFormat::RGBA8);
+  std::vector<bool> l_vbColor(imageCount, false);
+
+  for (const MaterialImages &slots : materials)
+    for (size_t s = 0; s < slots.size(); s++) {
+      if (slots[s] < 0 || static_cast<size_t>(slots[s]) >= imageCount)
+        continue;
+      const size_t image = static_cast<size_t>(slots[s]);
+      l_vbColor[image] = l_vbColor[image] || s != s_uNormalSlot;
+      l_vFormats[image] =
+          l_vbColor[image] ? ETextureFormat::BC7 : ETextureFormat::BC5;
+    }
+  return l_vFormats;
+}
+
+// block compressed textures by the hash of the png or jpeg they came from,
+// <hash>.bc7.ktx2 and <hash>.bc5.ktx2 under <bake cache>/textures. a hit
+// skips decoding and mip generation and uploads a quarter of the bytes.
+// compressing takes seconds for a big image, eHazBake --textures does it up
+// front and the viewer queues what it misses on a low priority thread of the
+// cache's own, the image is shown uncompressed until the next load.
+class CTextureCache {
+public:
+  // bumped whenever the encoder's output changes
+  static constexpr uint32_t s_uVersion = 2;
+
+  explicit CTextureCache(std::filesystem::path dir)
+      : m_dir(std::move(dir)), m_thread([this] { Run(); }) {}
+
+  ~CTextureCache() {
+    {
+      std::lock_guard<std::mutex> lock(m_mtx);
+      m_bStop = true;
+    }
+    m_cv.notify_one();
+    m_thread.join();
+  }
+
+  CTextureCache(const CTextureCache &) = delete;
+  CTextureCache &operator=(const CTextureCache &) = delete;
+
+  const std::filesystem::path &GetDir() const { return m_dir; }
+
+  // also what the viewer shares textures by
+  static uint64_t GetHash(const uint8_t *data, size_t size) {
+    return HashXXH64(data, size,
+                     HashFNV1a("eHazTextures" + std::to_string(s_uVersion)));
+  }
+
+  std::filesystem::path GetPath(uint64_t hash, ETextureFormat format) const {
+    char l_name[48];
+    std::snprintf(l_name, sizeof(l_name), "%016llx.%s.ktx2",
+                  static_cast<unsigned long long>(hash),
+                  format == ETextureFormat::BC5 ? "bc5" : "bc7");
+    return m_dir / l_name;
+  }
+
+  bool Contains(uint64_t hash, ETextureFormat format) const {
+    std::error_code ec;
+    return std::filesystem::is_regular_file(GetPath(hash, format), ec);
+  }
+
+  bool Load(uint64_t hash, ETextureFormat format, STextureImage &out) const {
+    if (LoadKtx2(GetPath(hash, format), out) && out.format == format)
+      return true;
+    out = STextureImage{};
+    return false;
+  }
+
+  // compresses a decoded image on the calling thread, false if keepGoing
+  // said no or the file could not be written
+  template <typename F>
+  bool Store(uint64_t hash, ETextureFormat format, const STextureImage &image,
+             F &&keepGoing) const {
+    STextureImage l_compressed;
+    return CompressImage(image, format, l_compressed, keepGoing) &&
+           SaveKtx2(GetPath(hash, format), l_compressed);
+  }
+
+  // the encoded image is copied, the cache's thread decodes and compresses
+  // it later. images that are cached or already queued are skipped.
+  void Queue(uint64_t hash, ETextureFormat format, const uint8_t *data,
+             size_t size) {
+    if (Contains(hash, format))
+      return;
+
+    {
+      std::lock_guard<std::mutex> lock(m_mtx);
+      if (!m_setQueued.insert(GetPath(hash, format).string()).second)
+        return;
+      m_dqJobs.push_back(
+          {hash, format, std::vector<uint8_t>(data, data + size)});
+    }
+    m_cv.notify_one();
+  }
+
+private:
+  struct SJob {
+    uint64_t hash;
+    ETextureFormat format;
+    std::vector<uint8_t> encoded;
+  };
+
+  std::filesystem::path m_dir;
+
+  std::mutex m_mtx;
+  std::condition_variable m_cv;
+  std::deque<SJob> m_dqJobs;
+  std::unordered_set<std::string> m_setQueued; // paths, for the whole session
+  bool m_bStop = false;
+
+  std::thread m_thread; // last, starts after everything above exists
+
+  bool IsStopping() {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_bStop;
+  }
+
+  void Run() {
+    // on linux the nice value is per thread, the render thread keeps its own
+    ::setpriority(PRIO_PROCESS, static_cast<id_t>(::gettid()), 10);
+
+    std::unique_lock<std::mutex> lock(m_mtx);
+    while (true) {
+      m_cv.wait(lock, [this] { return m_bStop || !m_dqJobs.empty(); });
+      if (m_bStop)
+        return;
+
+      SJob l_job = std::move(m_dqJobs.front());
+      m_dqJobs.pop_front();
+      lock.unlock();
+
+      // a texture that fails is decoded again the next time it is used,
+      // nothing is printed from this thread
+      STextureImage l_image;
+      std::string l_sError;
+      if (DecodeImage(l_job.encoded.data(), l_job.encoded.size(), l_image,
+                      l_sError))
+        Store(l_job.hash, l_job.format, l_image,
+              [this] { return !IsStopping(); });
+
+      lock.lock();
+    }
+  }
+};
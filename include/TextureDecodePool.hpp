@@ -0,0 +1,197 @@
+#pragma once
+
+#include "GlbFile.hpp"
+#include "Hash.hpp"
+#include "ImageDecoder.hpp"
+#include "MappedFile.hpp"
+#include "MaterialTextures.hpp"
+#include "TextureCache.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <latch>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// a model's textures decoded on the CPU, ready to be uploaded in one go.
+// images with the same key show the same texture, only the first of them is
+// decoded.
+struct SModelTextures {
+  std::vector<STextureImage> images; // per glTF image, empty if unused
+  std::vector<uint64_t> keys; // per glTF image, content and format, 0 unused
+  std::vector<MaterialImages> materials; // per glTF material
+  // one line per image that did not decode, for the caller to report. the
+  // decode threads do not print, their lines would interleave.
+  std::vector<std::string> errors;
+
+  bool Empty() const { return materials.empty(); }
+
+  uint64_t GetBytes() const {
+    uint64_t bytes = 0;
+    for (const STextureImage &image : images)
+      bytes += image.pixels.size();
+    return bytes;
+  }
+};
+
+// the encoded bytes of one image of the file, embedded or next to it. an
+// image next to it is mapped into file, which has to outlive the bytes.
+inline const uint8_t *ReadGlbImage(const CGlbFile &glb, const CJson &image,
+                                   const std::filesystem::path &dir,
+                                   CMappedFile &file, size_t &size,
+                                   std::string &error) {
+  if (const uint8_t *data = glb.GetImageData(image, size))
+    return data;
+
+  const CJson *uri = image.Find("uri");
+  const std::filesystem::path l_path =
+      uri ? CGlbFile::GetUriPath(uri->AsString(), dir) : "";
+  if (l_path.empty() || !file.Open(l_path)) {
+    error = "could not open " + (uri ? uri->AsString() : "image");
+    return nullptr;
+  }
+  size = file.Size();
+  return reinterpret_cast<const uint8_t *>(file.Data());
+}
+
+// decodes one image, or loads its compressed form from cache as format.
+// hash is CTextureCache::GetHash of the image, a miss is decoded and queued
+// for compression.
+inline bool DecodeGlbImage(const CGlbFile &glb, const CJson &image,
+                           const std::filesystem::path &dir, uint64_t hash,
+                           STextureImage &out, std::string &error,
+                           CTextureCache *cache = nullptr,
+                           ETextureFormat format = ETextureFormat::BC7) {
+  CMappedFile l_file;
+  size_t l_uSize = 0;
+  const uint8_t *data = ReadGlbImage(glb, image, dir, l_file, l_uSize, error);
+  if (!data)
+    return false;
+  if (!cache)
+    return DecodeImage(data, l_uSize, out, error);
+
+  if (cache->Load(hash, format, out))
+    return true;
+  if (!DecodeImage(data, l_uSize, out, error))
+    return false;
+  cache->Queue(hash, format, data, l_uSize);
+  return true;
+}
+
+// decodes every image the materials use, each with its mips, dir is where
+// relative uris start. with a pool every image is a task of its own so a
+// model's textures decode at once, without one they decode one after another
+// on the calling thread. with a cache the images come block compressed when
+// they were compressed before. the images are hashed first, copies of an
+// image are not decoded again. keepGoing is asked before every image,
+// returns false if it said no.
+template <typename F>
+inline bool DecodeModelTextures(const CGlbFile &glb,
+                                const std::filesystem::path &dir,
+                                bool deferredOnly, SModelTextures &out,
+                                CWorkStealingPool *pool, CTextureCache *cache,
+                                F &&keepGoing) {
+  out.materials = ReadMaterialImages(glb.json, deferredOnly);
+  out.images.clear();
+  out.keys.clear();
+  out.errors.clear();
+  const CJson *imageArray = glb.json.Find("images");
+  if (out.materials.empty() || !imageArray)
+    return true;
+
+  const std::vector<CJson> &images = imageArray->GetArray();
+  out.images.resize(images.size());
+  out.keys.resize(images.size(), 0);
+
+  const std::vector<ETextureFormat> l_vFormats =
+      ChooseImageFormats(out.materials, images.size());
+  std::vector<uint64_t> l_vuHashes(images.size(), 0);
+  std::vector<bool> l_vbUsed(images.size(), false);
+  std::unordered_map<uint64_t, size_t> l_mapFirst;
+  for (size_t i = 0; i < images.size(); i++) {
+    if (l_vFormats[i] == ETextureFormat::RGBA8)
+      continue;
+
+    // hashing is a fraction of decoding, an unreadable image is reported
+    // when it is decoded
+    CMappedFile l_file;
+    size_t l_uSize = 0;
+    std::string l_sError;
+    if (const uint8_t *data =
+            ReadGlbImage(glb, images[i], dir, l_file, l_uSize, l_sError)) {
+      l_vuHashes[i] = CTextureCache::GetHash(data, l_uSize);
+      out.keys[i] = HashFNV1a(
+          l_vFormats[i] == ETextureFormat::BC5 ? "normal" : "color",
+          l_vuHashes[i]);
+    }
+    l_vbUsed[i] = !out.keys[i] || l_mapFirst.emplace(out.keys[i], i).second;
+  }
+
+  // every task writes only its own entry
+  std::vector<std::string> l_vsErrors(images.size());
+  auto l_decode = [&](size_t index) {
+    if (!keepGoing())
+      return;
+    if (!DecodeGlbImage(glb, images[index], dir, l_vuHashes[index],
+                        out.images[index], l_vsErrors[index], cache,
+                        l_vFormats[index]) &&
+        l_vsErrors[index].empty())
+      l_vsErrors[index] = "could not decode";
+  };
+
+  if (pool) {
+    std::latch l_done(std::count(l_vbUsed.begin(), l_vbUsed.end(), true));
+    for (size_t i = 0; i < images.size(); i++)
+      if (l_vbUsed[i])
+        pool->Submit([&, i](uint32_t) {
+          l_decode(i);
+          l_done.count_down();
+        });
+    l_done.wait();
+  } else {
+    for (size_t i = 0; i < images.size(); i++)
+      if (l_vbUsed[i])
+        l_decode(i);
+  }
+
+  if (!keepGoing())
+    return false;
+
+  for (size_t i = 0; i < images.size(); i++)
+    if (!l_vsErrors[i].empty())
+      out.errors.push_back("texture " + std::to_string(i) +
+                           " not decoded: " + l_vsErrors[i]);
+
+  // a slot whose image did not decode keeps the importer's texture, so do
+  // the copies of that image
+  for (size_t i = 0; i < images.size(); i++)
+    if (out.keys[i] && out.images[l_mapFirst[out.keys[i]]].Empty())
+      out.keys[i] = 0;
+  for (MaterialImages &slots : out.materials)
+    for (int32_t &image : slots)
+      if (image >= 0 && !out.keys[static_cast<size_t>(image)])
+        image = -1;
+  return true;
+}
+
+// the loader's pool for the above, a model's images are decoded at once
+// instead of one after another inside the importer
+class CTextureDecodePool {
+public:
+  explicit CTextureDecodePool(uint32_t threads = 0) : m_pool(threads) {}
+
+  uint32_t GetThreadCount() const { return m_pool.GetThreadCount(); }
+
+  template <typename F>
+  bool Decode(const CGlbFile &glb, const std::filesystem::path &dir,
+              bool deferredOnly, SModelTextures &out, CTextureCache *cache,
+              F &&keepGoing) {
+    return DecodeModelTextures(glb, dir, deferredOnly, out, &m_pool, cache,
+                               keepGoing);
+  }
+
+private:
+  CWorkStealingPool m_pool;
+};
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// work stealing pool, every worker owns a deque. tasks submitted from a
+// worker go to its own deque (LIFO, keeps the cache warm), idle workers
+// steal from the front of the others.
+class CWorkStealingPool {
+public:
+  using Task = std::function<void(uint32_t workerIndex)>;
+
+  explicit CWorkStealingPool(uint32_t threadCount = 0) {
+    if (threadCount == 0)
+      threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+    m_vQueues.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; i++)
+      m_vQueues.push_back(std::make_unique<SQueue>());
+
+    m_vThreads.reserve(threadCount);
+    for (uint32_t i = 0; i < threadCount; i++)
+      m_vThreads.emplace_back([this, i] { WorkerLoop(i); });
+  }
+
+  ~CWorkStealingPool() {
+    {
+      std::lock_guard<std::mutex> lock(m_mtxWake);
+      m_bStop = true;
+    }
+    m_cvWake.notify_all();
+
+    for (auto &thread : m_vThreads)
+      thread.join();
+  }
+
+  CWorkStealingPool(const CWorkStealingPool &) = delete;
+  CWorkStealingPool &operator=(const CWorkStealingPool &) = delete;
+
+  uint32_t GetThreadCount() const {
+    return static_cast<uint32_t>(m_vThreads.size());
+  }
+
+  void Submit(Task task) {
+    m_uPending.fetch_add(1, std::memory_order_relaxed);
+
+    uint32_t l_uQueue = s_uWorkerIndex;
+    if (s_pOwner != this)
+      l_uQueue = m_uNextQueue.fetch_add(1, std::memory_order_relaxed) %
+                 GetThreadCount();
+
+    {
+      std::lock_guard<std::mutex> lock(m_vQueues[l_uQueue]->mtx);
+      m_vQueues[l_uQueue]->tasks.push_back(std::move(task));
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_mtxWake);
+      m_uQueued++;
+    }
+    m_cvWake.notify_one();
+  }
+
+  // blocks until every submitted task (and the tasks they spawned) finished
+  void Wait() {
+    std::unique_lock<std::mutex> lock(m_mtxWake);
+    m_cvIdle.wait(lock, [this] {
+      return m_uPending.load(std::memory_order_acquire) == 0;
+    });
+  }
+
+private:
+  struct SQueue {
+    std::mutex mtx;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<std::unique_ptr<SQueue>> m_vQueues;
+  std::vector<std::thread> m_vThreads;
+
+  std::mutex m_mtxWake;
+  std::condition_variable m_cvWake;
+  std::condition_variable m_cvIdle;
+  uint64_t m_uQueued = 0;
+  bool m_bStop = false;
+
+  std::atomic<uint64_t> m_uPending{0};
+  std::atomic<uint32_t> m_uNextQueue{0};
+
+  static inline thread_local CWorkStealingPool *s_pOwner = nullptr;
+  static inline thread_local uint32_t s_uWorkerIndex = 0;
+
+  bool PopOwn(uint32_t index, Task &out) {
+    SQueue &queue = *m_vQueues[index];
+    std::lock_guard<std::mutex> lock(queue.mtx);
+    if (queue.tasks.empty())
+      return false;
+
+    out = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    return true;
+  }
+
+  bool Steal(uint32_t thief, Task &out) {
+    const uint32_t count = GetThreadCount();
+
+    for (uint32_t i = 1; i < count; i++) {
+      SQueue &queue = *m_vQueues[(thief + i) % count];
+      std::lock_guard<std::mutex> lock(queue.mtx);
+      if (queue.tasks.empty())
+        continue;
+
+      out = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+      return true;
+    }
+    return false;
+  }
+
+  void WorkerLoop(uint32_t index) {
+    s_pOwner = this;
+    s_uWorkerIndex = index;
+
+    Task l_task;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(m_mtxWake);
+        m_cvWake.wait(lock, [this] { return m_bStop || m_uQueued > 0; });
+        if (m_uQueued == 0)
+          return;
+        m_uQueued--;
+      }
+
+      // a wake token guarantees a task exists somewhere, keep looking until
+      // we own one (another worker may have stolen "ours" in the meantime)
+      while (!PopOwn(index, l_task) && !Steal(index, l_task))
+        std::this_thread::yield();
+
+      l_task(index);
+      l_task = nullptr;
+
+      if (m_uPending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        std::lock_guard<std::mutex> lock(m_mtxWake);
+        m_cvIdle.notify_all();
+      }
+    }
+  }
+};
@@ -1,20 +1,56 @@
 #pragma once
+#include "BackgroundScan.hpp"
 #include "FileSystem.hpp"
+#include "FileWatcher.hpp"
+#include "Meshlets.hpp"
+#include "PathTable.hpp"
+#include "SceneState.hpp"
+#include "SearchIndex.hpp"
+#include "ViewportTarget.hpp"
 #include "imgui.h"
 #include "imgui_impl_opengl3.h"
 #include "imgui_impl_sdl3.h"
 #include <Renderer.hpp>
 #include <SDL3/SDL_log.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
 #include <string>
+#include <string_view>
 #include <vector>
+// filled in by main every frame for the stats overlay
+struct SViewerStats {
+  bool hasMeshlets = false; // the shown model came from a bake with them
+  SMeshletCullStats meshlets;
+  uint64_t textureBytes = 0;   // the viewer's own textures on the GPU
+  uint64_t streamingBytes = 0; // their finer levels still to upload
+  uint64_t sharedTextureBytes = 0; // saved by sharing identical images
+  SSceneUploadStats upload;        // what the frame sent the renderer
+  double frameP50Ms = 0.0;         // swap to swap
+  double frameP99Ms = 0.0;
+  double latencyP50Ms = 0.0; // input event to the swap that showed it
+  double latencyP99Ms = 0.0;
+};
+
 class CSelectUI {
 public:
-  std::vector<std::string> m_vsFiles;
+  // owned by main, the UI only orders and displays it
+  CPathTable &m_files;
+  std::vector<uint32_t> m_vuOrder; // live ids, sorted by path once scanned
   bool m_bFinished = false;
   bool m_bCanceled = false;
   std::string m_sSelectedFile;
+  uint32_t m_uSelectedId = CPathTable::s_uInvalid;
+  bool m_bScanFinished = false;
+  size_t m_uScanFound = 0;
+  SViewerStats m_stats;
+  bool m_bShowStats = true;
+  CViewportTarget m_viewport; // main draws the frame at its size
 
   static bool s_bIsPreviewFocused;
+
+  explicit CSelectUI(CPathTable &files) : m_files(files), m_search(files) {}
+
   bool IsWindowContentFocused() {
     if (!ImGui::IsWindowFocused(ImGuiFocusedFlags_RootWindow))
       return false;
@@ -58,6 +94,83 @@ public:
         eHazGraphics::Renderer::r_instance->p_window->GetOpenGLContext());
     ImGui_ImplOpenGL3_Init("#version 460");
   }
+  // pulls whatever the background scan found since the last frame
+  void PollScan(CBackgroundScan &scan) {
+    if (m_bScanFinished)
+      return;
+
+    // read before draining, every batch is queued before the flag is set
+    const bool l_bDone = scan.IsDone();
+
+    scan.Drain([this](CBackgroundScan::FileBatch &batch) {
+      for (const SScannedDir &dir : batch) {
+        dir.ForEachFile([this, &dir](std::string_view name) {
+          const uint32_t l_uFirstNew = m_files.GetIdCount();
+          uint32_t id = m_files.Add(dir.relDir, name);
+          if (id >= l_uFirstNew)
+            AddToList(id);
+        });
+      }
+    });
+    m_uScanFound = scan.GetFoundCount();
+
+    if (l_bDone) {
+      // batches arrive in whatever order the workers finished
+      SortOrder(m_vuOrder.begin(), m_vuOrder.end());
+      m_bScanFinished = true;
+
+      // ids don't survive a rescan, the selected path does
+      if (!m_sSelectedFile.empty())
+        m_uSelectedId = m_files.Find(m_sSelectedFile);
+    }
+  }
+
+  // drops the list, used when the file list has to be scanned again
+  void ResetFiles() {
+    m_files.Clear();
+    m_vuOrder.clear();
+    m_search.Clear();
+    m_uSelectedId = CPathTable::s_uInvalid;
+    m_bScanFinished = false;
+    m_uScanFound = 0;
+  }
+
+  // applies watcher changes, only valid once the scan finished and the list
+  // is sorted. the list stays sorted and free of duplicates.
+  void ApplyFileDelta(const SFileDelta &delta) {
+    size_t l_uRemoved = 0;
+    for (const std::string &dir : delta.removedDirs)
+      l_uRemoved += m_files.RemoveDir(dir);
+
+    for (const std::string &path : delta.removed)
+      if (m_files.Remove(m_files.Find(path)))
+        l_uRemoved++;
+
+    if (l_uRemoved > 0) {
+      std::erase_if(m_vuOrder,
+                    [this](uint32_t id) { return !m_files.IsAlive(id); });
+      m_bSearchDirty = true;
+    }
+
+    if (!delta.added.empty()) {
+      const uint32_t l_uFirstNew = m_files.GetIdCount();
+      const auto l_uOldCount = static_cast<std::ptrdiff_t>(m_vuOrder.size());
+
+      // Add hands back the existing id for paths we already have
+      for (const std::string &path : delta.added) {
+        uint32_t id = m_files.Add(path);
+        if (id >= l_uFirstNew)
+          AddToList(id);
+      }
+
+      SortOrder(m_vuOrder.begin() + l_uOldCount, m_vuOrder.end());
+      std::inplace_merge(m_vuOrder.begin(), m_vuOrder.begin() + l_uOldCount,
+                         m_vuOrder.end(), [this](uint32_t a, uint32_t b) {
+                           return m_files.Less(a, b);
+                         });
+    }
+  }
+
   void DrawGameViewPort() {
     ImGui::Begin("Viewport");
 
@@ -69,13 +182,20 @@ public:
     eHazGraphics::FrameBuffer &mainFBO =
         eHazGraphics::Renderer::r_instance->GetMainFBO();
 
-    if (mainFBO.GetWidth() != newW || mainFBO.GetHeight() != newH) {
-      mainFBO.Resize(newW, newH);
-    }
+    // dragging a splitter only reallocates once the size settles
+    if (m_viewport.Update(uint32_t(newW), uint32_t(newH), ImGui::GetTime()))
+      mainFBO.Resize(int(m_viewport.GetStorageWidth()),
+                     int(m_viewport.GetStorageHeight()));
 
+    // the frame is in the bottom left of the storage, GL's rows go up
+    const ImVec2 l_imagePos = ImGui::GetCursorScreenPos();
     ImGui::Image((void *)(uint64_t)mainFBO.GetColorTextures()[0].GetTextureID(),
-                 ImVec2(mainFBO.GetWidth(), mainFBO.GetHeight()), ImVec2(0, 1),
-                 ImVec2(1, 0));
+                 ImVec2(float(newW), float(newH)),
+                 ImVec2(0, m_viewport.GetMaxV()),
+                 ImVec2(m_viewport.GetMaxU(), 0));
+
+    if (m_bShowStats)
+      DrawStatsOverlay(l_imagePos);
 
     if (IsWindowContentFocused()) {
       s_bIsPreviewFocused = true;
@@ -86,6 +206,71 @@ public:
     ImGui::End();
   }
 
+  // drawn straight into the viewport's draw list, so it takes no input and
+  // the focus test above is not affected
+  void DrawStatsOverlay(ImVec2 pos) {
+    char l_line[128];
+    m_sStatsText.clear();
+
+    if (m_stats.hasMeshlets) {
+      const SMeshletCullStats &meshlets = m_stats.meshlets;
+      const double l_dTotal = double(std::max<uint64_t>(meshlets.meshlets, 1));
+      std::snprintf(l_line, sizeof(l_line),
+                    "meshlets %llu, visible %llu (stats only)\n"
+                    "cullable: frustum %.1f%%, backface %.1f%%",
+                    static_cast<unsigned long long>(meshlets.meshlets),
+                    static_cast<unsigned long long>(meshlets.GetVisible()),
+                    100.0 * double(meshlets.frustumCulled) / l_dTotal,
+                    100.0 * double(meshlets.coneCulled) / l_dTotal);
+      m_sStatsText += l_line;
+    } else {
+      m_sStatsText += "no meshlets, the model is not a .glb bake";
+    }
+
+    std::snprintf(l_line, sizeof(l_line), "\ntextures %.1f MB",
+                  double(m_stats.textureBytes) / double(1 << 20));
+    m_sStatsText += l_line;
+    if (m_stats.sharedTextureBytes) {
+      std::snprintf(l_line, sizeof(l_line), ", %.1f MB saved by sharing",
+                    double(m_stats.sharedTextureBytes) / double(1 << 20));
+      m_sStatsText += l_line;
+    }
+    if (m_stats.streamingBytes) {
+      std::snprintf(l_line, sizeof(l_line), ", %.1f MB streaming",
+                    double(m_stats.streamingBytes) / double(1 << 20));
+      m_sStatsText += l_line;
+    }
+
+    std::snprintf(l_line, sizeof(l_line), "\nsent %.1f KB%s",
+                  double(m_stats.upload.bytes) / 1024.0,
+                  m_stats.upload.commandSubmits ? ", commands rebuilt" : "");
+    m_sStatsText += l_line;
+
+    std::snprintf(l_line, sizeof(l_line),
+                  "\nviewport %ux%u in %ux%u, %u reallocations last resize",
+                  m_viewport.GetViewWidth(), m_viewport.GetViewHeight(),
+                  m_viewport.GetStorageWidth(), m_viewport.GetStorageHeight(),
+                  m_viewport.GetResizeReallocations());
+    m_sStatsText += l_line;
+
+    std::snprintf(l_line, sizeof(l_line),
+                  "\nframe p50 %.2f ms, p99 %.2f ms\n"
+                  "input latency p50 %.2f ms, p99 %.2f ms",
+                  m_stats.frameP50Ms, m_stats.frameP99Ms,
+                  m_stats.latencyP50Ms, m_stats.latencyP99Ms);
+    m_sStatsText += l_line;
+
+    ImDrawList *drawList = ImGui::GetWindowDrawList();
+    const ImVec2 l_textPos(pos.x + 8.0f, pos.y + 8.0f);
+    const char *l_text = m_sStatsText.c_str();
+    const ImVec2 l_size = ImGui::CalcTextSize(l_text);
+    drawList->AddRectFilled(
+        ImVec2(l_textPos.x - 4.0f, l_textPos.y - 4.0f),
+        ImVec2(l_textPos.x + l_size.x + 4.0f, l_textPos.y + l_size.y + 4.0f),
+        IM_COL32(0, 0, 0, 160), 4.0f);
+    drawList->AddText(l_textPos, IM_COL32(255, 255, 255, 255), l_text);
+  }
+
   void DrawModelSelectWindow() {
     ImGui::SetNextWindowDockID(ImGui::GetID("eHazDockspace"),
                                ImGuiCond_FirstUseEver);
@@ -95,21 +280,58 @@ public:
       return;
     }
 
-    ImGui::Text("File count: %d", (int)m_vsFiles.size());
-
-    for (int i = 0; i < m_vsFiles.size(); i++) {
-      bool selected = (m_sSelectedFile == m_vsFiles[i]);
-
-      std::string display = std::filesystem::path(m_vsFiles[i]).string();
-
-      std::string label = display + "###file_" + std::to_string(i);
+    if (m_bScanFinished)
+      ImGui::Text("File count: %d", (int)m_files.GetCount());
+    else
+      ImGui::Text("scanning... %zu found", m_uScanFound);
+
+    ImGui::SetNextItemWidth(-FLT_MIN);
+    if (ImGui::InputTextWithHint("##search", "search", m_acSearch,
+                                 sizeof(m_acSearch)))
+      m_bSearchDirty = true;
+
+    const bool l_bSearching = m_acSearch[0] != '\0';
+    if (l_bSearching && m_bSearchDirty) {
+      auto l_start = std::chrono::steady_clock::now();
+      m_bSearchComplete = m_search.Query(m_acSearch, m_vuResults);
+      m_fSearchMs = std::chrono::duration<float, std::milli>(
+                        std::chrono::steady_clock::now() - l_start)
+                        .count();
+      m_bSearchDirty = false;
+    }
 
-      if (ImGui::Selectable(label.c_str(), selected)) {
-        m_sSelectedFile = m_vsFiles[i];
-        SDL_Log("%s", m_vsFiles[i].c_str());
+    if (l_bSearching)
+      ImGui::Text("%zu%s matches (%.2f ms)", m_vuResults.size(),
+                  m_bSearchComplete ? "" : "+",
+                  static_cast<double>(m_fSearchMs));
+
+    const std::vector<uint32_t> &l_vuRows =
+        l_bSearching ? m_vuResults : m_vuOrder;
+
+    // only the rows on screen are touched, the label buffer keeps its
+    // capacity between frames so scrolling does not allocate
+    ImGui::BeginChild("file list");
+
+    ImGuiListClipper l_clipper;
+    l_clipper.Begin(static_cast<int>(l_vuRows.size()));
+
+    while (l_clipper.Step()) {
+      for (int row = l_clipper.DisplayStart; row < l_clipper.DisplayEnd;
+           row++) {
+        const uint32_t id = l_vuRows[static_cast<size_t>(row)];
+        m_files.GetPath(id, m_sPathBuffer);
+
+        ImGui::PushID(static_cast<int>(id));
+        if (ImGui::Selectable(m_sPathBuffer.c_str(), id == m_uSelectedId)) {
+          m_uSelectedId = id;
+          m_sSelectedFile = m_sPathBuffer;
+          SDL_Log("%s", m_sSelectedFile.c_str());
+        }
+        ImGui::PopID();
       }
     }
 
+    ImGui::EndChild();
     ImGui::End();
   }
 
@@ -130,11 +352,34 @@ public:
       m_bFinished = true;
     }
 
+    ImGui::SameLine();
+    ImGui::Checkbox("Stats", &m_bShowStats);
+
     ImGui::End();
   }
 
   std::string GetRelativeSelectedPath() { return m_sSelectedFile; }
 
+  // paths of the rows around the selection as currently listed (search
+  // results if searching), nearest first: +1, -1, +2, -2, ...
+  void GetNeighbourPaths(size_t depth, std::vector<std::string> &out) const {
+    out.clear();
+    const std::vector<uint32_t> &rows =
+        m_acSearch[0] != '\0' ? m_vuResults : m_vuOrder;
+
+    auto found = std::find(rows.begin(), rows.end(), m_uSelectedId);
+    if (found == rows.end())
+      return;
+
+    const size_t row = static_cast<size_t>(found - rows.begin());
+    for (size_t step = 1; step <= depth; step++) {
+      if (row + step < rows.size())
+        m_files.GetPath(rows[row + step], out.emplace_back());
+      if (step <= row)
+        m_files.GetPath(rows[row - step], out.emplace_back());
+    }
+  }
+
   void UpdateUI() {}
 
   void RenderUI() {
@@ -192,4 +437,26 @@ public:
       SDL_GL_MakeCurrent(backup_window, backup_context);
     }
   }
+
+private:
+  std::string m_sPathBuffer;
+  std::string m_sStatsText; // keeps its capacity between frames
+
+  CSearchIndex m_search;
+  char m_acSearch[256] = {};
+  std::vector<uint32_t> m_vuResults;
+  bool m_bSearchComplete = true; // false if the query hit its result cap
+  bool m_bSearchDirty = false;
+  float m_fSearchMs = 0.0f;
+
+  void AddToList(uint32_t id) {
+    m_vuOrder.push_back(id);
+    m_search.Add(id);
+    m_bSearchDirty = true;
+  }
+
+  template <typename It> void SortOrder(It first, It last) {
+    std::sort(first, last,
+              [this](uint32_t a, uint32_t b) { return m_files.Less(a, b); });
+  }
 };
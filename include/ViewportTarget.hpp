@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+// sizes the framebuffer behind the viewport window. the storage is rounded
+// up to s_uBucket pixels and only reallocated once the window has kept its
+// size for s_dSettleSeconds, dragging a splitter reallocates at most once
+// per drag. the frame is drawn into the bottom left width x height of the
+// storage and the image shows that part. while the window is bigger than
+// the storage the frame is drawn at the storage size and stretched.
+class CViewportTarget {
+public:
+  static constexpr uint32_t s_uBucket = 256;
+  static constexpr double s_dSettleSeconds = 0.2;
+
+  // the window's size this frame, now in seconds. true if the storage must
+  // be reallocated to GetStorageWidth x GetStorageHeight.
+  bool Update(uint32_t width, uint32_t height, double now) {
+    width = std::max(1u, width);
+    height = std::max(1u, height);
+
+    if (width != m_uWidth || height != m_uHeight) {
+      if (!m_bResizing)
+        m_uResizeReallocations = 0;
+      m_uWidth = width;
+      m_uHeight = height;
+      m_dLastChange = now;
+      m_bResizing = true;
+    }
+
+    const uint32_t l_uStorageWidth = RoundUp(width);
+    const uint32_t l_uStorageHeight = RoundUp(height);
+    const bool l_bFits =
+        l_uStorageWidth == m_uStorageWidth &&
+        l_uStorageHeight == m_uStorageHeight;
+    const bool l_bSettled = now - m_dLastChange >= s_dSettleSeconds;
+    if (l_bSettled)
+      m_bResizing = false;
+
+    // nothing to draw into yet, or the window settled on another bucket
+    if (l_bFits || (m_uStorageWidth && !l_bSettled))
+      return false;
+
+    m_uStorageWidth = l_uStorageWidth;
+    m_uStorageHeight = l_uStorageHeight;
+    m_uReallocations++;
+    m_uResizeReallocations++;
+    return true;
+  }
+
+  // still waiting for the window to settle, a frame has to come after it
+  bool IsResizing() const { return m_bResizing; }
+
+  // what the frame is drawn at
+  uint32_t GetWidth() const { return std::min(m_uWidth, m_uStorageWidth); }
+  uint32_t GetHeight() const { return std::min(m_uHeight, m_uStorageHeight); }
+
+  uint32_t GetViewWidth() const { return m_uWidth; }
+  uint32_t GetViewHeight() const { return m_uHeight; }
+
+  uint32_t GetStorageWidth() const { return m_uStorageWidth; }
+  uint32_t GetStorageHeight() const { return m_uStorageHeight; }
+
+  // the drawn part of the storage in texture coordinates
+  float GetMaxU() const {
+    return m_uStorageWidth ? float(GetWidth()) / float(m_uStorageWidth) : 1.0f;
+  }
+  float GetMaxV() const {
+    return m_uStorageHeight ? float(GetHeight()) / float(m_uStorageHeight)
+                            : 1.0f;
+  }
+
+  uint32_t GetReallocations() const { return m_uReallocations; }
+  // during the last resize, or the one still going
+  uint32_t GetResizeReallocations() const { return m_uResizeReallocations; }
+
+private:
+  uint32_t m_uWidth = 0;
+  uint32_t m_uHeight = 0;
+  uint32_t m_uStorageWidth = 0;
+  uint32_t m_uStorageHeight = 0;
+  double m_dLastChange = 0.0;
+  bool m_bResizing = false;
+  uint32_t m_uReallocations = 0;
+  uint32_t m_uResizeReallocations = 0;
+
+  static uint32_t RoundUp(uint32_t size) {
+    return (size + s_uBucket - 1) / s_uBucket * s_uBucket;
+  }
+};
@@ -0,0 +1,16 @@
+#include "AllocationCounter.hpp"
+#include <cstdlib>
+#include <new>
+
+// the nothrow and array forms go through these two, aligned ones are not
+// counted
+void *operator new(size_t size) {
+  SAllocationCounter::Add(size);
+  if (void *ptr = std::malloc(size ? size : 1))
+    return ptr;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
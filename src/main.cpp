@@ -1,29 +1,54 @@
 #include <SDL3/SDL_events.h>
+#include <SDL3/SDL_hints.h>
 #include <SDL3/SDL_keycode.h>
 #include <SDL3/SDL_log.h>
 #include <SDL3/SDL_mouse.h>
 #include <SDL3/SDL_scancode.h>
+#include <SDL3/SDL_timer.h>
+#include <SDL3/SDL_video.h>
 #include <boost/interprocess/creation_tags.hpp>
 #include <boost/interprocess/interprocess_fwd.hpp>
 #include <boost/interprocess/ipc/message_queue.hpp>
+#include <chrono>
 #include <filesystem>
 #include <iostream>
 #include <iterator>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "Animation/AnimatedModelManager.hpp"
+#include "BackgroundScan.hpp"
+#include "BakeCache.hpp"
 #include "Camera.hpp"
 
 #include "DataStructs.hpp"
 #include "FileSystem.hpp"
+#include "FileWatcher.hpp"
+#include "FrameLimiter.hpp"
+#include "GpuTextures.hpp"
+#include "LodBuilder.hpp"
+#include "MaterialTable.hpp"
+#include "Meshlets.hpp"
+#include "ModelBounds.hpp"
+#include "PathTable.hpp"
+#include "ScanBenchmark.hpp"
+#include "SceneState.hpp"
+#include "TextureBenchmark.hpp"
+#include "TextureCache.hpp"
 #include "ImGui/imgui.h"
 #include "ImGui/imgui_impl_opengl3.h"
 #include "ImGui/imgui_impl_sdl3.h"
+#include "ModelCache.hpp"
+#include "ModelLoader.hpp"
+#include "PacingBenchmark.hpp"
+#include "Prefetcher.hpp"
 #include "UI.hpp"
 #include "glad/glad.h"
 #include "glm/ext/matrix_transform.hpp"
+#include "glm/gtc/type_ptr.hpp"
 #include <Renderer.hpp>
 
 // #define EHAZ_DEBUG
@@ -49,7 +74,15 @@ static bool g_bIsMoving = false;
 
 Camera g_camera;
 
-void processInput(Window *c_window, bool &quit, Camera &camera) {
+// SDL's clock, the one event timestamps are on
+struct SSdlClock {
+  uint64_t Now() const { return SDL_GetTicksNS(); }
+  void SleepFor(uint64_t ns) const { SDL_DelayNS(ns); }
+};
+
+// returns when the oldest input event it handled was generated, 0 if there
+// was none
+uint64_t processInput(Window *c_window, bool &quit, Camera &camera) {
 
   SDL_Window *window = c_window->GetWindowPtr();
   // Delta time calculation using performance counters
@@ -60,6 +93,7 @@ void processInput(Window *c_window, bool &quit, Camera &camera) {
   static float lastY = 0.0f;
 
   SDL_Event event;
+  uint64_t l_uOldestInput = 0;
   const bool *key_states = SDL_GetKeyboardState(nullptr);
 
   if (key_states[SDL_SCANCODE_LSHIFT]) {
@@ -74,6 +108,20 @@ void processInput(Window *c_window, bool &quit, Camera &camera) {
 
     ImGui_ImplSDL3_ProcessEvent(&event);
     static short l_sClickCount = 0;
+
+    switch (event.type) {
+    case SDL_EVENT_KEY_DOWN:
+    case SDL_EVENT_KEY_UP:
+    case SDL_EVENT_MOUSE_MOTION:
+    case SDL_EVENT_MOUSE_BUTTON_DOWN:
+    case SDL_EVENT_MOUSE_BUTTON_UP:
+    case SDL_EVENT_MOUSE_WHEEL:
+      if (!l_uOldestInput)
+        l_uOldestInput = event.common.timestamp;
+      break;
+    default:
+      break;
+    }
     if (g_bIsMoving && g_bIsFocused)
       camera.ProcessKeyboard(MOVING, static_cast<float>(g_fDeltaTime));
     else if (!g_bIsMoving && g_bIsFocused) {
@@ -148,6 +196,7 @@ void processInput(Window *c_window, bool &quit, Camera &camera) {
       break;
     }
   }
+  return l_uOldestInput;
 }
 struct camData {
   glm::mat4 view = glm::mat4(1.0f);
@@ -156,13 +205,114 @@ struct camData {
 
 std::shared_ptr<Model> g_sptrModel;
 
-void LoadSelectedModel(std::string path);
+// simplified levels of g_sptrModel, coarser as the index grows. they are not
+// in the model cache, a level only lives as long as its model is shown.
+std::vector<std::shared_ptr<Model>> g_vLodModels;
+std::vector<float> g_vfLodErrors;
+
+using ModelCache = CModelCache<Model>;
+ModelCache g_modelCache;
+
+// meshlets of the resident models that came from a bake, dropped together
+// with their model
+std::unordered_map<const Model *, SModelMeshlets> g_mapMeshlets;
+
+// what each resident model put in BUFFER_STATIC_MESH_DATA. the mesh manager
+// appends every import to the buffer and EraseModel does not hand the range
+// back, an erased model's bytes stay until the buffer is cleared. the file
+// size stands in for the range.
+struct SResidentModel {
+  std::string path; // what LoadModelFile was given
+  uint64_t bytes = 0;
+};
+std::unordered_map<const Model *, SResidentModel> g_mapResident;
+uint64_t g_uStaticDeadBytes = 0;
+
+// erased models the static buffer may hold before it is cleared
+static constexpr uint64_t s_uMaxStaticDeadBytes = 256ull << 20;
+
+// what goes to the material SSBO, and the textures the viewer decoded for
+// bakes instead of the importer
+CMaterialTable g_materials;
+CGpuTextures g_gpuTextures;
+
+// a model's uploaded textures, one per glTF image of its file, and the
+// range of materials that show them
+struct SModelTextureSet {
+  std::vector<TextureID> textures;
+  std::vector<MaterialImages> materials; // from firstMaterial on
+  uint32_t firstMaterial = 0;
+  bool borrowed = false; // a LOD level showing its full model's textures
+};
+std::unordered_map<const Model *, SModelTextureSet> g_mapModelTextures;
+
+// what was last submitted, a static view sends nothing
+CSceneState g_scene;
+
+// what the models would take on the GPU without sharing identical images,
+// minus what they take
+uint64_t g_uTextureBytesShared = 0;
+
+// textures are the ones decoded on the loader thread, if there are any
+std::shared_ptr<Model> LoadModelFile(const std::string &path,
+                                     SModelTextures *textures = nullptr);
+
+// pulls the material manager's list into g_materials, returns its size
+uint32_t SyncMaterials();
+
+// points the materials model appended from firstMaterial on at the
+// textures of their images, one texture per image of the file. the model
+// takes a reference on each, so a LOD level can show the textures of its
+// full detail model, borrowed says it does.
+void ApplyModelTextures(const Model *model, uint32_t firstMaterial,
+                        const std::vector<MaterialImages> &materials,
+                        const std::vector<TextureID> &textures,
+                        bool borrowed = false);
+
+void ReleaseModelTextures(const Model *model);
+
+void UpdateTextureBytesShared();
+
+// points every material that shows a streamed texture at its new handle
+void ApplyTextureSwaps(const std::vector<STextureSwap> &swaps);
+
+// true if g_sptrModel is now a different model
+bool LoadSelectedModel(SStagedModel staged);
+
+void ReleaseLods();
+
+// drops everything kept for a resident model and erases it from the mesh
+// manager, its static range counts as dead. the caller waits for the GPU.
+void EraseResidentModel(const std::shared_ptr<Model> &model);
+
+// once the dead ranges pass s_uMaxStaticDeadBytes every resident model is
+// erased and the static buffer cleared, so the next import starts an empty
+// buffer. returns the path the shown model was loaded from, empty if
+// nothing was cleared.
+std::string ClearStaticBufferIfDead();
+
+// false if the level could not be imported
+bool LoadLod(SLodLevel &level);
+
+// blocks until an event is queued or a background result needs the render
+// thread. false if it only woke for the text cursor to blink.
+bool WaitForWork(CFileWatcher &watcher, bool textInput);
+
+// --headless: draws one model offscreen and exits
+int RunHeadless(const CFileSystem &fileSystem);
+
+// culls the meshlets of a model drawn at modelMatrix, for the stats overlay
+void CullModelMeshlets(SModelMeshlets &meshlets, const glm::mat4 &view,
+                       const glm::mat4 &projection,
+                       const glm::mat4 &modelMatrix, SMeshletCullStats &stats);
 
 #define DEBUGGING_ARGS
 int main(int argc, char *argv[]) {
 
 #ifdef DEBUGGING_ARGS
 
+  // only stands in when nothing was passed, the benchmarks and headless
+  // runs keep their own arguments
   static const char *fake_argv[] = {"./eHazEngine", "--root",
                                     "/home/floatz/Projects/personal/c++/ENGINE/"
                                     "eHaz Model Viewer/eHaz-Model-Viewer/",
@@ -170,8 +320,10 @@ int main(int argc, char *argv[]) {
                                     //  .ahzm",
                                     ".glb", nullptr};
 
-  argc = 6;
-  argv = const_cast<char **>(fake_argv);
+  if (argc == 1) {
+    argc = 6;
+    argv = const_cast<char **>(fake_argv);
+  }
 
 #endif
 
@@ -181,28 +333,50 @@ int main(int argc, char *argv[]) {
 
   l_FileSystem.SetFromCommandLine(argc, argv);
 
-  auto l_vstrFiles = l_FileSystem.GetFilesFromRoot();
+  if (l_FileSystem.scanBenchmark)
+    return RunScanBenchmark(l_FileSystem);
+  if (!l_FileSystem.textureBenchmark.empty())
+    return RunTextureBenchmark(l_FileSystem);
+  if (l_FileSystem.pacingBenchmark)
+    return RunPacingBenchmark(l_FileSystem);
+  if (!l_FileSystem.headlessModel.empty())
+    return RunHeadless(l_FileSystem);
+
+  // new and removed files show up without scanning again
+  CFileWatcher l_watcher(l_FileSystem);
+
+  // the list fills in while the window is already up
+  auto l_scan = std::make_unique<CBackgroundScan>(l_FileSystem, &l_watcher);
+  l_scan->Start();
 
   eHazGraphics::Renderer l_renderer;
   l_renderer.Initialize(720, 860, "Model viewer");
 
+  // the swap only waits for vblank when the limiter leaves pacing to it
+  SDL_GL_SetSwapInterval(l_FileSystem.frameLimit == EFrameLimit::VSync ? 1
+                                                                       : 0);
+  CFrameLimiter<SSdlClock> l_limiter(l_FileSystem.frameLimit,
+                                     l_FileSystem.maxFps);
+
   l_renderer.p_bufferManager->BeginWritting();
 
-  CSelectUI l_SelectUI;
+  CPathTable l_files;
+  CSelectUI l_SelectUI(l_files);
   l_SelectUI.Initialize();
 
-  l_SelectUI.m_vsFiles = l_vstrFiles;
-
   uint AlbedoTexture = l_renderer.p_materialManager->LoadTexture(
       PROJECT_ROOT_DIR "/assets/missing.png");
 
   uint materialID = l_renderer.p_materialManager->CreatePBRMaterial(
       AlbedoTexture, AlbedoTexture, AlbedoTexture, AlbedoTexture, "default_m");
 
-  auto mat = l_renderer.p_materialManager->SubmitMaterials();
+  // every model appends its materials, the buffer is sized for all of them
+  // up front
+  SyncMaterials();
+  g_gpuTextures.SetStreamBudget(uint64_t(l_FileSystem.textureUploadKB) << 10);
 
   SBufferRange l_brMaterials = l_renderer.p_bufferManager->InsertNewDynamicData(
-      mat.first.data(), mat.first.size() * sizeof(PBRMaterial),
+      g_materials.GetData(), g_materials.GetCapacityBytes(),
       TypeFlags::BUFFER_TEXTURE_DATA);
 
   g_siShader = l_renderer.p_shaderManager->CreateShaderProgramme(
@@ -227,7 +401,16 @@ int main(int argc, char *argv[]) {
 
   // g_sptrModel = l_renderer.p_meshManager->GetModel(l_midTestModel);
 
-  g_sptrModel = l_renderer.p_meshManager->LoadModel(testPath);
+  g_sptrModel = LoadModelFile(testPath);
+
+  // the file size stands in for the resident cost, the mesh manager does
+  // not report how much CPU/GPU memory a model takes
+  g_modelCache.SetBudget(uint64_t(l_FileSystem.modelCacheMB) << 20);
+  g_modelCache.SetEvictCallback([](const std::shared_ptr<Model> &model) {
+    Renderer::r_instance->WaitForGPU();
+    EraseResidentModel(model);
+  });
+  g_modelCache.Insert(testPath, g_sptrModel, ModelCache::GetFileSize(testPath));
 
   glm::mat4 pos = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
 
@@ -242,41 +425,170 @@ int main(int argc, char *argv[]) {
                                           TypeFlags::BUFFER_STATIC_MESH_DATA);
 
   auto l_vdrRanges = l_renderer.p_renderQueue->SubmitRenderCommands();
+  g_scene.SetFramesInFlight(l_FileSystem.framesInFlight);
+  g_scene.SetInstance(g_sptrModel.get(), glm::value_ptr(pos));
+  g_scene.TakeCommandsDirty();
+  g_scene.TakeCameraDirty(&l_cdFinalData, sizeof(l_cdFinalData));
+  g_scene.TakeStats();
+
+  // models baked by eHazBake are loaded in place of their source
+  std::unique_ptr<CBakeCache> l_bakeCache;
+  if (l_FileSystem.useBakeCache) {
+    l_bakeCache = std::make_unique<CBakeCache>(
+        l_FileSystem.bakeDir.empty() ? CBakeCache::GetDefaultDir()
+                                     : l_FileSystem.bakeDir);
+    l_bakeCache->LoadManifest();
+    l_bakeCache->SetBakeMissing(l_FileSystem.bakeOnLoad);
+  }
+
+  // deferred textures compressed by eHazBake --textures, or in the
+  // background after their first load
+  std::unique_ptr<CTextureCache> l_textureCache;
+  if (l_bakeCache && l_FileSystem.useTextureCache) {
+    l_textureCache =
+        std::make_unique<CTextureCache>(l_bakeCache->GetDir() / "textures");
+    l_bakeCache->SetTextureCache(l_textureCache.get());
+  }
 
-  std::string l_strLastPath = l_vstrFiles[1];
+  CModelLoader l_modelLoader(l_bakeCache.get(), l_FileSystem.textureThreads);
+
+  // levels are built after the full detail model is up, and loaded one per
+  // frame once they are while the camera holds still
+  std::unique_ptr<CLodBuilder> l_lodBuilder;
+  if (l_bakeCache && l_FileSystem.buildLods) {
+    l_lodBuilder = std::make_unique<CLodBuilder>(*l_bakeCache);
+    l_lodBuilder->Request(testPath);
+  }
+  std::string l_strLodPath = testPath;
+  std::vector<SLodLevel> l_vPendingLods;
+  CPrefetcher l_prefetcher(uint64_t(l_FileSystem.prefetchMB) << 20,
+                           l_bakeCache.get());
+  std::vector<std::string> l_vstrNeighbours;
+
+  std::string l_strLastPath;
   int frameNum = 0;
+
+  // frames drawn since the last change. ImGui takes a couple to settle hover
+  // and layout, after that the loop sleeps until there is something to do.
+  static constexpr int s_iSettleFrames = 3;
+  int l_iIdleFrames = 0;
+  bool l_bMeshletStatsStale = true;
+  uint64_t lastCounter = SDL_GetPerformanceCounter();
   while (l_renderer.shouldQuit == false) {
 
-    static uint64_t lastCounter = SDL_GetPerformanceCounter();
+    if (!l_FileSystem.continuous && l_iIdleFrames >= s_iSettleFrames) {
+      if (WaitForWork(l_watcher, ImGui::GetIO().WantTextInput))
+        l_iIdleFrames = 0;
+      lastCounter = SDL_GetPerformanceCounter(); // the wait is not a frame
+      l_limiter.Resync();
+    }
+
+    // sleeps until the frame can just make its deadline
+    l_limiter.BeginFrame();
+
     uint64_t currentCounter = SDL_GetPerformanceCounter();
 
     g_fDeltaTime =
         double(currentCounter - lastCounter) / SDL_GetPerformanceFrequency();
     lastCounter = currentCounter;
 
-    processInput(l_renderer.p_window.get(), l_renderer.shouldQuit, g_camera);
+    l_watcher.Poll();
+    l_SelectUI.PollScan(*l_scan);
+
+    // changes seen during the scan wait until the list is sorted
+    if (l_SelectUI.m_bScanFinished) {
+      SFileDelta l_delta = l_watcher.TakeDelta();
+
+      if (l_delta.rescan) {
+        l_SelectUI.ResetFiles();
+        l_scan = std::make_unique<CBackgroundScan>(l_FileSystem, &l_watcher);
+        l_scan->Start();
+      } else if (!l_delta.Empty()) {
+        l_SelectUI.ApplyFileDelta(l_delta);
+      }
+    }
 
-    projection = glm::perspective(glm::radians(g_camera.Zoom),
-                                  (float)l_renderer.p_window->GetWidth() /
-                                      (float)l_renderer.p_window->GetHeight(),
+    // input is read as late as it can be, right before the camera goes up
+    const uint64_t l_uInputTime = processInput(
+        l_renderer.p_window.get(), l_renderer.shouldQuit, g_camera);
+
+    // the viewport window's shape, the frame is shown at its size
+    const CViewportTarget &l_viewport = l_SelectUI.m_viewport;
+    const float l_fAspect =
+        l_viewport.GetStorageWidth()
+            ? float(l_viewport.GetViewWidth()) /
+                  float(l_viewport.GetViewHeight())
+            : (float)l_renderer.p_window->GetWidth() /
+                  (float)l_renderer.p_window->GetHeight();
+    projection = glm::perspective(glm::radians(g_camera.Zoom), l_fAspect,
                                   0.1f, 100.0f);
 
     l_cdFinalData = {g_camera.GetViewMatrix(), projection};
 
-    l_renderer.UpdateDynamicData(l_brCameraDataLocation, &l_cdFinalData,
-                                 sizeof(l_cdFinalData));
+    const bool l_bCameraUpload =
+        g_scene.TakeCameraDirty(&l_cdFinalData, sizeof(l_cdFinalData));
+    const bool l_bCameraDirty = g_scene.HasCameraChanged();
+    if (l_bCameraUpload)
+      l_renderer.UpdateDynamicData(l_brCameraDataLocation, &l_cdFinalData,
+                                   sizeof(l_cdFinalData));
 
     l_renderer.UpdateRenderer(g_fDeltaTime);
 
-    Renderer::r_instance->SubmitStaticModel(g_sptrModel, pos,
-                                            TypeFlags::BUFFER_STATIC_MESH_DATA);
+    // the only instance sits at pos
+    const size_t l_uLevel = SelectLod(
+        g_vfLodErrors, glm::distance(g_camera.Position, glm::vec3(pos[3])),
+        g_camera.Zoom,
+        l_viewport.GetStorageWidth()
+            ? float(l_viewport.GetViewHeight())
+            : float(l_renderer.p_window->GetHeight()),
+        l_FileSystem.lodPixelError);
+    const std::shared_ptr<Model> &l_shown =
+        l_uLevel ? g_vLodModels[l_uLevel - 1] : g_sptrModel;
+    g_scene.SetInstance(l_shown.get(), glm::value_ptr(pos));
+    const bool l_bCommandsDirty = g_scene.TakeCommandsDirty();
+    const bool l_bInstanceDirty = g_scene.HasInstanceChanged();
+    // nothing is shown if a failed load could not bring the old model back
+    if (l_bCommandsDirty && l_shown)
+      Renderer::r_instance->SubmitStaticModel(
+          l_shown, pos, TypeFlags::BUFFER_STATIC_MESH_DATA);
+
+    // the render queue draws whole models, the culling only measures what
+    // meshlet granularity would leave out. it runs only while the overlay
+    // is shown, the numbers hold until the camera or the instance moves.
+    SViewerStats &l_stats = l_SelectUI.m_stats;
+    l_bMeshletStatsStale |= l_bCameraDirty || l_bInstanceDirty;
+    if (l_SelectUI.m_bShowStats && l_bMeshletStatsStale) {
+      l_bMeshletStatsStale = false;
+      l_stats.meshlets = {};
+      auto l_meshlets = g_mapMeshlets.find(l_shown.get());
+      l_stats.hasMeshlets = l_meshlets != g_mapMeshlets.end();
+      if (l_stats.hasMeshlets)
+        CullModelMeshlets(l_meshlets->second, l_cdFinalData.view, projection,
+                          pos, l_stats.meshlets);
+    }
 
-    l_renderer.UpdateDynamicData(l_brMaterials, mat.first.data(),
-                                 mat.first.size() * sizeof(PBRMaterial));
+    // finer texture levels go up under the budget, a finished level swaps
+    // the handle in before the materials are sent
+    ApplyTextureSwaps(g_gpuTextures.Stream());
+    l_stats.textureBytes = g_gpuTextures.GetBytes();
+    l_stats.streamingBytes = g_gpuTextures.GetStreamingBytes();
+    l_stats.sharedTextureBytes = g_uTextureBytesShared;
 
-    l_vdrRanges = Renderer::p_renderQueue->SubmitRenderCommands();
+    const size_t l_uMaterialBytes =
+        g_scene.TakeMaterialBytes(g_materials.TakeDirtyBytes(),
+                                  g_materials.GetBytes());
+    if (l_uMaterialBytes)
+      l_renderer.UpdateDynamicData(l_brMaterials, g_materials.GetData(),
+                                   l_uMaterialBytes);
+
+    if (l_bCommandsDirty)
+      l_vdrRanges = Renderer::p_renderQueue->SubmitRenderCommands();
+    l_stats.upload = g_scene.TakeStats();
 
     l_renderer.SetFrameBuffer(l_renderer.GetMainFBO());
+    if (l_viewport.GetStorageWidth())
+      glViewport(0, 0, GLsizei(l_viewport.GetWidth()),
+                 GLsizei(l_viewport.GetHeight()));
 
     l_renderer.RenderFrame(l_vdrRanges);
 
@@ -285,33 +597,218 @@ int main(int argc, char *argv[]) {
     l_SelectUI.RenderUI();
 
     l_renderer.SwapBuffers();
+    l_limiter.EndFrame();
+    if (l_uInputTime)
+      l_limiter.AddInputLatency(l_uInputTime);
+    l_stats.frameP50Ms = l_limiter.GetFrameTimes().GetPercentileMs(0.5);
+    l_stats.frameP99Ms = l_limiter.GetFrameTimes().GetPercentileMs(0.99);
+    l_stats.latencyP50Ms = l_limiter.GetInputLatency().GetPercentileMs(0.5);
+    l_stats.latencyP99Ms = l_limiter.GetInputLatency().GetPercentileMs(0.99);
 
     l_renderer.EndFrame();
 
     if (l_strLastPath != l_SelectUI.m_sSelectedFile &&
         l_SelectUI.m_sSelectedFile != "") {
 
-      LoadSelectedModel(l_FileSystem.root.string() +
-                        l_SelectUI.m_sSelectedFile);
+      // a cached model needs nothing staged, LoadSelectedModel swaps it in
+      // from the path alone. a neighbour that was read ahead is ready right
+      // away, otherwise the current model keeps drawing until the file is
+      // staged. Supply also supersedes a request still being staged.
+      const std::string l_sSelected =
+          (l_FileSystem.root / l_SelectUI.m_sSelectedFile).string();
+      SStagedModel l_prefetched;
+      if (g_modelCache.Get(l_sSelected)) {
+        l_prefetched.path = l_sSelected;
+        l_modelLoader.Supply(std::move(l_prefetched));
+      } else if (l_prefetcher.Take(l_sSelected, l_prefetched)) {
+        l_modelLoader.Supply(std::move(l_prefetched));
+      } else {
+        l_modelLoader.Request(l_sSelected);
+      }
+
+      // a new selection invalidates whatever was being read ahead, cached
+      // neighbours are not read again
+      l_SelectUI.GetNeighbourPaths(l_FileSystem.prefetchDepth,
+                                   l_vstrNeighbours);
+      for (std::string &neighbour : l_vstrNeighbours)
+        neighbour = (l_FileSystem.root / neighbour).string();
+      std::erase_if(l_vstrNeighbours, [](const std::string &neighbour) {
+        return g_modelCache.Contains(neighbour);
+      });
+      l_prefetcher.Prefetch(l_vstrNeighbours);
       SDL_Log("frame %i", ++frameNum);
       SDL_Log(("last path: " + l_strLastPath).c_str());
       SDL_Log(("selected path: " + l_SelectUI.m_sSelectedFile).c_str());
       l_strLastPath = l_SelectUI.m_sSelectedFile;
     }
 
+    SStagedModel l_staged;
+    SLodChain l_lodChain;
+    if (l_modelLoader.TakeReady(l_staged)) {
+      std::string l_sPath = l_staged.path;
+      if (LoadSelectedModel(std::move(l_staged))) {
+        l_vPendingLods.clear();
+        l_strLodPath = std::move(l_sPath);
+        if (l_lodBuilder)
+          l_lodBuilder->Request(l_strLodPath);
+      }
+    } else if (l_lodBuilder && l_lodBuilder->TakeReady(l_lodChain)) {
+      if (l_lodChain.path == l_strLodPath)
+        l_vPendingLods = std::move(l_lodChain.levels);
+    } else if (!l_modelLoader.IsBusy() && !l_bCameraDirty && !l_uInputTime &&
+               g_vLodModels.size() < l_vPendingLods.size()) {
+      // importing a level stalls this thread, a frame that shows the same
+      // picture as the last one hides it
+      if (!LoadLod(l_vPendingLods[g_vLodModels.size()]))
+        l_vPendingLods.resize(g_vLodModels.size()); // coarser ones would skip it
+    }
+
     if (l_SelectUI.m_bFinished || l_SelectUI.m_bCanceled) {
 
       l_renderer.shouldQuit = true;
     }
+
+    // anything still loading, streaming or moving keeps frames coming
+    const bool l_bBusy =
+        !l_SelectUI.m_bScanFinished || l_modelLoader.IsBusy() ||
+        (l_lodBuilder && l_lodBuilder->IsBusy()) ||
+        g_vLodModels.size() < l_vPendingLods.size() ||
+        g_gpuTextures.GetStreamingBytes() > 0 || l_watcher.HasPending() ||
+        l_bInstanceDirty || l_bCameraDirty || g_scene.IsSettling() ||
+        l_viewport.IsResizing() ||
+        std::filesystem::path(l_strLastPath).extension() == a_ext;
+    l_iIdleFrames = l_bBusy ? 0 : l_iIdleFrames + 1;
   }
 
   if (l_SelectUI.m_bFinished) {
 
     // send the final path
   }
+
+  // what was baked this session is found without hashing next time
+  if (l_bakeCache && l_FileSystem.bakeOnLoad)
+    l_bakeCache->SaveManifest();
+}
+
+// baked models go through the mesh manager's own deserializer, anything else
+// is imported
+std::shared_ptr<Model> LoadModelFile(const std::string &path,
+                                     SModelTextures *textures) {
+  const uint32_t l_uFirstMaterial = g_materials.GetCount();
+
+  std::shared_ptr<Model> l_model;
+  if (std::filesystem::path(path).extension() != s_ext) {
+    l_model = Renderer::p_meshManager->LoadModel(path);
+  } else {
+    ModelID l_mID = Renderer::p_meshManager->LoadHazModel(path);
+    l_model = Renderer::p_meshManager->GetModel(l_mID);
+  }
+
+  SyncMaterials();
+  g_scene.InvalidateCommands();
+  if (l_model)
+    g_mapResident[l_model.get()] = {path, ModelCache::GetFileSize(path)};
+  if (textures)
+    for (const std::string &error : textures->errors)
+      SDL_Log("%s: %s", path.c_str(), error.c_str());
+  if (l_model && textures && !textures->Empty()) {
+    // the whole batch goes up at once, the CPU copies are done after
+    const std::vector<TextureID> l_vuTextures =
+        g_gpuTextures.Upload(std::move(textures->images), textures->keys);
+    ApplyModelTextures(l_model.get(), l_uFirstMaterial, textures->materials,
+                       l_vuTextures);
+    for (TextureID texture : l_vuTextures)
+      g_gpuTextures.Release(texture); // the model holds its own reference
+    *textures = {};
+  }
+  return l_model;
+}
+
+uint32_t SyncMaterials() {
+  auto l_materials = Renderer::p_materialManager->SubmitMaterials();
+  g_materials.Sync(l_materials.first);
+  if (l_materials.first.size() > CMaterialTable::s_uCapacity)
+    SDL_Log("%zu materials, only the first %u are drawn right",
+            l_materials.first.size(), CMaterialTable::s_uCapacity);
+  return g_materials.GetCount();
+}
+
+void ApplyModelTextures(const Model *model, uint32_t firstMaterial,
+                        const std::vector<MaterialImages> &materials,
+                        const std::vector<TextureID> &textures,
+                        bool borrowed) {
+  // glTF materials are imported in order, a default one can come after
+  if (g_materials.GetCount() < firstMaterial + materials.size()) {
+    SDL_Log("materials do not line up with the file, keeping the importer's "
+            "textures");
+    return;
+  }
+
+  SModelTextureSet &set = g_mapModelTextures[model];
+  set.textures = textures;
+  set.materials = materials;
+  set.firstMaterial = firstMaterial;
+  set.borrowed = borrowed;
+  for (TextureID texture : set.textures)
+    g_gpuTextures.Retain(texture);
+  UpdateTextureBytesShared();
+
+  for (size_t m = 0; m < materials.size(); m++)
+    for (size_t slot = 0; slot < materials[m].size(); slot++) {
+      const int32_t image = materials[m][slot];
+      if (image >= 0 && static_cast<size_t>(image) < textures.size())
+        g_materials.SetTexture(
+            firstMaterial + static_cast<uint32_t>(m), slot,
+            g_gpuTextures.GetHandle(textures[static_cast<size_t>(image)]));
+    }
+}
+
+// the GPU must be done with the model
+void ReleaseModelTextures(const Model *model) {
+  auto found = g_mapModelTextures.find(model);
+  if (found == g_mapModelTextures.end())
+    return;
+
+  const SModelTextureSet &set = found->second;
+  for (size_t m = 0; m < set.materials.size(); m++)
+    g_materials.ClearTextures(set.firstMaterial + static_cast<uint32_t>(m));
+  for (TextureID texture : set.textures)
+    g_gpuTextures.Release(texture);
+  g_mapModelTextures.erase(found);
+  UpdateTextureBytesShared();
+}
+
+// every image of every model counted as if it had a texture of its own
+void UpdateTextureBytesShared() {
+  uint64_t l_uUnshared = 0, l_uShared = 0;
+  std::unordered_set<TextureID> l_setCounted;
+  for (const auto &[model, set] : g_mapModelTextures) {
+    if (set.borrowed)
+      continue;
+    for (TextureID texture : set.textures) {
+      l_uUnshared += g_gpuTextures.GetSize(texture);
+      if (texture && l_setCounted.insert(texture).second)
+        l_uShared += g_gpuTextures.GetSize(texture);
+    }
+  }
+  g_uTextureBytesShared = l_uUnshared - l_uShared;
+}
+
+void ApplyTextureSwaps(const std::vector<STextureSwap> &swaps) {
+  for (const STextureSwap &swap : swaps)
+    for (const auto &[model, set] : g_mapModelTextures)
+      for (size_t m = 0; m < set.materials.size(); m++)
+        for (size_t slot = 0; slot < set.materials[m].size(); slot++) {
+          const int32_t image = set.materials[m][slot];
+          if (image >= 0 && static_cast<size_t>(image) < set.textures.size() &&
+              set.textures[static_cast<size_t>(image)] == swap.texture)
+            g_materials.SetTexture(set.firstMaterial + static_cast<uint32_t>(m),
+                                   slot, swap.handle);
+        }
 }
 
-void LoadSelectedModel(std::string path) {
+bool LoadSelectedModel(SStagedModel staged) {
+  const std::string &path = staged.path;
 
   auto &renderer = Renderer::r_instance;
 
@@ -340,11 +837,344 @@ void LoadSelectedModel(std::string path) {
   //
   //
 
+  // going back to a recently viewed model is just a pointer swap, the
+  // selection hands it over without staging
+  if (auto l_cached = g_modelCache.Get(path)) {
+    if (l_cached == g_sptrModel)
+      return false;
+    ReleaseLods();
+    g_sptrModel = l_cached;
+    return true;
+  }
+
+  // a broken .hzmdl was caught on the loader thread, keep the current model
+  if (!staged.error.empty()) {
+    SDL_Log("can not load %s: %s", path.c_str(), staged.error.c_str());
+    return false;
+  }
+
+  // the buffer can only be cleared before the import, afterwards it would
+  // take the new model with it
+  const std::string l_sShownPath = ClearStaticBufferIfDead();
+
+  // the current model stays resident and keeps its place until the new one
+  // has been imported, an import that fails leaves it shown
+  std::shared_ptr<Model> l_model =
+      LoadModelFile(staged.GetLoadPath(), &staged.textures);
+
+  if (!l_model) {
+    SDL_Log("can not load %s, keeping the current model", path.c_str());
+
+    // the clear took it along, it comes back without the textures the
+    // loader decoded for it
+    if (!l_sShownPath.empty() && (g_sptrModel = LoadModelFile(l_sShownPath))) {
+      Renderer::p_meshManager->SetModelShader(g_sptrModel, g_siShader);
+      g_modelCache.Insert(l_sShownPath, g_sptrModel,
+                          g_mapResident[g_sptrModel.get()].bytes);
+    }
+    return false;
+  }
+
   renderer->WaitForGPU();
-  Renderer::p_meshManager->EraseModel(g_sptrModel->GetID());
-  Renderer::p_bufferManager->ClearBuffer(TypeFlags::BUFFER_STATIC_MESH_DATA);
+  ReleaseLods();
+
+  // without a cache only one model is ever resident
+  if (!g_modelCache.IsEnabled() && g_sptrModel)
+    EraseResidentModel(g_sptrModel);
+  g_sptrModel = std::move(l_model);
+
+  if (!staged.meshlets.Empty())
+    g_mapMeshlets[g_sptrModel.get()] = std::move(staged.meshlets);
+
+  Renderer::p_meshManager->SetModelShader(g_sptrModel, g_siShader);
+
+  g_modelCache.Insert(path, g_sptrModel,
+                     ModelCache::GetFileSize(staged.GetLoadPath()));
+  return true;
+}
+
+// the levels go before their model does
+void ReleaseLods() {
+  if (g_vLodModels.empty())
+    return;
+
+  Renderer::r_instance->WaitForGPU();
+  for (const std::shared_ptr<Model> &model : g_vLodModels)
+    EraseResidentModel(model);
+  g_vLodModels.clear();
+  g_vfLodErrors.clear();
+  g_scene.InvalidateCommands();
+}
+
+void EraseResidentModel(const std::shared_ptr<Model> &model) {
+  auto l_resident = g_mapResident.find(model.get());
+  if (l_resident == g_mapResident.end())
+    return; // already erased
+  g_uStaticDeadBytes += l_resident->second.bytes;
+  g_mapResident.erase(l_resident);
+
+  g_mapMeshlets.erase(model.get());
+  ReleaseModelTextures(model.get());
+  Renderer::p_meshManager->EraseModel(model->GetID());
+  g_scene.InvalidateCommands();
+}
+
+std::string ClearStaticBufferIfDead() {
+  if (g_uStaticDeadBytes <= s_uMaxStaticDeadBytes)
+    return {};
+
+  std::string l_sShownPath;
+  if (auto l_shown = g_mapResident.find(g_sptrModel.get());
+      l_shown != g_mapResident.end())
+    l_sShownPath = l_shown->second.path;
+
+  Renderer::r_instance->WaitForGPU();
+  ReleaseLods();
+  g_modelCache.Clear();
+  if (g_sptrModel)
+    EraseResidentModel(g_sptrModel); // not in the cache when it is off
   g_sptrModel.reset();
-  g_sptrModel = Renderer::p_meshManager->LoadModel(path);
 
+  SDL_Log("clearing the static mesh buffer, %llu MB of it were erased models",
+          static_cast<unsigned long long>(g_uStaticDeadBytes >> 20));
+  Renderer::p_bufferManager->ClearBuffer(TypeFlags::BUFFER_STATIC_MESH_DATA);
+  g_uStaticDeadBytes = 0;
+  return l_sShownPath;
+}
+
+bool LoadLod(SLodLevel &level) {
+  const uint32_t l_uFirstMaterial = g_materials.GetCount();
+  auto l_model = LoadModelFile(level.path);
+  if (!l_model)
+    return false;
+
+  Renderer::p_meshManager->SetModelShader(l_model, g_siShader);
+
+  if (!level.meshlets.Empty())
+    g_mapMeshlets[l_model.get()] = std::move(level.meshlets);
+
+  // levels are always .glb bakes of the shown model's source, they have its
+  // images and show them with the textures it already has
+  auto l_full = g_mapModelTextures.find(g_sptrModel.get());
+  if (l_full != g_mapModelTextures.end())
+    ApplyModelTextures(l_model.get(), l_uFirstMaterial, level.images,
+                       l_full->second.textures, true);
+
+  g_vLodModels.push_back(std::move(l_model));
+  g_vfLodErrors.push_back(level.error);
+  return true;
+}
+
+// the same renderer, mesh manager and shaders as the viewer without a
+// window or ImGui. SDL's offscreen driver makes the context through EGL,
+// surfaceless where the driver has it, so llvmpipe draws on a machine
+// without a GPU. the model is staged on this thread the way a selection
+// is, with the bake and texture caches.
+int RunHeadless(const CFileSystem &fileSystem) {
+  using Clock = std::chrono::steady_clock;
+  const uint32_t l_uWidth = std::max(1u, fileSystem.headlessWidth);
+  const uint32_t l_uHeight = std::max(1u, fileSystem.headlessHeight);
+
+  SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "offscreen");
+  eHazGraphics::Renderer l_renderer;
+  l_renderer.Initialize(int(l_uWidth), int(l_uHeight), "Model viewer");
+  l_renderer.p_bufferManager->BeginWritting();
+
+  // the first material shows the missing texture, as in the viewer
+  uint AlbedoTexture = l_renderer.p_materialManager->LoadTexture(
+      PROJECT_ROOT_DIR "/assets/missing.png");
+  l_renderer.p_materialManager->CreatePBRMaterial(
+      AlbedoTexture, AlbedoTexture, AlbedoTexture, AlbedoTexture, "default_m");
+  SyncMaterials();
+  g_gpuTextures.SetStreamBudget(0); // every level before the first frame
+
+  SBufferRange l_brMaterials = l_renderer.p_bufferManager->InsertNewDynamicData(
+      g_materials.GetData(), g_materials.GetCapacityBytes(),
+      TypeFlags::BUFFER_TEXTURE_DATA);
+
+  g_siShader = l_renderer.p_shaderManager->CreateShaderProgramme(
+      PROJECT_ROOT_DIR "/assets/shader.vert",
+      PROJECT_ROOT_DIR "/assets/shader.frag");
+
+  std::unique_ptr<CBakeCache> l_bakeCache;
+  std::unique_ptr<CTextureCache> l_textureCache;
+  if (fileSystem.useBakeCache) {
+    l_bakeCache = std::make_unique<CBakeCache>(
+        fileSystem.bakeDir.empty() ? CBakeCache::GetDefaultDir()
+                                   : fileSystem.bakeDir);
+    l_bakeCache->LoadManifest();
+    if (fileSystem.useTextureCache) {
+      l_textureCache =
+          std::make_unique<CTextureCache>(l_bakeCache->GetDir() / "textures");
+      l_bakeCache->SetTextureCache(l_textureCache.get());
+    }
+  }
+
+  CTextureDecodePool l_texturePool(fileSystem.textureThreads);
+  SStagedModel l_staged;
+  l_staged.path = fileSystem.headlessModel.string();
+  std::vector<char> l_vcChunk;
+  // staging hashes, bakes and decodes, the import only uploads
+  const auto l_stageStart = Clock::now();
+  StageModel(l_staged, l_vcChunk, l_bakeCache.get(), &l_texturePool,
+             [] { return true; });
+  if (!l_staged.error.empty()) {
+    std::printf("can not load %s: %s\n", l_staged.path.c_str(),
+                l_staged.error.c_str());
+    return 1;
+  }
+
+  const auto l_importStart = Clock::now();
+  g_sptrModel = LoadModelFile(l_staged.GetLoadPath(), &l_staged.textures);
+  if (!g_sptrModel) {
+    std::printf("can not load %s\n", l_staged.path.c_str());
+    return 1;
+  }
   Renderer::p_meshManager->SetModelShader(g_sptrModel, g_siShader);
+  const auto l_importEnd = Clock::now();
+  const double l_dStageMs =
+      std::chrono::duration<double, std::milli>(l_importStart - l_stageStart)
+          .count();
+  const double l_dImportMs =
+      std::chrono::duration<double, std::milli>(l_importEnd - l_importStart)
+          .count();
+
+  eHazGraphics::FrameBuffer &mainFBO = l_renderer.GetMainFBO();
+  mainFBO.Resize(int(l_uWidth), int(l_uHeight));
+
+  // the camera keeps the viewer's direction and backs off until the
+  // sphere around the model's box fits the narrower field of view, the
+  // depth range hugs the sphere. only a glTF binary has bounds to read,
+  // a .hzmdl or another format keeps the viewer's start camera.
+  const float l_fAspect = float(l_uWidth) / float(l_uHeight);
+  glm::mat4 l_view = g_camera.GetViewMatrix();
+  glm::mat4 l_projection = glm::perspective(glm::radians(g_camera.Zoom),
+                                            l_fAspect, 0.1f, 100.0f);
+  float l_min[3], l_max[3];
+  bool l_bFitted = false;
+  {
+    CGlbFile l_glb;
+    std::string l_sError;
+    l_bFitted = (l_glb.Load(l_staged.GetLoadPath(), l_sError) ||
+                 l_glb.Load(l_staged.path, l_sError)) &&
+                GetModelBounds(l_glb.json, l_min, l_max);
+  }
+  if (l_bFitted) {
+    const glm::vec3 l_center = 0.5f * (glm::make_vec3(l_min) +
+                                       glm::make_vec3(l_max));
+    const float l_fRadius = std::max(
+        0.5f * glm::distance(glm::make_vec3(l_min), glm::make_vec3(l_max)),
+        1e-4f);
+    const float l_fHalfFovY = 0.5f * glm::radians(g_camera.Zoom);
+    const float l_fHalfFov = std::min(
+        l_fHalfFovY, std::atan(std::tan(l_fHalfFovY) * l_fAspect));
+    const float l_fDistance = l_fRadius / std::sin(l_fHalfFov);
+    const glm::vec3 l_direction =
+        glm::normalize(g_camera.Position - g_camera.Target);
+
+    l_view = glm::lookAt(l_center + l_direction * l_fDistance, l_center,
+                         g_camera.Up);
+    l_projection = glm::perspective(
+        2.0f * l_fHalfFovY, l_fAspect,
+        std::max(l_fDistance - l_fRadius, l_fDistance * 1e-3f),
+        l_fDistance + l_fRadius);
+  }
+
+  camData l_cdFinalData{l_view, l_projection};
+  l_renderer.SubmitDynamicData(&l_cdFinalData, sizeof(l_cdFinalData),
+                               TypeFlags::BUFFER_CAMERA_DATA);
+
+  const glm::mat4 pos(1.0f);
+  Renderer::r_instance->SubmitStaticModel(g_sptrModel, pos,
+                                          TypeFlags::BUFFER_STATIC_MESH_DATA);
+  auto l_vdrRanges = l_renderer.p_renderQueue->SubmitRenderCommands();
+  l_renderer.UpdateDynamicData(l_brMaterials, g_materials.GetData(),
+                               g_materials.GetBytes());
+
+  // glFinish puts the GPU's part of every frame into its time
+  CFrameHistogram l_frameTimes;
+  const auto l_start = Clock::now();
+  for (uint32_t frame = 0; frame < fileSystem.headlessFrames; frame++) {
+    const auto l_frameStart = Clock::now();
+
+    l_renderer.UpdateRenderer(1.0f / 60.0f);
+    l_renderer.SetFrameBuffer(mainFBO);
+    glViewport(0, 0, GLsizei(l_uWidth), GLsizei(l_uHeight));
+    l_renderer.RenderFrame(l_vdrRanges);
+    l_renderer.DefaultFrameBuffer();
+    glFinish();
+    l_renderer.EndFrame();
+
+    l_frameTimes.Add(static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                             l_frameStart)
+            .count()));
+  }
+  const double l_dTotalMs =
+      std::chrono::duration<double, std::milli>(Clock::now() - l_start)
+          .count();
+
+  std::printf("%s: staged in %.1f ms, imported in %.1f ms, %s camera, "
+              "%u frames at %ux%u in %.1f ms, p50 %.2f ms, p99 %.2f ms "
+              "(%s)\n",
+              l_staged.path.c_str(), l_dStageMs, l_dImportMs,
+              l_bFitted ? "fitted" : "default", fileSystem.headlessFrames,
+              l_uWidth, l_uHeight, l_dTotalMs,
+              l_frameTimes.GetPercentileMs(0.5),
+              l_frameTimes.GetPercentileMs(0.99),
+              reinterpret_cast<const char *>(glGetString(GL_RENDERER)));
+
+  if (!fileSystem.headlessOutput.empty()) {
+    // GL's rows go up, the png is written bottom up
+    std::vector<uint8_t> l_vPixels(size_t(l_uWidth) * l_uHeight * 4);
+    glGetTextureImage(mainFBO.GetColorTextures()[0].GetTextureID(), 0,
+                      GL_RGBA, GL_UNSIGNED_BYTE, GLsizei(l_vPixels.size()),
+                      l_vPixels.data());
+    std::string l_sError;
+    if (!SavePng(fileSystem.headlessOutput.c_str(), l_vPixels.data(),
+                 l_uWidth, l_uHeight, true, l_sError)) {
+      std::printf("can not write %s: %s\n",
+                  fileSystem.headlessOutput.c_str(), l_sError.c_str());
+      return 1;
+    }
+  }
+
+  Renderer::r_instance->WaitForGPU();
+  ReleaseModelTextures(g_sptrModel.get());
+  return 0;
+}
+
+bool WaitForWork(CFileWatcher &watcher, bool textInput) {
+  // the watcher has no fd SDL could wait on
+  static constexpr int32_t s_iPollMs = 100;
+  static constexpr int32_t s_iBlinkMs = 400; // ImGui's cursor is off 0.4 s
+
+  for (int32_t waited = 0;; waited += s_iPollMs) {
+    if (SDL_WaitEventTimeout(nullptr, s_iPollMs))
+      return true;
+
+    watcher.Poll();
+    if (watcher.HasPending())
+      return true;
+    if (textInput && waited + s_iPollMs >= s_iBlinkMs)
+      return false;
+  }
+}
+
+// every node instance is tested in its own mesh space, the planes come out
+// of the full clip matrix and the camera out of the inverse model view
+void CullModelMeshlets(SModelMeshlets &meshlets, const glm::mat4 &view,
+                       const glm::mat4 &projection,
+                       const glm::mat4 &modelMatrix, SMeshletCullStats &stats) {
+  float l_planes[6][4];
+  for (const SModelMeshlets::SInstance &instance : meshlets.instances) {
+    const glm::mat4 l_modelView =
+        view * modelMatrix * glm::make_mat4(instance.matrix);
+    const glm::mat4 l_clip = projection * l_modelView;
+    ExtractFrustumPlanes(glm::value_ptr(l_clip), l_planes);
+
+    const glm::vec4 l_camera = glm::inverse(l_modelView)[3];
+    const float l_cameraPos[3] = {l_camera.x, l_camera.y, l_camera.z};
+    CullMeshlets(meshlets, instance, l_planes, l_cameraPos, stats);
+  }
 }
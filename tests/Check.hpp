@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdio>
+
+// the tests are plain executables, a failed check prints where and the test
+// returns the number of failures as its exit code
+inline int g_iFailures = 0;
+
+#define CHECK(condition)                                                       \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,            \
+                  #condition);                                                 \
+      g_iFailures++;                                                           \
+    }                                                                          \
+  } while (false)
@@ -0,0 +1,112 @@
+#include "Check.hpp"
+#include "FrameLimiter.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+// time that only moves when the limiter reads or sleeps, or a frame works.
+// sleeps overshoot by half a millisecond, less than the limiter spins.
+struct STestClock {
+  uint64_t time = 1'000'000'000;
+
+  uint64_t Now() { return time += 1'000; }
+  void SleepFor(uint64_t ns) { time += ns + 500'000; }
+};
+
+static constexpr uint64_t s_uFrame60 = 1'000'000'000 / 60;
+
+// runs frames with work(frame) nanoseconds each and returns when each one
+// started, right after its BeginFrame. a frame that takes longer than the
+// estimate it started with missed its deadline and counts in late.
+template <typename F>
+static std::vector<uint64_t> RunFrames(CFrameLimiter<STestClock> &limiter,
+                                       uint32_t frames, F &&work,
+                                       uint32_t &late) {
+  STestClock &clock = limiter.GetClock();
+  std::vector<uint64_t> l_vuStarts;
+  late = 0;
+  for (uint32_t frame = 0; frame < frames; frame++) {
+    const uint64_t l_uEstimate = limiter.GetWorkEstimate();
+    limiter.BeginFrame();
+    l_vuStarts.push_back(clock.time);
+    const uint64_t l_uWork = work(frame);
+    clock.time += l_uWork;
+    limiter.EndFrame();
+    // the limiter's own clock reads take a few microseconds
+    if (frame >= CFrameLimiter<STestClock>::s_uWindow &&
+        l_uWork > l_uEstimate + 10'000)
+      late++;
+  }
+  return l_vuStarts;
+}
+
+// a frame shows when its work is done, so the limiter paces the starts.
+// every gap between them from first on is interval, give or take the spin,
+// and on average within a few clock reads of it.
+static void CheckIntervals(const std::vector<uint64_t> &starts, size_t first,
+                           uint64_t interval) {
+  for (size_t i = first + 1; i < starts.size(); i++) {
+    const int64_t l_iError =
+        int64_t(starts[i] - starts[i - 1]) - int64_t(interval);
+    CHECK(std::llabs(l_iError) <=
+          int64_t(CFrameLimiter<STestClock>::s_uSpinNs));
+  }
+  const uint64_t l_uMean =
+      (starts.back() - starts[first]) / (starts.size() - 1 - first);
+  CHECK(std::llabs(int64_t(l_uMean) - int64_t(interval)) <= 20'000);
+}
+
+int main() {
+  // fixed at 60 fps the frames are 16.67 ms apart however light they are
+  {
+    CFrameLimiter<STestClock> l_limiter(EFrameLimit::Fixed, 60);
+    CHECK(l_limiter.GetInterval() == s_uFrame60);
+    uint32_t l_uLate = 0;
+    const auto l_vuStarts = RunFrames(
+        l_limiter, 200,
+        [](uint32_t frame) { return frame % 2 ? 3'000'000ull : 5'000'000ull; },
+        l_uLate);
+    CheckIntervals(l_vuStarts, 64, s_uFrame60);
+    CHECK(l_uLate == 0);
+  }
+
+  // adaptive follows the 90th percentile of the work, plus a tenth
+  {
+    CFrameLimiter<STestClock> l_limiter(EFrameLimit::Adaptive, 60);
+    // two frames in ten take 20 ms, the rest 10
+    auto l_spiky = [](uint32_t frame) {
+      return frame % 10 < 8 ? 10'000'000ull : 20'000'000ull;
+    };
+    uint32_t l_uLate = 0;
+    auto l_vuStarts = RunFrames(l_limiter, 200, l_spiky, l_uLate);
+    const uint64_t l_uWork = l_limiter.GetWorkEstimate();
+    CHECK(l_uWork >= 20'000'000 && l_uWork <= 20'050'000);
+    CHECK(l_limiter.GetInterval() == l_uWork * 11 / 10);
+    CheckIntervals(l_vuStarts, 64, l_uWork * 11 / 10);
+    CHECK(l_uLate == 0);
+
+    // once the work is light again the cap takes over
+    l_vuStarts = RunFrames(
+        l_limiter, 200, [](uint32_t) { return 4'000'000ull; }, l_uLate);
+    const uint64_t l_uLight = l_limiter.GetWorkEstimate();
+    CHECK(l_uLight >= 4'000'000 && l_uLight <= 4'050'000);
+    CHECK(l_limiter.GetInterval() == s_uFrame60);
+    CheckIntervals(l_vuStarts, 64, s_uFrame60);
+  }
+
+  // neither paces, the frames come as fast as they are done
+  {
+    CFrameLimiter<STestClock> l_vsync(EFrameLimit::VSync, 60);
+    CFrameLimiter<STestClock> l_off(EFrameLimit::Off, 60);
+    CHECK(l_vsync.GetInterval() == 0 && l_off.GetInterval() == 0);
+    uint32_t l_uLate = 0;
+    const auto l_vuStarts = RunFrames(
+        l_off, 10, [](uint32_t) { return 2'000'000ull; }, l_uLate);
+    CHECK(l_vuStarts.back() - l_vuStarts.front() < 9 * 2'100'000ull);
+  }
+
+  if (g_iFailures == 0)
+    std::printf("frame limiter: ok\n");
+  return g_iFailures;
+}
@@ -0,0 +1,232 @@
+// eHazBake: bakes every .glb under a directory into the viewer's bake cache.
+// files whose content was baked before are skipped, unchanged files are not
+// even read thanks to the manifest.
+
+#include "BakeCache.hpp"
+#include "FileSystem.hpp"
+#include "ModelBaker.hpp"
+#include "TextureDecodePool.hpp"
+#include "ThreadPool.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct SBakeArgs {
+  fs::path root = ".";
+  fs::path cacheDir = CBakeCache::GetDefaultDir();
+  uint32_t threads = 0;
+  bool force = false;
+  bool textures = false;
+};
+
+void PrintHelp(const char *exeName) {
+  std::cout << "Usage:\n"
+               "  "
+            << exeName
+            << " [options] <dir>\n\n"
+               "Options:\n"
+               "  --help            Show this help message\n"
+               "  --out <path>      Bake cache directory "
+               "(default: ~/.cache/eHazViewer/baked)\n"
+               "  --threads <n>     Worker threads (default: all cores)\n"
+               "  --force           Bake again even if the cache is up to "
+               "date\n"
+               "  --textures        Compress the textures the bakes defer "
+               "to BC7/BC5 into\n"
+               "                    <out>/textures, the viewer uploads "
+               "them as they are\n\n"
+               "Example:\n"
+               "  "
+            << exeName << " --out ~/.cache/eHazViewer/baked assets\n";
+}
+
+bool ParseArgs(int argc, char **argv, SBakeArgs &args) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+
+    if (arg == "--help") {
+      PrintHelp(argv[0]);
+      std::exit(0);
+    } else if (arg == "--out" && i + 1 < argc) {
+      args.cacheDir = argv[++i];
+    } else if (arg == "--threads" && i + 1 < argc) {
+      args.threads =
+          static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--force") {
+      args.force = true;
+    } else if (arg == "--textures") {
+      args.textures = true;
+    } else if (!arg.starts_with("--")) {
+      args.root = arg;
+    } else {
+      std::cerr << "unknown option " << arg << "\n";
+      return false;
+    }
+  }
+  return true;
+}
+
+// compresses every image the bake deferred that the cache does not have
+// yet, on the calling thread. counts the images compressed and returns false
+// if one of them failed.
+bool CompressBakeTextures(const fs::path &bake, const CTextureCache &cache,
+                          uint32_t &compressed, std::string &error) {
+  CGlbFile l_glb;
+  if (!l_glb.Load(bake, error))
+    return false;
+
+  const std::vector<MaterialImages> l_vMaterials =
+      ReadMaterialImages(l_glb.json, true);
+  const CJson *images = l_glb.json.Find("images");
+  if (l_vMaterials.empty() || !images)
+    return true;
+
+  const std::vector<ETextureFormat> l_vFormats =
+      ChooseImageFormats(l_vMaterials, images->Size());
+  for (size_t i = 0; i < l_vFormats.size(); i++) {
+    if (l_vFormats[i] == ETextureFormat::RGBA8)
+      continue;
+
+    CMappedFile l_file;
+    size_t l_uSize = 0;
+    const uint8_t *data = ReadGlbImage(l_glb, images->GetArray()[i],
+                                       bake.parent_path(), l_file, l_uSize,
+                                       error);
+    if (!data)
+      return false;
+
+    const uint64_t l_uHash = CTextureCache::GetHash(data, l_uSize);
+    if (cache.Contains(l_uHash, l_vFormats[i]))
+      continue;
+
+    STextureImage l_image;
+    if (!DecodeImage(data, l_uSize, l_image, error))
+      return false;
+    if (!cache.Store(l_uHash, l_vFormats[i], l_image, [] { return true; })) {
+      error =
+          "could not write " + cache.GetPath(l_uHash, l_vFormats[i]).string();
+      return false;
+    }
+    compressed++;
+  }
+  return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  SBakeArgs l_args;
+  if (!ParseArgs(argc, argv, l_args))
+    return 2;
+
+  CFileSystem l_FileSystem;
+  l_FileSystem.root = l_args.root;
+  l_FileSystem.extensions = {".glb"};
+  l_FileSystem.scanThreads = l_args.threads;
+
+  CBakeCache l_cache(l_args.cacheDir);
+  l_cache.LoadManifest();
+  CTextureCache l_textureCache(l_args.cacheDir / "textures");
+
+  auto l_start = std::chrono::steady_clock::now();
+  std::vector<std::string> l_vsFiles = l_FileSystem.GetFilesFromRoot();
+
+  CWorkStealingPool l_pool(l_FileSystem.GetScanThreadCount());
+  std::vector<CModelBaker> l_vBakers(l_pool.GetThreadCount());
+  std::vector<std::vector<char>> l_vvcChunks(l_pool.GetThreadCount());
+  std::vector<SVertexCacheStats> l_vBefore(l_pool.GetThreadCount());
+  std::vector<SVertexCacheStats> l_vAfter(l_pool.GetThreadCount());
+
+  std::atomic<uint32_t> l_uBaked{0}, l_uSkipped{0}, l_uFailed{0};
+  std::atomic<uint32_t> l_uTextures{0};
+  std::mutex l_mtxLog;
+
+  for (const std::string &file : l_vsFiles) {
+    l_pool.Submit([&, source = l_FileSystem.root / file](uint32_t worker) {
+      auto l_fail = [&](const std::string &why) {
+        l_uFailed++;
+        std::lock_guard<std::mutex> lock(l_mtxLog);
+        std::cerr << source.string() << ": " << why << "\n";
+      };
+
+      uint64_t l_uHash = 0;
+      if (!l_cache.LookupHash(source, l_uHash)) {
+        if (!CBakeCache::HashFile(source, l_vvcChunks[worker], l_uHash,
+                                  [] { return true; })) {
+          l_fail("could not read");
+          return;
+        }
+        l_cache.Remember(source, l_uHash);
+      }
+
+      const fs::path l_glbPath = l_cache.GetBakedPath(l_uHash, ".glb");
+
+      auto l_compressTextures = [&] {
+        uint32_t l_uCompressed = 0;
+        std::string l_sError;
+        const bool ok = CompressBakeTextures(l_glbPath, l_textureCache,
+                                             l_uCompressed, l_sError);
+        l_uTextures += l_uCompressed;
+        if (!ok)
+          l_fail("textures not compressed, " + l_sError);
+        return ok;
+      };
+
+      std::error_code ec;
+      const bool l_bHaveGlb = fs::is_regular_file(l_glbPath, ec);
+      if (!l_args.force && l_bHaveGlb) {
+        if (!l_args.textures || l_compressTextures())
+          l_uSkipped++;
+        return;
+      }
+
+      CModelBaker &baker = l_vBakers[worker];
+      std::string l_sError;
+      if (!baker.Bake(source, l_glbPath, l_sError)) {
+        l_fail(l_sError);
+        return;
+      }
+      l_vBefore[worker] += baker.GetStatsBefore();
+      l_vAfter[worker] += baker.GetStatsAfter();
+
+      if (l_args.textures && !l_compressTextures())
+        return;
+
+      l_uBaked++;
+    });
+  }
+  l_pool.Wait();
+
+  if (!l_cache.SaveManifest())
+    std::cerr << "failed to write the manifest in " << l_args.cacheDir
+              << "\n";
+
+  double l_dSeconds = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - l_start)
+                          .count();
+  std::printf("%zu files: %u baked, %u up to date, %u failed (%.2f s)\n",
+              l_vsFiles.size(), l_uBaked.load(), l_uSkipped.load(),
+              l_uFailed.load(), l_dSeconds);
+  if (l_args.textures)
+    std::printf("%u textures compressed\n", l_uTextures.load());
+
+  SVertexCacheStats l_before, l_after;
+  for (size_t i = 0; i < l_vBefore.size(); i++) {
+    l_before += l_vBefore[i];
+    l_after += l_vAfter[i];
+  }
+  if (l_before.triangles)
+    std::printf("%llu triangles, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+                static_cast<unsigned long long>(l_before.triangles),
+                l_before.GetACMR(), l_after.GetACMR(), l_before.GetATVR(),
+                l_after.GetATVR());
+
+  return l_uFailed ? 1 : 0;
+}